@@ -0,0 +1,252 @@
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include "assetloader.hpp"
+#include "material.hpp"
+#include "texturecache.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+AssetLoader::AssetLoader(unsigned int threadCount, size_t uploadBytesPerFrame)
+    : pending(0), streamer(uploadBytesPerFrame), residency(NULL), pool(threadCount)
+{
+    taskThreads = std::max(1u, hardwareThreadCount() / pool.threadCount());
+}
+
+void AssetLoader::loadModel(Model &model, const char *path, bool optimize, float lodError)
+{
+    // Another model of the same file shares its mesh, loaded or not
+    bool created;
+    model.mesh = resourceCache().acquireMesh(path, optimize ? MESH_CACHE_OPTIMIZE : 0, lodError, created);
+    if (!created)
+        return;
+    
+    ModelRequest *request = new ModelRequest;
+    request->model = &model;
+    request->path = path;
+    request->optimize = optimize;
+    request->lodError = lodError;
+    request->loaded = false;
+    models.emplace_back(request);
+    pending++;
+    
+    pool.submit([this, request]
+    {
+        request->loaded = Model::loadObj(request->path.c_str(), request->cached,
+                                         request->optimize, request->lodError, taskThreads);
+        
+        Ready item = { request, NULL };
+        std::lock_guard<std::mutex> lock(readyMutex);
+        ready.push_back(item);
+    });
+}
+
+void AssetLoader::addTexture(Model &model, const char *path, const std::string &type, bool flipVertically)
+{
+    bool created;
+    uint32_t options = flipVertically ? TEXTURE_CACHE_FLIP_VERTICALLY : 0;
+    Attachment attachment;
+    attachment.model = &model;
+    attachment.texture.resource = resourceCache().acquireTexture(path, textureUsage(type), options, created);
+    attachment.texture.type = type;
+    attachment.texture.path = path;
+    unattached.push_back(attachment);
+    
+    if (created)
+        loadTexture(attachment.texture.resource, type, options);
+}
+
+void AssetLoader::loadTexture(const TextureHandle &texture, const std::string &type, uint32_t options)
+{
+    TextureRequest *request = new TextureRequest;
+    request->texture = texture;
+    request->type = type;
+    request->options = options;
+    request->loaded = false;
+    textures.emplace_back(request);
+    unplaced.push_back(request);
+    pending++;
+    
+    pool.submit([this, request] { decodeTexture(request); });
+}
+
+void AssetLoader::decodeTexture(TextureRequest *request)
+{
+    TRACE_SCOPE("AssetLoader::decodeTexture", request->texture->path);
+    
+    // Files with the same bytes as a texture already loaded share it
+    uint64_t contentHash;
+    request->loaded = loadTextureCache(request->texture->path.c_str(), textureUsage(request->type),
+                                       request->options, request->compressed, contentHash, NULL, taskThreads);
+    if (request->loaded)
+        request->original = resourceCache().shareTextureContents(request->texture, contentHash);
+    
+    Ready item = { NULL, request };
+    std::lock_guard<std::mutex> lock(readyMutex);
+    ready.push_back(item);
+}
+
+void AssetLoader::createPlaceholders()
+{
+    for (TextureRequest *request : unplaced)
+    {
+        // Workers can finish a texture queued during the last update
+        if (request->texture->id != 0 || request->texture->original || request->texture->array)
+            continue;
+        
+        // 1x1 stand ins: a flat normal for normal maps, mid grey for the rest
+        unsigned int kind = request->type == "normal" ? 0 : 1;
+        if (!placeholders[kind])
+        {
+            unsigned char pixel[3] = { 128, 128, kind == 0 ? (unsigned char)255 : (unsigned char)128 };
+            placeholders[kind] = std::make_shared<GpuTexture>();
+            glGenTextures(1, &placeholders[kind]->id);
+            placeholders[kind]->owned = true;
+            Model::uploadTexture(placeholders[kind]->id, 1, 1, 3, pixel);
+        }
+        request->texture->original = placeholders[kind];
+    }
+    unplaced.clear();
+    
+    // Textures for a model can be asked for before the model has any parts
+    size_t kept = 0;
+    for (Attachment &attachment : unattached)
+    {
+        if (attachment.model->mesh && attachment.model->mesh->loaded())
+            attachment.model->addTexture(attachment.texture);
+        else
+            unattached[kept++] = attachment;
+    }
+    unattached.resize(kept);
+}
+
+size_t AssetLoader::update(double budgetSeconds)
+{
+    createPlaceholders();
+    
+    auto start = std::chrono::steady_clock::now();
+    size_t uploaded = 0;
+    for (;;)
+    {
+        Ready item;
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            if (ready.empty())
+                break;
+            item = ready.front();
+            ready.pop_front();
+        }
+        
+        // Streamed textures are finished by the streamer
+        bool finished = true;
+        if (item.model)
+            uploadModel(*item.model);
+        else
+            finished = uploadTexture(*item.texture);
+        if (finished)
+        {
+            pending--;
+            uploaded++;
+        }
+        
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= budgetSeconds)
+            break;
+    }
+    
+    size_t streamed = streamer.update();
+    pending -= streamed;
+    uploaded += streamed;
+    
+    // Attach the textures of models uploaded just now
+    if (uploaded > 0)
+        createPlaceholders();
+    return uploaded;
+}
+
+void AssetLoader::finish()
+{
+    // Uploading a model can queue the texture maps of its materials
+    while (pending > 0)
+    {
+        pool.wait();
+        update(std::numeric_limits<double>::infinity());
+        
+        // Wait for the GPU to free a segment rather than spin
+        pending -= streamer.update(true);
+    }
+}
+
+void AssetLoader::uploadModel(ModelRequest &request)
+{
+    if (request.loaded)
+    {
+        request.model->upload(request.path.c_str(), request.cached, false);
+        
+        // Load the maps the materials name the first time they are used
+        MaterialTable &table = materialTable();
+        for (const ModelPart &part : request.model->mesh->parts)
+        {
+            for (Texture &texture : table.get(part.material).textures)
+            {
+                if (texture.resource)
+                    continue;
+                
+                bool created;
+                texture.resource = resourceCache().acquireTexture(texture.path.c_str(), textureUsage(texture.type),
+                                                                  0, created);
+                if (created)
+                    loadTexture(texture.resource, texture.type, 0);
+            }
+        }
+    }
+    
+    // The mesh is in GL buffers now, so the mapped cache can go
+    request.cached.release();
+}
+
+bool AssetLoader::uploadTexture(TextureRequest &request)
+{
+    GpuTexture &texture = *request.texture;
+    if (request.original)
+    {
+        texture.original = request.original;
+        request.compressed = CompressedTexture();
+        return true;
+    }
+    
+    if (!request.loaded)
+    {
+        printf("Texture %s failed to load.\n", texture.path.c_str());
+        return true;
+    }
+    
+    TRACE_SCOPE("AssetLoader::uploadTexture", texture.path);
+    GLenum internalFormat;
+    if (glBlockFormat(request.compressed.format, internalFormat))
+    {
+        // Managed textures start with their small levels, the rest are
+        // read back from the cache when needed
+        size_t firstLevel = 0;
+        std::string cachePath = textureCachePath(texture.path.c_str(), textureUsage(request.type), request.options);
+        if (residency && residency->add(request.texture, cachePath.c_str(), request.compressed))
+            firstLevel = residency->initialLevel(request.compressed);
+        streamer.upload(request.texture, request.compressed, firstLevel);
+        return false;
+    }
+    
+    // Levels the driver cannot take are decompressed, all at once
+    glGenTextures(1, &texture.id);
+    texture.owned = true;
+    texture.original.reset();
+    Model::uploadCompressedTexture(texture, request.compressed);
+    request.compressed = CompressedTexture();
+    return true;
+}
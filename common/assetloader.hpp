@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+
+#include "threadpool.hpp"
+#include "meshcache.hpp"
+#include "resourcecache.hpp"
+#include "model.hpp"
+#include "texturestreamer.hpp"
+#include "textureresidency.hpp"
+
+// Loads models and textures in the background. Files are read, parsed and
+// compressed or read from their caches on worker threads while the GL
+// thread carries on, and update()
+// creates the GL objects of the assets that are ready a few at a time so no
+// frame waits long for them. Texture levels stream in through a
+// TextureStreamer, uploadBytesPerFrame at most each update. Until then
+// models draw nothing and textures are a 1x1 placeholder. Assets the resource cache already has, or is
+// loading, are shared rather than loaded again.
+class AssetLoader
+{
+public:
+    // threadCount workers, 0 for one per core
+    explicit AssetLoader(unsigned int threadCount = 0, size_t uploadBytesPerFrame = 4 << 20);
+
+    // Start loading a model into model, which must outlive the loader.
+    // Needs no GL context, so loading can start before the window opens.
+    void loadModel(Model &model, const char *path, bool optimize = true,
+                   float lodError = meshCacheDefaultLodError);
+
+    // Add a texture to every material of model, like Model::addTexture,
+    // once the model is uploaded
+    void addTexture(Model &model, const char *path, const std::string &type, bool flipVertically = false);
+
+    // On the GL thread: upload assets that are ready until budgetSeconds
+    // have passed, at least one per call, and stream the next texture
+    // levels. Returns how many assets were finished.
+    size_t update(double budgetSeconds);
+
+    // Upload every asset, waiting for the workers
+    void finish();
+
+    // Assets being loaded and not uploaded yet
+    size_t pendingCount() const { return pending; }
+
+    // Hand the textures loaded from now on to residency, which must outlive
+    // the loader, uploading only their small levels. NULL uploads every level.
+    void setResidency(TextureResidency *residency) { this->residency = residency; }
+
+private:
+    AssetLoader(const AssetLoader &);
+    AssetLoader &operator=(const AssetLoader &);
+
+    struct ModelRequest
+    {
+        Model *model;
+        std::string path;
+        bool optimize;
+        float lodError;
+        CachedMesh cached;
+        bool loaded;
+    };
+
+    struct TextureRequest
+    {
+        TextureHandle texture;
+        std::string type;
+        uint32_t options;           // TextureCacheOptions
+        TextureHandle original;     // loaded texture with the same bytes
+        CompressedTexture compressed;
+        bool loaded;
+    };
+
+    // A texture for a model that may not be uploaded yet
+    struct Attachment
+    {
+        Model *model;
+        Texture texture;
+    };
+
+    // An asset the workers are done with
+    struct Ready
+    {
+        ModelRequest *model;
+        TextureRequest *texture;
+    };
+
+    void loadTexture(const TextureHandle &texture, const std::string &type, uint32_t options);
+    void decodeTexture(TextureRequest *request);
+    void uploadModel(ModelRequest &request);
+    bool uploadTexture(TextureRequest &request);
+
+    // Show new textures as placeholders, then add those of loaded models
+    void createPlaceholders();
+
+    std::vector<std::unique_ptr<ModelRequest>> models;
+    std::vector<std::unique_ptr<TextureRequest>> textures;
+    std::vector<TextureRequest *> unplaced;     // no placeholder yet
+    std::vector<Attachment> unattached;         // model not uploaded yet
+    TextureHandle placeholders[2];              // flat normal, mid grey
+    size_t pending;
+    TextureStreamer streamer;
+    TextureResidency *residency;
+
+    // Threads each worker's parsing or compressing may use, a share of the
+    // cores so the workers together don't start one per core each
+    unsigned int taskThreads;
+
+    std::mutex readyMutex;
+    std::deque<Ready> ready;
+
+    // Last so the workers stop before the requests they use are freed
+    ThreadPool pool;
+};
@@ -0,0 +1,670 @@
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bcn.hpp"
+#include "parallel.hpp"
+
+namespace
+{
+    // Rows of blocks below this are not worth a thread
+    const size_t minRowsPerThread = 8;
+
+    // BC7 4-bit index interpolation weights, out of 64
+    const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // Nearest BC7 weight index for a position along the endpoints, in 64ths
+    struct Bc7WeightTable
+    {
+        unsigned char nearest[65];
+
+        Bc7WeightTable()
+        {
+            for (int position = 0; position <= 64; position++)
+            {
+                int best = 0;
+                for (int i = 1; i < 16; i++)
+                {
+                    if (abs(bc7Weights[i] - position) < abs(bc7Weights[best] - position))
+                        best = i;
+                }
+                nearest[position] = static_cast<unsigned char>(best);
+            }
+        }
+    };
+    const Bc7WeightTable bc7WeightTable;
+
+    // Copy the 4x4 block at (blockX, blockY), repeating the edge pixels past
+    // the image
+    void fetchBlock(const unsigned char *rgba, unsigned int width, unsigned int height,
+                    unsigned int blockX, unsigned int blockY, unsigned char outBlock[64])
+    {
+        for (unsigned int y = 0; y < 4; y++)
+        {
+            unsigned int sourceY = std::min(blockY * 4 + y, height - 1);
+            for (unsigned int x = 0; x < 4; x++)
+            {
+                unsigned int sourceX = std::min(blockX * 4 + x, width - 1);
+                memcpy(&outBlock[(y * 4 + x) * 4], &rgba[(sourceY * width + sourceX) * 4], 4);
+            }
+        }
+    }
+
+    // Mean of the pixels and the axis they spread furthest along, found by
+    // power iteration on their covariance. The axis is zero for flat blocks.
+    template <int Channels>
+    void principalAxis(const float pixels[16][Channels], float outMean[Channels], float outAxis[Channels])
+    {
+        float minimum[Channels], maximum[Channels];
+        for (int c = 0; c < Channels; c++)
+        {
+            outMean[c] = 0.0f;
+            minimum[c] = maximum[c] = pixels[0][c];
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < Channels; c++)
+            {
+                outMean[c] += pixels[i][c] * (1.0f / 16.0f);
+                minimum[c] = std::min(minimum[c], pixels[i][c]);
+                maximum[c] = std::max(maximum[c], pixels[i][c]);
+            }
+        }
+
+        float covariance[Channels][Channels] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float offset[Channels];
+            for (int c = 0; c < Channels; c++)
+                offset[c] = pixels[i][c] - outMean[c];
+            for (int row = 0; row < Channels; row++)
+                for (int column = 0; column < Channels; column++)
+                    covariance[row][column] += offset[row] * offset[column];
+        }
+
+        // Start along the box diagonal, which is close for most blocks
+        for (int c = 0; c < Channels; c++)
+            outAxis[c] = maximum[c] - minimum[c];
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[Channels] = {};
+            float lengthSquared = 0.0f;
+            for (int row = 0; row < Channels; row++)
+            {
+                for (int column = 0; column < Channels; column++)
+                    next[row] += covariance[row][column] * outAxis[column];
+                lengthSquared += next[row] * next[row];
+            }
+            if (lengthSquared < 1e-12f)
+                break;
+            float scale = 1.0f / sqrtf(lengthSquared);
+            for (int c = 0; c < Channels; c++)
+                outAxis[c] = next[c] * scale;
+        }
+
+        float lengthSquared = 0.0f;
+        for (int c = 0; c < Channels; c++)
+            lengthSquared += outAxis[c] * outAxis[c];
+        float scale = lengthSquared > 1e-12f ? 1.0f / sqrtf(lengthSquared) : 0.0f;
+        for (int c = 0; c < Channels; c++)
+            outAxis[c] *= scale;
+    }
+
+    // Endpoints at the extremes of the pixels projected onto the axis
+    template <int Channels>
+    void axisEndpoints(const float pixels[16][Channels], float outLow[Channels], float outHigh[Channels])
+    {
+        float mean[Channels], axis[Channels];
+        principalAxis<Channels>(pixels, mean, axis);
+
+        float low = 0.0f, high = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < Channels; c++)
+                t += (pixels[i][c] - mean[c]) * axis[c];
+            low = std::min(low, t);
+            high = std::max(high, t);
+        }
+        for (int c = 0; c < Channels; c++)
+        {
+            outLow[c] = mean[c] + axis[c] * low;
+            outHigh[c] = mean[c] + axis[c] * high;
+        }
+    }
+
+    // Endpoints that best fit the pixels in the least squares sense, given
+    // the fraction of the high endpoint each pixel uses. False if the
+    // pixels all use the same fraction.
+    template <int Channels>
+    bool leastSquaresEndpoints(const float pixels[16][Channels], const float weights[16],
+                               float outLow[Channels], float outHigh[Channels])
+    {
+        float lowLow = 0.0f, lowHigh = 0.0f, highHigh = 0.0f;
+        float lowSum[Channels] = {}, highSum[Channels] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float high = weights[i], low = 1.0f - high;
+            lowLow += low * low;
+            lowHigh += low * high;
+            highHigh += high * high;
+            for (int c = 0; c < Channels; c++)
+            {
+                lowSum[c] += low * pixels[i][c];
+                highSum[c] += high * pixels[i][c];
+            }
+        }
+
+        float determinant = lowLow * highHigh - lowHigh * lowHigh;
+        if (fabsf(determinant) < 1e-6f)
+            return false;
+        float inverse = 1.0f / determinant;
+        for (int c = 0; c < Channels; c++)
+        {
+            outLow[c] = std::min(255.0f, std::max(0.0f, (highHigh * lowSum[c] - lowHigh * highSum[c]) * inverse));
+            outHigh[c] = std::min(255.0f, std::max(0.0f, (lowLow * highSum[c] - lowHigh * lowSum[c]) * inverse));
+        }
+        return true;
+    }
+
+    // Little endian writer and reader of bit fields, lowest bit first
+    struct BitWriter
+    {
+        unsigned char *bytes;
+        unsigned int position;
+
+        void write(unsigned int value, unsigned int bitCount)
+        {
+            for (unsigned int i = 0; i < bitCount; i++, position++)
+            {
+                if (value & (1u << i))
+                    bytes[position >> 3] |= static_cast<unsigned char>(1u << (position & 7));
+            }
+        }
+    };
+
+    struct BitReader
+    {
+        const unsigned char *bytes;
+        unsigned int position;
+
+        unsigned int read(unsigned int bitCount)
+        {
+            unsigned int value = 0;
+            for (unsigned int i = 0; i < bitCount; i++, position++)
+                value |= ((bytes[position >> 3] >> (position & 7)) & 1u) << i;
+            return value;
+        }
+    };
+
+    // BC1 colour blocks
+
+    uint16_t pack565(const float color[3])
+    {
+        int red = std::min(31, std::max(0, static_cast<int>(color[0] * (31.0f / 255.0f) + 0.5f)));
+        int green = std::min(63, std::max(0, static_cast<int>(color[1] * (63.0f / 255.0f) + 0.5f)));
+        int blue = std::min(31, std::max(0, static_cast<int>(color[2] * (31.0f / 255.0f) + 0.5f)));
+        return static_cast<uint16_t>((red << 11) | (green << 5) | blue);
+    }
+
+    void unpack565(uint16_t packed, int outColor[3])
+    {
+        int red = (packed >> 11) & 31, green = (packed >> 5) & 63, blue = packed & 31;
+        outColor[0] = (red << 3) | (red >> 2);
+        outColor[1] = (green << 2) | (green >> 4);
+        outColor[2] = (blue << 3) | (blue >> 2);
+    }
+
+    // The four colours of a block in four colour mode, in index order
+    void colorPalette(uint16_t color0, uint16_t color1, int outPalette[4][3])
+    {
+        unpack565(color0, outPalette[0]);
+        unpack565(color1, outPalette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            outPalette[2][c] = (2 * outPalette[0][c] + outPalette[1][c]) / 3;
+            outPalette[3][c] = (outPalette[0][c] + 2 * outPalette[1][c]) / 3;
+        }
+    }
+
+    // Nearest palette colour of every pixel, returning the squared error
+    int fitColorIndices(const float pixels[16][3], uint16_t color0, uint16_t color1, unsigned char outIndices[16])
+    {
+        int palette[4][3];
+        colorPalette(color0, color1, palette);
+
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int bestError = 0x7fffffff;
+            for (int entry = 0; entry < 4; entry++)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    int difference = palette[entry][c] - static_cast<int>(pixels[i][c]);
+                    error += difference * difference;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    outIndices[i] = static_cast<unsigned char>(entry);
+                }
+            }
+            total += bestError;
+        }
+        return total;
+    }
+
+    void encodeColorBlock(const unsigned char block[64], unsigned char outBlock[8])
+    {
+        float pixels[16][3];
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                pixels[i][c] = block[i * 4 + c];
+
+        float low[3], high[3];
+        axisEndpoints<3>(pixels, low, high);
+        uint16_t color0 = pack565(high), color1 = pack565(low);
+        unsigned char indices[16];
+        int error = fitColorIndices(pixels, color0, color1, indices);
+
+        // Refit the endpoints to the chosen indices while that helps
+        static const float highWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        for (int iteration = 0; iteration < 2 && error > 0; iteration++)
+        {
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+                weights[i] = highWeights[indices[i]];
+            if (!leastSquaresEndpoints<3>(pixels, weights, low, high))
+                break;
+
+            uint16_t refit0 = pack565(high), refit1 = pack565(low);
+            unsigned char refitIndices[16];
+            int refitError = fitColorIndices(pixels, refit0, refit1, refitIndices);
+            if (refitError >= error)
+                break;
+            color0 = refit0;
+            color1 = refit1;
+            error = refitError;
+            memcpy(indices, refitIndices, sizeof(indices));
+        }
+
+        // Four colour mode needs color0 > color1; swapping the endpoints
+        // swaps indices 0 with 1 and 2 with 3
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+            for (int i = 0; i < 16; i++)
+                indices[i] ^= 1;
+        }
+        else if (color0 == color1)
+        {
+            memset(indices, 0, sizeof(indices));
+        }
+
+        uint32_t bits = 0;
+        for (int i = 0; i < 16; i++)
+            bits |= static_cast<uint32_t>(indices[i]) << (i * 2);
+        outBlock[0] = static_cast<unsigned char>(color0);
+        outBlock[1] = static_cast<unsigned char>(color0 >> 8);
+        outBlock[2] = static_cast<unsigned char>(color1);
+        outBlock[3] = static_cast<unsigned char>(color1 >> 8);
+        for (int i = 0; i < 4; i++)
+            outBlock[4 + i] = static_cast<unsigned char>(bits >> (i * 8));
+    }
+
+    // BC3 colour is always in four colour mode
+    void decodeColorBlock(const unsigned char block[8], bool allowThreeColor, unsigned char outBlock[64])
+    {
+        uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+        uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+        int palette[4][3];
+        colorPalette(color0, color1, palette);
+
+        // Three colour mode: the midpoint and transparent black
+        bool threeColor = allowThreeColor && color0 <= color1;
+        if (threeColor)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+
+        uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+        for (int i = 0; i < 16; i++)
+        {
+            unsigned int index = (bits >> (i * 2)) & 3;
+            for (int c = 0; c < 3; c++)
+                outBlock[i * 4 + c] = static_cast<unsigned char>(palette[index][c]);
+            outBlock[i * 4 + 3] = threeColor && index == 3 ? 0 : 255;
+        }
+    }
+
+    // BC4 single channel blocks
+
+    // The eight values of a block with value0 > value1, in index order
+    void channelPalette(int value0, int value1, int outPalette[8])
+    {
+        outPalette[0] = value0;
+        outPalette[1] = value1;
+        if (value0 > value1)
+        {
+            for (int i = 1; i < 7; i++)
+                outPalette[i + 1] = ((7 - i) * value0 + i * value1) / 7;
+        }
+        else
+        {
+            for (int i = 1; i < 5; i++)
+                outPalette[i + 1] = ((5 - i) * value0 + i * value1) / 5;
+            outPalette[6] = 0;
+            outPalette[7] = 255;
+        }
+    }
+
+    // Channel channel of the block's pixels, with the endpoints at its
+    // extremes
+    void encodeChannelBlock(const unsigned char block[64], int channel, unsigned char outBlock[8])
+    {
+        int minimum = 255, maximum = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            minimum = std::min<int>(minimum, block[i * 4 + channel]);
+            maximum = std::max<int>(maximum, block[i * 4 + channel]);
+        }
+
+        int palette[8];
+        channelPalette(maximum, minimum, palette);
+        uint64_t bits = 0;
+        for (int i = 0; i < 16 && maximum > minimum; i++)
+        {
+            int value = block[i * 4 + channel];
+            int best = 0;
+            for (int entry = 1; entry < 8; entry++)
+            {
+                if (abs(palette[entry] - value) < abs(palette[best] - value))
+                    best = entry;
+            }
+            bits |= static_cast<uint64_t>(best) << (i * 3);
+        }
+
+        outBlock[0] = static_cast<unsigned char>(maximum);
+        outBlock[1] = static_cast<unsigned char>(minimum);
+        for (int i = 0; i < 6; i++)
+            outBlock[2 + i] = static_cast<unsigned char>(bits >> (i * 8));
+    }
+
+    void decodeChannelBlock(const unsigned char block[8], int channel, unsigned char outBlock[64])
+    {
+        int palette[8];
+        channelPalette(block[0], block[1], palette);
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; i++)
+            bits |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+        for (int i = 0; i < 16; i++)
+            outBlock[i * 4 + channel] = static_cast<unsigned char>(palette[(bits >> (i * 3)) & 7]);
+    }
+
+    // BC7 mode 6 blocks
+
+    struct Bc7Endpoints
+    {
+        int quantized[2][4];    // 7 bits per channel
+        int parity[2];          // p-bit shared by the channels of an endpoint
+        int decoded[2][4];
+    };
+
+    // Weight index of every pixel for the decoded endpoints, found by
+    // projecting onto the line between them, returning the squared error
+    int fitBc7Indices(const float pixels[16][4], const Bc7Endpoints &endpoints, unsigned char outIndices[16])
+    {
+        const int *low = endpoints.decoded[0], *high = endpoints.decoded[1];
+        float direction[4], lengthSquared = 0.0f;
+        for (int c = 0; c < 4; c++)
+        {
+            direction[c] = static_cast<float>(high[c] - low[c]);
+            lengthSquared += direction[c] * direction[c];
+        }
+        float scale = lengthSquared > 0.0f ? 64.0f / lengthSquared : 0.0f;
+
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < 4; c++)
+                t += (pixels[i][c] - low[c]) * direction[c];
+            int position = std::min(64, std::max(0, static_cast<int>(t * scale + 0.5f)));
+            unsigned char index = bc7WeightTable.nearest[position];
+            outIndices[i] = index;
+
+            int weight = bc7Weights[index];
+            for (int c = 0; c < 4; c++)
+            {
+                int value = ((64 - weight) * low[c] + weight * high[c] + 32) >> 6;
+                int difference = value - static_cast<int>(pixels[i][c]);
+                total += difference * difference;
+            }
+        }
+        return total;
+    }
+
+    // Quantise the endpoints with every combination of p-bits and keep the
+    // one with the least error
+    int quantizeBc7Endpoints(const float pixels[16][4], const float low[4], const float high[4],
+                             Bc7Endpoints &outEndpoints, unsigned char outIndices[16])
+    {
+        const float *endpoints[2] = { low, high };
+        int bestError = 0x7fffffff;
+        for (int parities = 0; parities < 4; parities++)
+        {
+            Bc7Endpoints candidate;
+            for (int e = 0; e < 2; e++)
+            {
+                int parity = (parities >> e) & 1;
+                candidate.parity[e] = parity;
+                for (int c = 0; c < 4; c++)
+                {
+                    int quantized = static_cast<int>((endpoints[e][c] - parity) * 0.5f + 0.5f);
+                    quantized = std::min(127, std::max(0, quantized));
+                    candidate.quantized[e][c] = quantized;
+                    candidate.decoded[e][c] = (quantized << 1) | parity;
+                }
+            }
+
+            unsigned char indices[16];
+            int error = fitBc7Indices(pixels, candidate, indices);
+            if (error < bestError)
+            {
+                bestError = error;
+                outEndpoints = candidate;
+                memcpy(outIndices, indices, 16);
+            }
+        }
+        return bestError;
+    }
+
+    void encodeBc7Block(const unsigned char block[64], unsigned char outBlock[16])
+    {
+        float pixels[16][4];
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 4; c++)
+                pixels[i][c] = block[i * 4 + c];
+
+        float low[4], high[4];
+        axisEndpoints<4>(pixels, low, high);
+        Bc7Endpoints endpoints;
+        unsigned char indices[16];
+        int error = quantizeBc7Endpoints(pixels, low, high, endpoints, indices);
+
+        // One least squares refit of the endpoints to the chosen weights
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+            weights[i] = bc7Weights[indices[i]] / 64.0f;
+        if (error > 0 && leastSquaresEndpoints<4>(pixels, weights, low, high))
+        {
+            Bc7Endpoints refit;
+            unsigned char refitIndices[16];
+            if (quantizeBc7Endpoints(pixels, low, high, refit, refitIndices) < error)
+            {
+                endpoints = refit;
+                memcpy(indices, refitIndices, sizeof(indices));
+            }
+        }
+
+        // The first index is stored without its top bit, so it must be
+        // under 8; swapping the endpoints mirrors every index
+        if (indices[0] & 8)
+        {
+            std::swap(endpoints.quantized[0], endpoints.quantized[1]);
+            std::swap(endpoints.parity[0], endpoints.parity[1]);
+            for (int i = 0; i < 16; i++)
+                indices[i] = static_cast<unsigned char>(15 - indices[i]);
+        }
+
+        memset(outBlock, 0, 16);
+        BitWriter writer = { outBlock, 0 };
+        writer.write(1u << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            writer.write(endpoints.quantized[0][c], 7);
+            writer.write(endpoints.quantized[1][c], 7);
+        }
+        writer.write(endpoints.parity[0], 1);
+        writer.write(endpoints.parity[1], 1);
+        writer.write(indices[0], 3);
+        for (int i = 1; i < 16; i++)
+            writer.write(indices[i], 4);
+    }
+
+    void decodeBc7Block(const unsigned char block[16], unsigned char outBlock[64])
+    {
+        if ((block[0] & 0x7f) != 0x40)
+        {
+            memset(outBlock, 0, 64);
+            return;
+        }
+
+        BitReader reader = { block, 7 };
+        int endpoints[2][4];
+        for (int c = 0; c < 4; c++)
+        {
+            endpoints[0][c] = reader.read(7) << 1;
+            endpoints[1][c] = reader.read(7) << 1;
+        }
+        for (int e = 0; e < 2; e++)
+        {
+            int parity = reader.read(1);
+            for (int c = 0; c < 4; c++)
+                endpoints[e][c] |= parity;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int weight = bc7Weights[reader.read(i == 0 ? 3 : 4)];
+            for (int c = 0; c < 4; c++)
+                outBlock[i * 4 + c] = static_cast<unsigned char>(
+                    ((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+        }
+    }
+
+    void encodeBlock(const unsigned char block[64], uint32_t format, unsigned char *outBlock)
+    {
+        switch (format)
+        {
+        case BLOCK_BC1:
+            encodeColorBlock(block, outBlock);
+            break;
+        case BLOCK_BC3:
+            encodeChannelBlock(block, 3, outBlock);
+            encodeColorBlock(block, outBlock + 8);
+            break;
+        case BLOCK_BC5:
+            encodeChannelBlock(block, 0, outBlock);
+            encodeChannelBlock(block, 1, outBlock + 8);
+            break;
+        case BLOCK_BC7:
+            encodeBc7Block(block, outBlock);
+            break;
+        }
+    }
+
+    void decodeBlock(const unsigned char *block, uint32_t format, unsigned char outBlock[64])
+    {
+        switch (format)
+        {
+        case BLOCK_BC1:
+            decodeColorBlock(block, true, outBlock);
+            break;
+        case BLOCK_BC3:
+            decodeColorBlock(block + 8, false, outBlock);
+            decodeChannelBlock(block, 3, outBlock);
+            break;
+        case BLOCK_BC5:
+            for (int i = 0; i < 16; i++)
+            {
+                outBlock[i * 4 + 2] = 0;
+                outBlock[i * 4 + 3] = 255;
+            }
+            decodeChannelBlock(block, 0, outBlock);
+            decodeChannelBlock(block + 8, 1, outBlock);
+            break;
+        case BLOCK_BC7:
+            decodeBc7Block(block, outBlock);
+            break;
+        }
+    }
+}
+
+size_t blockBytes(uint32_t format)
+{
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+size_t compressedImageSize(uint32_t format, unsigned int width, unsigned int height)
+{
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void compressImage(const unsigned char *rgba, unsigned int width, unsigned int height,
+                   uint32_t format, unsigned char *outBlocks, unsigned int threadCount)
+{
+    unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t rowBytes = blocksX * blockBytes(format);
+    parallelFor(blocksY, minRowsPerThread, threadCount, [&](size_t begin, size_t end)
+    {
+        unsigned char block[64];
+        for (size_t blockY = begin; blockY < end; blockY++)
+        {
+            unsigned char *row = outBlocks + blockY * rowBytes;
+            for (unsigned int blockX = 0; blockX < blocksX; blockX++)
+            {
+                fetchBlock(rgba, width, height, blockX, static_cast<unsigned int>(blockY), block);
+                encodeBlock(block, format, row + blockX * blockBytes(format));
+            }
+        }
+    });
+}
+
+void decompressImage(const unsigned char *blocks, unsigned int width, unsigned int height,
+                     uint32_t format, unsigned char *outRgba)
+{
+    unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    unsigned char block[64];
+    for (unsigned int blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (unsigned int blockX = 0; blockX < blocksX; blockX++)
+        {
+            decodeBlock(blocks, format, block);
+            blocks += blockBytes(format);
+
+            // Drop the padding of partial blocks
+            for (unsigned int y = 0; y < 4 && blockY * 4 + y < height; y++)
+            {
+                unsigned int columns = std::min(4u, width - blockX * 4);
+                memcpy(&outRgba[((blockY * 4 + y) * width + blockX * 4) * 4], &block[y * 16], columns * 4);
+            }
+        }
+    }
+}
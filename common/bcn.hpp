@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 4x4 block compression formats the GPU samples without decompressing.
+// Images that are not a multiple of 4 are padded by repeating their last
+// row and column.
+enum BlockFormat
+{
+    BLOCK_BC1 = 1,      // RGB with 565 endpoints, 8 bytes per block
+    BLOCK_BC3,          // BC1 colour and BC4 alpha, 16 bytes
+    BLOCK_BC5,          // red and green as two BC4 channels, 16 bytes
+    BLOCK_BC7           // RGBA with 7-bit endpoints (mode 6), 16 bytes
+};
+
+// Size of one block and of a whole image in bytes
+size_t blockBytes(uint32_t format);
+size_t compressedImageSize(uint32_t format, unsigned int width, unsigned int height);
+
+// Compress a width x height RGBA8 image into outBlocks, row of blocks after
+// row of blocks. Rows are split over up to threadCount threads (0 uses
+// every core).
+void compressImage(const unsigned char *rgba, unsigned int width, unsigned int height,
+                   uint32_t format, unsigned char *outBlocks, unsigned int threadCount = 0);
+
+// Decode blocks back to RGBA8, for GL drivers without the format and for
+// measuring the error. BC5 decodes with blue 0 and alpha 255, and BC7
+// blocks in modes other than 6 decode as transparent black.
+void decompressImage(const unsigned char *blocks, unsigned int width, unsigned int height,
+                     uint32_t format, unsigned char *outRgba);
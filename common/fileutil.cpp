@@ -0,0 +1,214 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "fileutil.hpp"
+
+bool readFile(const char *path, std::vector<char> &outData)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0)
+    {
+        fclose(file);
+        return false;
+    }
+
+    outData.resize(static_cast<size_t>(size) + 1);
+    size_t bytesRead = fread(outData.data(), 1, static_cast<size_t>(size), file);
+    fclose(file);
+
+    outData.resize(bytesRead + 1);
+    outData[bytesRead] = '\0';
+    return true;
+}
+
+bool writeFileAtomic(const char *path, const void *data, size_t size)
+{
+    std::string temporaryPath = std::string(path) + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    // rename() will not replace an existing file on Windows
+    remove(path);
+#endif
+    if (rename(temporaryPath.c_str(), path) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool getFileInfo(const char *path, uint64_t &outSize, int64_t &outModifiedTime)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path, &info) != 0)
+        return false;
+#else
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+#endif
+    outSize = static_cast<uint64_t>(info.st_size);
+    outModifiedTime = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+std::string directoryOf(const char *path)
+{
+    std::string directory(path);
+    size_t separator = directory.find_last_of("/\\");
+    if (separator == std::string::npos)
+        return std::string();
+    return directory.substr(0, separator + 1);
+}
+
+std::string canonicalPath(const char *path)
+{
+#ifdef _WIN32
+    char buffer[_MAX_PATH];
+    if (_fullpath(buffer, path, sizeof(buffer)) == NULL || GetFileAttributesA(buffer) == INVALID_FILE_ATTRIBUTES)
+        return path;
+    std::string canonical(buffer);
+    std::replace(canonical.begin(), canonical.end(), '\\', '/');
+    return canonical;
+#else
+    char *resolved = realpath(path, NULL);
+    if (resolved == NULL)
+        return path;
+    std::string canonical(resolved);
+    free(resolved);
+    return canonical;
+#endif
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+MappedFile::MappedFile()
+    : view(NULL), length(0)
+#ifdef _WIN32
+    , fileHandle(NULL), mappingHandle(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char *path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    length = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int file = ::open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        ::close(file);
+        return false;
+    }
+
+    void *mapped = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (mapped == MAP_FAILED)
+        return false;
+
+    view = mapped;
+    length = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (view == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+    fileHandle = NULL;
+    mappingHandle = NULL;
+#else
+    munmap(view, length);
+#endif
+    view = NULL;
+    length = 0;
+}
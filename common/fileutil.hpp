@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+// Read a whole file into memory. A terminating '\0' is appended so parsers
+// can scan past the last token without bounds checks.
+bool readFile(const char *path, std::vector<char> &outData);
+
+// Write a file through a temporary so readers never see a partial file
+bool writeFileAtomic(const char *path, const void *data, size_t size);
+
+// Size and modification time of a file
+bool getFileInfo(const char *path, uint64_t &outSize, int64_t &outModifiedTime);
+
+// Directory part of a path including the trailing separator, "" for none
+std::string directoryOf(const char *path);
+
+// Absolute path with links, "." and ".." resolved and '/' separators, so
+// every spelling of a file gives the same string. Files that do not exist
+// keep the path as given.
+std::string canonicalPath(const char *path);
+
+// 64-bit FNV-1a hash
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char *path);
+    void close();
+
+    const unsigned char *data() const { return static_cast<const unsigned char *>(view); }
+    size_t size() const { return length; }
+    bool isOpen() const { return view != NULL; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    void *view;
+    size_t length;
+#ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#endif
+};
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+Frustum extractFrustum(const glm::mat4 &clip)
+{
+    // Rows of the matrix; glm stores columns
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++)
+        rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[3] + rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+
+    for (glm::vec4 &plane : frustum.planes)
+    {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f)
+            plane /= length;
+    }
+    return frustum;
+}
+
+bool sphereInFrustum(const Frustum &frustum, const glm::vec3 &center, float radius)
+{
+    for (const glm::vec4 &plane : frustum.planes)
+    {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool boxInFrustum(const Frustum &frustum, const glm::vec3 &min, const glm::vec3 &max)
+{
+    for (const glm::vec4 &plane : frustum.planes)
+    {
+        // The corner furthest along the plane normal
+        glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x,
+                         plane.y >= 0.0f ? max.y : min.y,
+                         plane.z >= 0.0f ? max.z : min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+bool volumeInFrustum(const Frustum &frustum, const BoundingVolume &volume)
+{
+    return sphereInFrustum(frustum, volume.center, volume.radius) &&
+           boxInFrustum(frustum, volume.min, volume.max);
+}
+
+BoundingVolume transformVolume(const BoundingVolume &volume, const glm::mat4 &transform)
+{
+    // Each axis of the box extent spreads over the transformed axes by the
+    // absolute values of the matrix (Arvo)
+    glm::vec3 center = (volume.min + volume.max) * 0.5f;
+    glm::vec3 extent = (volume.max - volume.min) * 0.5f;
+    glm::vec3 newCenter(transform * glm::vec4(center, 1.0f));
+    glm::vec3 newExtent(0.0f);
+    for (int column = 0; column < 3; column++)
+        newExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+
+    float scale = std::max(glm::length(glm::vec3(transform[0])),
+                           std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+    BoundingVolume result;
+    result.min = newCenter - newExtent;
+    result.max = newCenter + newExtent;
+    result.center = glm::vec3(transform * glm::vec4(volume.center, 1.0f));
+    result.radius = volume.radius * scale;
+    return result;
+}
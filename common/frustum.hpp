@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a projection, as (normal, distance) with normals
+// pointing inwards and normalised so distances are in world units. Taken
+// from a view projection matrix the planes are in world space; taken from
+// a model view projection matrix they are in that model's space.
+struct Frustum
+{
+    glm::vec4 planes[6];    // left, right, bottom, top, near, far
+};
+
+// An axis aligned box and a sphere around the same object
+struct BoundingVolume
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float     radius;
+};
+
+// Extract the planes of an OpenGL clip space matrix (Gribb and Hartmann)
+Frustum extractFrustum(const glm::mat4 &clip);
+
+// False if the sphere lies entirely outside one of the planes
+bool sphereInFrustum(const Frustum &frustum, const glm::vec3 &center, float radius);
+
+// False if the box lies entirely outside one of the planes
+bool boxInFrustum(const Frustum &frustum, const glm::vec3 &min, const glm::vec3 &max);
+
+// The sphere test rejects most objects cheaply; the box is tighter for long
+// thin objects whose sphere still touches the frustum
+bool volumeInFrustum(const Frustum &frustum, const BoundingVolume &volume);
+
+// Bounds of a volume after a transform: the box enclosing the transformed
+// box, and the sphere scaled by the largest axis scale
+BoundingVolume transformVolume(const BoundingVolume &volume, const glm::mat4 &transform);
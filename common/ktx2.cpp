@@ -0,0 +1,242 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <string.h>
+
+#include "ktx2.hpp"
+#include "bcn.hpp"
+
+namespace
+{
+    const unsigned char ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    // Bytes of the identifier, header and index before the level index
+    const size_t ktx2LevelIndexOffset = 80;
+    const size_t ktx2LevelIndexEntry = 24;
+
+    // Khronos data format descriptor values for the basic descriptor block
+    const uint32_t dfdPrimariesBt709 = 1;
+    const uint32_t dfdTransferLinear = 1;
+    const uint32_t dfdChannelAlpha = 15;
+
+    struct Ktx2Format
+    {
+        uint32_t format;            // BlockFormat
+        uint32_t vkFormat;          // VK_FORMAT_*_UNORM_BLOCK
+        uint32_t colorModel;        // KHR_DF_MODEL_BC*
+        uint32_t sampleCount;
+        uint32_t sampleChannels[2];
+    };
+
+    const Ktx2Format ktx2Formats[] = {
+        { BLOCK_BC1, 131, 128, 1, { 0, 0 } },
+        { BLOCK_BC3, 137, 130, 2, { dfdChannelAlpha, 0 } },
+        { BLOCK_BC5, 141, 132, 2, { 0, 1 } },
+        { BLOCK_BC7, 145, 134, 1, { 0, 0 } }
+    };
+
+    const Ktx2Format *findFormat(uint32_t format, uint32_t vkFormat)
+    {
+        for (const Ktx2Format &entry : ktx2Formats)
+        {
+            if (entry.format == format || entry.vkFormat == vkFormat)
+                return &entry;
+        }
+        return NULL;
+    }
+
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void append32(std::vector<unsigned char> &image, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            image.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+
+    void write64(std::vector<unsigned char> &image, size_t offset, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+            image[offset + i] = static_cast<unsigned char>(value >> (i * 8));
+    }
+
+    uint32_t read32(const unsigned char *data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint64_t read64(const unsigned char *data)
+    {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    unsigned int levelSize(unsigned int size, size_t level)
+    {
+        return std::max(1u, size >> level);
+    }
+
+    // Check the header and level index, filling in all but the levels
+    bool readHeader(const unsigned char *data, size_t size, CompressedTexture &outTexture, uint32_t &outLevelCount)
+    {
+        if (size < ktx2LevelIndexOffset || memcmp(data, ktx2Identifier, sizeof(ktx2Identifier)) != 0)
+            return false;
+
+        const unsigned char *header = data + sizeof(ktx2Identifier);
+        const Ktx2Format *format = findFormat(0, read32(header));
+        uint32_t width = read32(header + 8), height = read32(header + 12);
+        uint32_t levelCount = read32(header + 28);
+        if (!format || read32(header + 16) != 0 || read32(header + 20) > 1 || read32(header + 24) != 1 ||
+            read32(header + 32) != 0 || width == 0 || height == 0 || levelCount == 0 || levelCount > 32 ||
+            size < ktx2LevelIndexOffset + levelCount * ktx2LevelIndexEntry)
+            return false;
+
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            const unsigned char *entry = data + ktx2LevelIndexOffset + level * ktx2LevelIndexEntry;
+            uint64_t offset = read64(entry), length = read64(entry + 8);
+            if (offset > size || length > size - offset ||
+                length != compressedImageSize(format->format, levelSize(width, level), levelSize(height, level)))
+                return false;
+        }
+
+        outTexture.format = format->format;
+        outTexture.width = width;
+        outTexture.height = height;
+        outTexture.levels.clear();
+        outLevelCount = levelCount;
+        return true;
+    }
+
+    void copyLevel(const unsigned char *data, uint32_t level, std::vector<unsigned char> &outBlocks)
+    {
+        const unsigned char *entry = data + ktx2LevelIndexOffset + level * ktx2LevelIndexEntry;
+        uint64_t offset = read64(entry), length = read64(entry + 8);
+        outBlocks.assign(data + offset, data + offset + length);
+    }
+}
+
+void writeKtx2(const CompressedTexture &texture, const Ktx2KeyValues &keyValues,
+               std::vector<unsigned char> &outImage)
+{
+    const Ktx2Format &format = *findFormat(texture.format, 0);
+    uint32_t levelCount = static_cast<uint32_t>(texture.levels.size());
+    uint32_t blockSize = static_cast<uint32_t>(blockBytes(texture.format));
+
+    outImage.assign(ktx2Identifier, ktx2Identifier + sizeof(ktx2Identifier));
+    append32(outImage, format.vkFormat);
+    append32(outImage, 1);                  // typeSize
+    append32(outImage, texture.width);
+    append32(outImage, texture.height);
+    append32(outImage, 0);                  // pixelDepth
+    append32(outImage, 0);                  // layerCount
+    append32(outImage, 1);                  // faceCount
+    append32(outImage, levelCount);
+    append32(outImage, 0);                  // supercompressionScheme
+
+    // Index, patched once the sections are laid out, then the level index
+    size_t indexOffset = outImage.size();
+    outImage.resize(ktx2LevelIndexOffset + levelCount * ktx2LevelIndexEntry, 0);
+
+    // Data format descriptor: one basic block describing the block format
+    uint32_t dfdOffset = static_cast<uint32_t>(outImage.size());
+    uint32_t basicBlockSize = 24 + 16 * format.sampleCount;
+    append32(outImage, 4 + basicBlockSize);
+    append32(outImage, 0);                  // Khronos vendor, basic descriptor type
+    append32(outImage, 2 | (basicBlockSize << 16));
+    append32(outImage, format.colorModel | (dfdPrimariesBt709 << 8) | (dfdTransferLinear << 16));
+    append32(outImage, 3 | (3 << 8));       // 4x4 texel blocks
+    append32(outImage, blockSize);
+    append32(outImage, 0);
+    for (uint32_t i = 0; i < format.sampleCount; i++)
+    {
+        uint32_t bitLength = blockSize * 8 / format.sampleCount - 1;
+        append32(outImage, (i * 64) | (bitLength << 16) | (format.sampleChannels[i] << 24));
+        append32(outImage, 0);              // sample position
+        append32(outImage, 0);              // sampleLower
+        append32(outImage, 0xFFFFFFFFu);    // sampleUpper
+    }
+    uint32_t dfdLength = static_cast<uint32_t>(outImage.size()) - dfdOffset;
+
+    // Key/value data, sorted by key, each entry padded to 4 bytes
+    Ktx2KeyValues sorted = keyValues;
+    std::sort(sorted.begin(), sorted.end());
+    uint32_t kvdOffset = static_cast<uint32_t>(outImage.size());
+    for (const std::pair<std::string, std::string> &keyValue : sorted)
+    {
+        append32(outImage, static_cast<uint32_t>(keyValue.first.size() + 1 + keyValue.second.size()));
+        outImage.insert(outImage.end(), keyValue.first.begin(), keyValue.first.end());
+        outImage.push_back('\0');
+        outImage.insert(outImage.end(), keyValue.second.begin(), keyValue.second.end());
+        outImage.resize(alignUp(outImage.size(), 4), 0);
+    }
+    uint32_t kvdLength = static_cast<uint32_t>(outImage.size()) - kvdOffset;
+
+    size_t index[] = { dfdOffset, dfdLength, kvdOffset, kvdLength };
+    for (size_t i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 4; b++)
+            outImage[indexOffset + i * 4 + b] = static_cast<unsigned char>(index[i] >> (b * 8));
+    }
+
+    // Levels, smallest first, each aligned to a whole block
+    for (size_t level = levelCount; level-- > 0;)
+    {
+        outImage.resize(alignUp(outImage.size(), blockSize), 0);
+        size_t entry = ktx2LevelIndexOffset + level * ktx2LevelIndexEntry;
+        write64(outImage, entry, outImage.size());
+        write64(outImage, entry + 8, texture.levels[level].size());
+        write64(outImage, entry + 16, texture.levels[level].size());
+        outImage.insert(outImage.end(), texture.levels[level].begin(), texture.levels[level].end());
+    }
+}
+
+bool readKtx2(const unsigned char *data, size_t size, CompressedTexture &outTexture,
+              Ktx2KeyValues *outKeyValues)
+{
+    uint32_t levelCount;
+    if (!readHeader(data, size, outTexture, levelCount))
+        return false;
+
+    const unsigned char *header = data + sizeof(ktx2Identifier);
+    outTexture.levels.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; level++)
+        copyLevel(data, level, outTexture.levels[level]);
+
+    if (outKeyValues)
+    {
+        outKeyValues->clear();
+        uint32_t kvdOffset = read32(header + 44), kvdLength = read32(header + 48);
+        if (kvdOffset > size || kvdLength > size - kvdOffset)
+            return false;
+        const unsigned char *entry = data + kvdOffset, *end = entry + kvdLength;
+        while (end - entry >= 4)
+        {
+            uint32_t length = read32(entry);
+            const char *text = reinterpret_cast<const char *>(entry + 4);
+            if (length > static_cast<size_t>(end - entry) - 4)
+                return false;
+            const char *keyEnd = static_cast<const char *>(memchr(text, '\0', length));
+            if (keyEnd)
+                outKeyValues->push_back(std::make_pair(std::string(text, keyEnd),
+                                                       std::string(keyEnd + 1, text + length)));
+            entry += alignUp(4 + length, 4);
+        }
+    }
+    return true;
+}
+
+bool readKtx2Level(const unsigned char *data, size_t size, uint32_t level, CompressedTexture &outTexture,
+                   std::vector<unsigned char> &outBlocks)
+{
+    uint32_t levelCount;
+    if (!readHeader(data, size, outTexture, levelCount) || level >= levelCount)
+        return false;
+    copyLevel(data, level, outBlocks);
+    return true;
+}
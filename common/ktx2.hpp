@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+// Block compressed image and its mip levels, largest first. Level i is
+// max(1, width >> i) by max(1, height >> i) pixels.
+struct CompressedTexture
+{
+    uint32_t format;        // BlockFormat
+    unsigned int width;
+    unsigned int height;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+typedef std::vector<std::pair<std::string, std::string>> Ktx2KeyValues;
+
+// Serialise a texture as a KTX2 file: header, level index, data format
+// descriptor, key/value data and the levels, smallest first
+void writeKtx2(const CompressedTexture &texture, const Ktx2KeyValues &keyValues,
+               std::vector<unsigned char> &outImage);
+
+// Parse a KTX2 file holding a 2D texture in one of the block formats.
+// Other formats, supercompression, arrays, cube maps and 3D textures fail.
+bool readKtx2(const unsigned char *data, size_t size, CompressedTexture &outTexture,
+              Ktx2KeyValues *outKeyValues = NULL);
+
+// Parse the header of a KTX2 file like readKtx2, leaving outTexture's
+// levels empty, and copy just one level out of it
+bool readKtx2Level(const unsigned char *data, size_t size, uint32_t level, CompressedTexture &outTexture,
+                   std::vector<unsigned char> &outBlocks);
@@ -0,0 +1,268 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "material.hpp"
+#include "texturearray.hpp"
+#include "uniforms.hpp"
+#include "fileutil.hpp"
+
+Material::Material()
+    : ka(0.0f), kd(1.0f), ks(0.0f), Ns(0.0f)
+{
+}
+
+namespace
+{
+    const char *const samplerTypes[samplerTypeCount] = { "diffuse", "spec", "normal" };
+    const unsigned int specUnit = 1, normalUnit = 2;
+
+    // Unit of a map type's 2D sampler, or -1 if the shader has none
+    int samplerUnit(const std::string &type)
+    {
+        for (unsigned int i = 0; i < samplerTypeCount; i++)
+        {
+            if (type == samplerTypes[i])
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+}
+
+const char *samplerType(unsigned int index)
+{
+    return samplerTypes[index];
+}
+
+void setTextureUnits(unsigned int shaderID)
+{
+    // Samplers of different types may not share a unit, so each has its own
+    const ShaderUniforms &uniforms = shaderUniforms(shaderID);
+    for (unsigned int i = 0; i < samplerTypeCount; i++)
+    {
+        setUniform(uniforms.maps[i], static_cast<int>(i));
+        setUniform(uniforms.arrays[i], static_cast<int>(samplerTypeCount + i));
+    }
+}
+
+void TextureBindings::reset()
+{
+    for (unsigned int i = 0; i < textureUnitCount; i++)
+        known[i] = false;
+    binds = 0;
+}
+
+void TextureBindings::bind(unsigned int unit, unsigned int target, unsigned int id)
+{
+    if (known[unit] && ids[unit] == id)
+        return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, id);
+    ids[unit] = id;
+    known[unit] = true;
+    binds++;
+}
+
+void Material::bind(unsigned int shaderID) const
+{
+    TextureBindings bindings;
+    bind(shaderID, bindings);
+}
+
+void Material::bind(unsigned int shaderID, TextureBindings &bindings) const
+{
+    bind(shaderUniforms(shaderID), bindings);
+}
+
+void Material::bind(const ShaderUniforms &uniforms, TextureBindings &bindings) const
+{
+    // Send material properties to the shader
+    setUniform(uniforms.ka, ka);
+    setUniform(uniforms.kd, kd);
+    setUniform(uniforms.ks, ks);
+    setUniform(uniforms.ns, Ns);
+
+    // Bind the textures, packed ones as a layer of their array
+    bool sampled[samplerTypeCount] = { false, false, false };
+    for (const Texture &texture : textures)
+    {
+        int unit = samplerUnit(texture.type);
+        if (unit < 0)
+            continue;
+        sampled[unit] = true;
+
+        int layer = -1;
+        const GpuTexture *drawn = texture.resource ? &texture.resource->drawn() : NULL;
+        if (drawn && drawn->array)
+        {
+            bindings.bind(samplerTypeCount + unit, GL_TEXTURE_2D_ARRAY, drawn->array->id);
+            layer = static_cast<int>(drawn->layer);
+        }
+        else
+            bindings.bind(unit, GL_TEXTURE_2D, drawn ? drawn->id : 0);
+        setUniform(uniforms.layers[unit], layer);
+    }
+    setUniform(uniforms.useNormalAndSpec, static_cast<int>(sampled[normalUnit] && sampled[specUnit]));
+}
+
+unsigned int Material::textureKey() const
+{
+    if (textures.empty() || !textures[0].resource)
+        return 0;
+    const GpuTexture &drawn = textures[0].resource->drawn();
+    return drawn.array ? drawn.array->id : drawn.id;
+}
+
+bool Material::hasTexture(const std::string &type) const
+{
+    for (const Texture &texture : textures)
+    {
+        if (texture.type == type)
+            return true;
+    }
+    return false;
+}
+
+namespace
+{
+    // Add a texture map statement. Options such as -bm come before the file
+    // name, so the last word on the line is taken as the file.
+    void addMap(Material &material, const char *type, const char *rest, const std::string &directory)
+    {
+        const char *file = NULL;
+        for (const char *c = rest; *c; c++)
+        {
+            if (*c != ' ' && *c != '\t' && (c == rest || c[-1] == ' ' || c[-1] == '\t'))
+                file = c;
+        }
+        if (file == NULL)
+            return;
+
+        Texture texture;
+        texture.type = type;
+        texture.path = directory + file;
+        material.textures.push_back(texture);
+    }
+}
+
+void MaterialTable::loadLibrary(const std::string &path)
+{
+    if (libraries.count(path))
+        return;
+    libraries[path] = true;
+
+    std::vector<char> data;
+    if (!readFile(path.c_str(), data))
+    {
+        printf("Material library %s not found, using default materials\n", path.c_str());
+        return;
+    }
+
+    std::string directory = directoryOf(path.c_str());
+    Material *material = NULL;
+
+    char *line = data.data();
+    while (*line)
+    {
+        // Split off one line, trimming the line ending and leading spaces
+        char *end = line + strcspn(line, "\r\n");
+        char *next = end + strspn(end, "\r\n");
+        *end = '\0';
+        while (*line == ' ' || *line == '\t')
+            line++;
+
+        char keyword[32];
+        int length = 0;
+        if (sscanf(line, "%31s%n", keyword, &length) == 1)
+        {
+            const char *rest = line + length;
+            while (*rest == ' ' || *rest == '\t')
+                rest++;
+
+            if (strcmp(keyword, "newmtl") == 0)
+            {
+                std::string key = path + '\n' + rest;
+                if (ids.count(key) == 0)
+                {
+                    ids[key] = static_cast<unsigned int>(materials.size());
+                    materials.push_back(Material());
+                    materials.back().name = rest;
+                }
+                material = &materials[ids[key]];
+            }
+            else if (material == NULL)
+            {
+                // Statements before the first newmtl have nothing to apply to
+            }
+            else if (strcmp(keyword, "Ka") == 0)
+                sscanf(rest, "%f %f %f", &material->ka.x, &material->ka.y, &material->ka.z);
+            else if (strcmp(keyword, "Kd") == 0)
+                sscanf(rest, "%f %f %f", &material->kd.x, &material->kd.y, &material->kd.z);
+            else if (strcmp(keyword, "Ks") == 0)
+                sscanf(rest, "%f %f %f", &material->ks.x, &material->ks.y, &material->ks.z);
+            else if (strcmp(keyword, "Ns") == 0)
+                sscanf(rest, "%f", &material->Ns);
+            else if (strcmp(keyword, "map_Kd") == 0)
+                addMap(*material, "diffuse", rest, directory);
+            else if (strcmp(keyword, "map_Ks") == 0)
+                addMap(*material, "spec", rest, directory);
+            else if (strcmp(keyword, "map_Bump") == 0 || strcmp(keyword, "bump") == 0 ||
+                     strcmp(keyword, "norm") == 0)
+                addMap(*material, "normal", rest, directory);
+        }
+        line = next;
+    }
+}
+
+unsigned int MaterialTable::acquire(const std::vector<std::string> &libraryPaths,
+                                    const std::string &name,
+                                    const std::string &owner)
+{
+    for (const std::string &library : libraryPaths)
+    {
+        loadLibrary(library);
+        auto found = ids.find(library + '\n' + name);
+        if (found != ids.end())
+            return found->second;
+    }
+
+    // Not defined anywhere, so give the owner a default it can add textures to
+    std::string key = owner + '\n' + name;
+    auto found = ids.find(key);
+    if (found != ids.end())
+        return found->second;
+
+    unsigned int id = static_cast<unsigned int>(materials.size());
+    ids[key] = id;
+    materials.push_back(Material());
+    materials.back().name = name;
+    return id;
+}
+
+unsigned int MaterialTable::withTexture(unsigned int id, const Texture &texture)
+{
+    // Textures are told apart by their resource, which the variant keeps
+    // alive, or by path until they have one
+    char source[32];
+    snprintf(source, sizeof(source), "\n%u\n%p\n", id, static_cast<const void *>(texture.resource.get()));
+    std::string key = source + texture.type + '\n' + texture.path;
+    auto found = ids.find(key);
+    if (found != ids.end())
+        return found->second;
+
+    unsigned int variant = static_cast<unsigned int>(materials.size());
+    ids[key] = variant;
+    materials.push_back(materials[id]);
+    materials.back().textures.push_back(texture);
+    return variant;
+}
+
+MaterialTable &materialTable()
+{
+    static MaterialTable table;
+    return table;
+}
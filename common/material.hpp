@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "resourcecache.hpp"
+
+// Texture struct
+struct Texture
+{
+    TextureHandle resource;
+    std::string type;       // sampler name without the "Map" suffix
+    std::string path;       // file to load while resource is still NULL
+
+    unsigned int id() const { return resource ? resource->glId() : 0; }
+};
+
+// Texture units of the maps the shader samples: diffuse, spec and normal
+// on units 0 to 2 as 2D textures and 3 to 5 as array layers
+const unsigned int samplerTypeCount = 3;
+const unsigned int textureUnitCount = 2 * samplerTypeCount;
+
+struct ShaderUniforms;
+
+// Map type sampled on unit index, "diffuse", "spec" or "normal"
+const char *samplerType(unsigned int index);
+
+// Point the shader's <type>Map and <type>Array samplers at their units,
+// once per program
+void setTextureUnits(unsigned int shaderID);
+
+// The texture bound to each unit, so binding it again is skipped
+class TextureBindings
+{
+public:
+    TextureBindings() { reset(); }
+
+    // Forget what is bound, after other code has bound textures
+    void reset();
+
+    void bind(unsigned int unit, unsigned int target, unsigned int id);
+
+    // glBindTexture calls made since the last reset
+    unsigned int bindCount() const { return binds; }
+
+private:
+    unsigned int ids[textureUnitCount];
+    bool known[textureUnitCount];
+    unsigned int binds;
+};
+
+// Surface properties from a .mtl file, shared by every model that uses it
+struct Material
+{
+    std::string name;
+    glm::vec3 ka, kd, ks;
+    float Ns;
+    std::vector<Texture> textures;
+
+    Material();
+
+    // Send the properties to the shader and bind the maps to the units of
+    // their type, with each map's layer, or -1 when it is not in an array.
+    // Textures already bound in bindings are not bound again. Normal
+    // mapping is enabled when the material has both a normal and a
+    // specular map. Uniforms are set through the program's resolved
+    // locations, see uniforms.hpp.
+    void bind(unsigned int shaderID) const;
+    void bind(unsigned int shaderID, TextureBindings &bindings) const;
+    void bind(const ShaderUniforms &uniforms, TextureBindings &bindings) const;
+
+    // GL texture of the first map, to draw materials sharing it together
+    unsigned int textureKey() const;
+
+    bool hasTexture(const std::string &type) const;
+
+    // Number of glUniform and glBindTexture calls made by bind()
+    unsigned int uniformCount() const { return 5 + static_cast<unsigned int>(textures.size()); }
+    unsigned int textureCount() const { return static_cast<unsigned int>(textures.size()); }
+};
+
+// Table of every material loaded so far. Each .mtl file is read once and
+// materials are referred to by their index in the table.
+class MaterialTable
+{
+public:
+    // Index of material name from the first of the libraries defining it.
+    // Names no library defines get a default material private to owner.
+    unsigned int acquire(const std::vector<std::string> &libraryPaths,
+                         const std::string &name,
+                         const std::string &owner);
+
+    // Index of material id with texture added to its maps. Adding the same
+    // texture to the same material again gives the same index, so models
+    // given the same maps still share their materials.
+    unsigned int withTexture(unsigned int id, const Texture &texture);
+
+    Material &get(unsigned int id) { return materials[id]; }
+    const Material &get(unsigned int id) const { return materials[id]; }
+    size_t size() const { return materials.size(); }
+
+private:
+    // Parse a .mtl file, adding its materials to the table
+    void loadLibrary(const std::string &path);
+
+    std::vector<Material> materials;
+    std::unordered_map<std::string, unsigned int> ids;     // library + '\n' + name, or a variant's key
+    std::unordered_map<std::string, bool> libraries;       // loaded .mtl files
+};
+
+// The table shared by all models
+MaterialTable &materialTable();
@@ -0,0 +1,439 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.hpp"
+#include "meshlet.hpp"
+#include "meshopt.hpp"
+#include "simplify.hpp"
+#include "tangents.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    const char meshCacheMagic[4] = { 'M', 'S', 'H', 'C' };
+
+    size_t alignUp(size_t value)
+    {
+        return (value + meshCacheAlignment - 1) & ~(meshCacheAlignment - 1);
+    }
+
+    // Join strings into one block, each followed by '\0'
+    std::string joinStrings(const std::vector<std::string> &strings)
+    {
+        std::string joined;
+        for (const std::string &string : strings)
+        {
+            joined += string;
+            joined += '\0';
+        }
+        return joined;
+    }
+
+    // Description of one stream to be written into the image
+    struct SectionSource
+    {
+        uint32_t type;
+        const void *data;
+        size_t size;
+    };
+
+    MeshBounds computeBounds(const std::vector<glm::vec3> &positions)
+    {
+        glm::vec3 minimum(0.0f), maximum(0.0f);
+        if (!positions.empty())
+        {
+            minimum = maximum = positions[0];
+            for (const glm::vec3 &position : positions)
+            {
+                minimum = glm::min(minimum, position);
+                maximum = glm::max(maximum, position);
+            }
+        }
+
+        // Sphere around the box centre, tightened to the furthest vertex
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (const glm::vec3 &position : positions)
+        {
+            glm::vec3 offset = position - center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+
+        MeshBounds bounds;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds.min[axis] = minimum[axis];
+            bounds.max[axis] = maximum[axis];
+            bounds.center[axis] = center[axis];
+        }
+        bounds.radius = sqrtf(radiusSquared);
+        return bounds;
+    }
+}
+
+std::string meshCachePath(const char *objPath)
+{
+    return std::string(objPath) + ".meshcache";
+}
+
+void cookMeshCache(const MeshData &mesh, uint64_t sourceSize, int64_t sourceModifiedTime,
+                   uint64_t sourceHash, uint32_t options, float lodError,
+                   const MeshCacheStats &stats, std::vector<unsigned char> &outImage)
+{
+    // Narrow the indices to 16 bits when every vertex can be addressed
+    uint32_t indexSize = mesh.vertices.size() <= 65536 ? 2 : 4;
+    std::vector<unsigned short> shortIndices;
+    if (indexSize == 2)
+        shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+
+    PackedVertexLayout layout;
+    std::vector<unsigned char> vertices;
+    packVertices(mesh, layout, vertices);
+
+    std::string materials = joinStrings(mesh.materials);
+    std::string libraries = joinStrings(mesh.materialLibraries);
+    MeshBounds bounds = computeBounds(mesh.vertices);
+
+    SectionSource sources[] = {
+        { MESH_SECTION_VERTICES,  vertices.data(),      vertices.size() },
+        { MESH_SECTION_VERTEX_LAYOUT, &layout,          sizeof(layout) },
+        { MESH_SECTION_INDICES,
+          indexSize == 2 ? static_cast<const void *>(shortIndices.data()) : mesh.indices.data(),
+          mesh.indices.size() * indexSize },
+        { MESH_SECTION_SUBMESHES, mesh.subMeshes.data(), mesh.subMeshes.size() * sizeof(SubMesh) },
+        { MESH_SECTION_MATERIALS, materials.data(),      materials.size() },
+        { MESH_SECTION_LIBRARIES, libraries.data(),      libraries.size() },
+        { MESH_SECTION_VERTEX_CACHE, &stats,             sizeof(stats) },
+        { MESH_SECTION_LODS,      mesh.lods.data(),      mesh.lods.size() * sizeof(MeshLod) },
+        { MESH_SECTION_BOUNDS,    &bounds,               sizeof(bounds) },
+        { MESH_SECTION_MESHLETS,  mesh.meshlets.data(),  mesh.meshlets.size() * sizeof(Meshlet) }
+    };
+    const uint32_t sectionCount = sizeof(sources) / sizeof(sources[0]);
+
+    // Lay out the header, section table and aligned streams
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, meshCacheMagic, sizeof(header.magic));
+    header.version = meshCacheVersion;
+    header.sourceSize = sourceSize;
+    header.sourceModifiedTime = sourceModifiedTime;
+    header.sourceHash = sourceHash;
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.indexSize = indexSize;
+    header.sectionCount = sectionCount;
+    header.options = options;
+    header.lodError = lodError;
+
+    MeshCacheSection sections[sectionCount];
+    size_t offset = alignUp(sizeof(MeshCacheHeader) + sizeof(sections));
+    for (uint32_t i = 0; i < sectionCount; i++)
+    {
+        sections[i].type = sources[i].type;
+        sections[i].reserved = 0;
+        sections[i].offset = offset;
+        sections[i].size = sources[i].size;
+        offset = alignUp(offset + sources[i].size);
+    }
+
+    outImage.assign(offset, 0);
+    memcpy(&outImage[0], &header, sizeof(header));
+    memcpy(&outImage[sizeof(header)], sections, sizeof(sections));
+    for (uint32_t i = 0; i < sectionCount; i++)
+    {
+        if (sources[i].size > 0)
+            memcpy(&outImage[sections[i].offset], sources[i].data, sources[i].size);
+    }
+}
+
+CachedMesh::CachedMesh()
+    : data(NULL), size(0), warm(false)
+{
+}
+
+bool CachedMesh::validate(const unsigned char *bytes, size_t byteCount) const
+{
+    if (byteCount < sizeof(MeshCacheHeader))
+        return false;
+
+    const MeshCacheHeader *cacheHeader = reinterpret_cast<const MeshCacheHeader *>(bytes);
+    if (memcmp(cacheHeader->magic, meshCacheMagic, sizeof(cacheHeader->magic)) != 0 ||
+        cacheHeader->version != meshCacheVersion ||
+        byteCount < sizeof(MeshCacheHeader) + cacheHeader->sectionCount * sizeof(MeshCacheSection))
+        return false;
+
+    // Every section must lie inside the file, and the vertex layout must be
+    // present for the VAO to be set up from
+    const MeshCacheSection *sections = reinterpret_cast<const MeshCacheSection *>(cacheHeader + 1);
+    const MeshCacheSection *found[MESH_SECTION_MESHLETS + 1] = {};
+    for (uint32_t i = 0; i < cacheHeader->sectionCount; i++)
+    {
+        if (sections[i].offset > byteCount || sections[i].size > byteCount - sections[i].offset)
+            return false;
+        if (sections[i].type <= MESH_SECTION_MESHLETS)
+            found[sections[i].type] = &sections[i];
+    }
+    const MeshCacheSection *layoutSection = found[MESH_SECTION_VERTEX_LAYOUT];
+    const MeshCacheSection *vertexSection = found[MESH_SECTION_VERTICES];
+    const MeshCacheSection *indexSection = found[MESH_SECTION_INDICES];
+    if (!layoutSection || !vertexSection || !indexSection || layoutSection->size != sizeof(PackedVertexLayout))
+        return false;
+    const PackedVertexLayout *layout = reinterpret_cast<const PackedVertexLayout *>(bytes + layoutSection->offset);
+    if (layout->attributeCount > sizeof(layout->attributes) / sizeof(layout->attributes[0]))
+        return false;
+
+    // The streams must hold exactly the vertices and indices the header
+    // says, as the buffers and draws are sized from it
+    uint64_t indexCount = cacheHeader->indexCount;
+    if ((cacheHeader->indexSize != 2 && cacheHeader->indexSize != 4) ||
+        vertexSection->size != static_cast<uint64_t>(cacheHeader->vertexCount) * layout->stride ||
+        indexSection->size != indexCount * cacheHeader->indexSize)
+        return false;
+
+    // Draw ranges must stay inside the index buffer, and levels inside the
+    // submesh list
+    uint64_t subMeshCount = 0;
+    if (const MeshCacheSection *subMeshSection = found[MESH_SECTION_SUBMESHES])
+    {
+        const SubMesh *subMeshes = reinterpret_cast<const SubMesh *>(bytes + subMeshSection->offset);
+        subMeshCount = subMeshSection->size / sizeof(SubMesh);
+        for (uint64_t i = 0; i < subMeshCount; i++)
+        {
+            if (static_cast<uint64_t>(subMeshes[i].indexOffset) + subMeshes[i].indexCount > indexCount)
+                return false;
+        }
+    }
+    if (const MeshCacheSection *meshletSection = found[MESH_SECTION_MESHLETS])
+    {
+        const Meshlet *meshlets = reinterpret_cast<const Meshlet *>(bytes + meshletSection->offset);
+        for (uint64_t i = 0; i < meshletSection->size / sizeof(Meshlet); i++)
+        {
+            if (static_cast<uint64_t>(meshlets[i].indexOffset) + meshlets[i].indexCount > indexCount)
+                return false;
+        }
+    }
+    if (const MeshCacheSection *lodSection = found[MESH_SECTION_LODS])
+    {
+        const MeshLod *lods = reinterpret_cast<const MeshLod *>(bytes + lodSection->offset);
+        for (uint64_t i = 0; i < lodSection->size / sizeof(MeshLod); i++)
+        {
+            if (static_cast<uint64_t>(lods[i].firstSubMesh) + lods[i].subMeshCount > subMeshCount)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool CachedMesh::load(const char *objPath, uint32_t options, float lodError, unsigned int threadCount)
+{
+    release();
+    warm = false;
+
+    std::string cachePath = meshCachePath(objPath);
+    uint64_t sourceSize = 0;
+    int64_t sourceModifiedTime = 0;
+    bool haveSource = getFileInfo(objPath, sourceSize, sourceModifiedTime);
+
+    // Warm path: the cache matches the source's size, and either its
+    // modification time or, if that changed, its content hash
+    if (file.open(cachePath.c_str()) && validate(file.data(), file.size()))
+    {
+        const MeshCacheHeader *cacheHeader = reinterpret_cast<const MeshCacheHeader *>(file.data());
+        bool sameSettings = cacheHeader->options == options && cacheHeader->lodError == lodError;
+        bool fresh = !haveSource && sameSettings;
+        if (haveSource && cacheHeader->sourceSize == sourceSize && sameSettings)
+        {
+            fresh = cacheHeader->sourceModifiedTime == sourceModifiedTime;
+            if (!fresh)
+            {
+                std::vector<char> source;
+                fresh = readFile(objPath, source) &&
+                        hashBytes(source.data(), source.size() - 1) == cacheHeader->sourceHash;
+            }
+        }
+
+        if (fresh)
+        {
+            data = file.data();
+            size = file.size();
+            warm = true;
+            return true;
+        }
+    }
+    file.close();
+
+    // Cold path: parse the .obj and cook a new cache
+    std::vector<char> source;
+    if (!haveSource || !readFile(objPath, source))
+    {
+        printf("Impossible to open %s. Check paths and directories.\n", objPath);
+        return false;
+    }
+
+    MeshData mesh;
+    {
+        TRACE_SCOPE("parseObj");
+        if (!parseObj(source.data(), source.size() - 1, mesh, threadCount))
+            return false;
+    }
+
+    // Tangents split vertices, so they come before any reordering
+    {
+        TRACE_SCOPE("generateTangents");
+        generateTangents(mesh);
+    }
+
+    // Levels share the vertices, so they are optimised along with the full mesh
+    {
+        TRACE_SCOPE("generateLods");
+        generateLods(mesh, lodError);
+    }
+
+    // Coarser levels follow the full mesh in the index list, and only the
+    // full mesh is measured
+    size_t fullIndexCount = mesh.lods.size() > 1 ?
+        mesh.subMeshes[mesh.lods[1].firstSubMesh].indexOffset : mesh.indices.size();
+
+    MeshOptimizationStats optimization;
+    if (options & MESH_CACHE_OPTIMIZE)
+    {
+        TRACE_SCOPE("optimizeMesh");
+        optimizeMesh(mesh, &optimization);
+    }
+    else
+    {
+        optimization.before = analyzeVertexCache(mesh.indices.data(), fullIndexCount, mesh.vertices.size());
+    }
+
+    // Clusters reorder triangles within each sub-mesh, so they come last and
+    // the final cache statistics are taken after them
+    {
+        TRACE_SCOPE("buildMeshlets");
+        buildMeshlets(mesh);
+    }
+    optimization.after = analyzeVertexCache(mesh.indices.data(), fullIndexCount, mesh.vertices.size());
+
+    MeshCacheStats stats;
+    stats.acmrBefore = optimization.before.acmr;
+    stats.atvrBefore = optimization.before.atvr;
+    stats.acmrAfter = optimization.after.acmr;
+    stats.atvrAfter = optimization.after.atvr;
+
+    TRACE_SCOPE("cookMeshCache");
+    cookMeshCache(mesh, sourceSize, sourceModifiedTime,
+                  hashBytes(source.data(), source.size() - 1), options, lodError, stats, image);
+    if (!writeFileAtomic(cachePath.c_str(), image.data(), image.size()))
+        printf("Could not write mesh cache %s\n", cachePath.c_str());
+
+    data = image.data();
+    size = image.size();
+    return true;
+}
+
+void CachedMesh::release()
+{
+    file.close();
+    std::vector<unsigned char>().swap(image);
+    data = NULL;
+    size = 0;
+}
+
+const MeshCacheHeader &CachedMesh::header() const
+{
+    return *reinterpret_cast<const MeshCacheHeader *>(data);
+}
+
+const void *CachedMesh::section(uint32_t type, size_t *outSize) const
+{
+    const MeshCacheSection *sections = reinterpret_cast<const MeshCacheSection *>(&header() + 1);
+    for (uint32_t i = 0; i < header().sectionCount; i++)
+    {
+        if (sections[i].type == type)
+        {
+            if (outSize)
+                *outSize = static_cast<size_t>(sections[i].size);
+            return data + sections[i].offset;
+        }
+    }
+
+    if (outSize)
+        *outSize = 0;
+    return NULL;
+}
+
+const PackedVertexLayout &CachedMesh::vertexLayout() const
+{
+    return *static_cast<const PackedVertexLayout *>(section(MESH_SECTION_VERTEX_LAYOUT));
+}
+
+std::vector<std::string> CachedMesh::strings(uint32_t type) const
+{
+    std::vector<std::string> result;
+    size_t sectionSize;
+    const char *text = static_cast<const char *>(section(type, &sectionSize));
+    const char *end = text + sectionSize;
+    while (text && text < end)
+    {
+        const char *stringEnd = static_cast<const char *>(memchr(text, '\0', end - text));
+        if (stringEnd == NULL)
+            break;
+        result.push_back(std::string(text, stringEnd));
+        text = stringEnd + 1;
+    }
+    return result;
+}
+
+MeshCacheStats CachedMesh::stats() const
+{
+    MeshCacheStats result;
+    memset(&result, 0, sizeof(result));
+    size_t sectionSize;
+    const void *stored = section(MESH_SECTION_VERTEX_CACHE, &sectionSize);
+    if (stored && sectionSize >= sizeof(result))
+        memcpy(&result, stored, sizeof(result));
+    return result;
+}
+
+std::vector<MeshLod> CachedMesh::lods() const
+{
+    size_t sectionSize;
+    const MeshLod *stored = static_cast<const MeshLod *>(section(MESH_SECTION_LODS, &sectionSize));
+    std::vector<MeshLod> result;
+    if (stored)
+        result.assign(stored, stored + sectionSize / sizeof(MeshLod));
+    if (result.empty())
+    {
+        size_t subMeshSize;
+        section(MESH_SECTION_SUBMESHES, &subMeshSize);
+        MeshLod full = { 0, static_cast<unsigned int>(subMeshSize / sizeof(SubMesh)), 0.0f };
+        result.push_back(full);
+    }
+    return result;
+}
+
+MeshBounds CachedMesh::bounds() const
+{
+    MeshBounds result;
+    memset(&result, 0, sizeof(result));
+    size_t sectionSize;
+    const void *stored = section(MESH_SECTION_BOUNDS, &sectionSize);
+    if (stored && sectionSize >= sizeof(result))
+        memcpy(&result, stored, sizeof(result));
+    return result;
+}
+
+std::vector<Meshlet> CachedMesh::meshlets() const
+{
+    size_t sectionSize;
+    const Meshlet *stored = static_cast<const Meshlet *>(section(MESH_SECTION_MESHLETS, &sectionSize));
+    std::vector<Meshlet> result;
+    if (stored)
+        result.assign(stored, stored + sectionSize / sizeof(Meshlet));
+    return result;
+}
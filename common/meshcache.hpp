@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fileutil.hpp"
+#include "objloader.hpp"
+#include "vertexpack.hpp"
+
+// Binary mesh cache, written next to each .obj as <file>.obj.meshcache. The
+// file is a header, a section table and the vertex and index streams, each
+// stream aligned so it can be handed straight to glBufferData. Vertices are
+// interleaved and quantised as described by the vertex layout section.
+// Submeshes hold every level of detail, level after level.
+
+const uint32_t meshCacheVersion = 10;
+const size_t   meshCacheAlignment = 64;
+
+// Largest error of the first simplified level, as a fraction of the bounding radius
+const float    meshCacheDefaultLodError = 0.01f;
+
+enum MeshCacheSectionType
+{
+    MESH_SECTION_VERTICES = 1,    // PackedVertexLayout::stride bytes per vertex
+    MESH_SECTION_VERTEX_LAYOUT,   // PackedVertexLayout
+    MESH_SECTION_INDICES,         // indexSize bytes per index
+    MESH_SECTION_SUBMESHES,       // SubMesh per material and level of detail
+    MESH_SECTION_MATERIALS,       // '\0' terminated usemtl names
+    MESH_SECTION_LIBRARIES,       // '\0' terminated mtllib file names
+    MESH_SECTION_VERTEX_CACHE,    // MeshCacheStats
+    MESH_SECTION_LODS,            // MeshLod per level, finest first
+    MESH_SECTION_BOUNDS,          // MeshBounds
+    MESH_SECTION_MESHLETS         // Meshlet per cluster, in index order
+};
+
+// Processing applied when cooking, recorded so a cache cooked with other
+// options is rebuilt
+enum MeshCacheOptions
+{
+    MESH_CACHE_OPTIMIZE = 1       // optimizeMesh vertex cache, overdraw and fetch order
+};
+
+struct MeshCacheHeader
+{
+    char     magic[4];
+    uint32_t version;
+
+    // The source .obj this cache was cooked from
+    uint64_t sourceSize;
+    int64_t  sourceModifiedTime;
+    uint64_t sourceHash;
+
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;
+    uint32_t sectionCount;
+    uint32_t options;
+    float    lodError;            // generateLods error budget, 0 for no levels
+};
+
+// Post-transform cache efficiency of the index list before and after
+// optimisation, 32 entry FIFO
+struct MeshCacheStats
+{
+    float acmrBefore;
+    float atvrBefore;
+    float acmrAfter;
+    float atvrAfter;
+};
+
+// Bounds of the vertex positions in model space
+struct MeshBounds
+{
+    float min[3];
+    float max[3];
+    float center[3];
+    float radius;
+};
+
+struct MeshCacheSection
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Path of the cache file for a .obj
+std::string meshCachePath(const char *objPath);
+
+// Serialise a mesh into the cache file layout
+void cookMeshCache(const MeshData &mesh, uint64_t sourceSize, int64_t sourceModifiedTime,
+                   uint64_t sourceHash, uint32_t options, float lodError,
+                   const MeshCacheStats &stats, std::vector<unsigned char> &outImage);
+
+// A mesh loaded through the cache. On a warm load the streams point into the
+// memory-mapped cache file; on a cold load the .obj is parsed, the cache is
+// written and the streams point into the freshly cooked image.
+class CachedMesh
+{
+public:
+    CachedMesh();
+
+    // Map the cache for objPath, cooking it first if it is missing, stale or
+    // was cooked with other options. Cooking parses on up to threadCount
+    // threads (0 uses every core).
+    bool load(const char *objPath, uint32_t options = MESH_CACHE_OPTIMIZE,
+              float lodError = meshCacheDefaultLodError, unsigned int threadCount = 0);
+
+    // Unmap the cache once its streams have been uploaded
+    void release();
+
+    const MeshCacheHeader &header() const;
+    const void *section(uint32_t type, size_t *outSize = NULL) const;
+
+    const PackedVertexLayout &vertexLayout() const;
+
+    // Split a section of '\0' terminated strings
+    std::vector<std::string> strings(uint32_t type) const;
+
+    // Vertex cache statistics recorded when the mesh was cooked
+    MeshCacheStats stats() const;
+
+    // Levels of detail, or a single level covering every submesh for caches
+    // cooked without them
+    std::vector<MeshLod> lods() const;
+
+    MeshBounds bounds() const;
+
+    // Clusters of every sub-mesh, empty for caches cooked without them
+    std::vector<Meshlet> meshlets() const;
+
+    // True if the last load was served from an existing cache file
+    bool wasWarm() const { return warm; }
+
+private:
+    CachedMesh(const CachedMesh &);
+    CachedMesh &operator=(const CachedMesh &);
+
+    bool validate(const unsigned char *bytes, size_t byteCount) const;
+
+    MappedFile file;
+    std::vector<unsigned char> image;
+    const unsigned char *data;
+    size_t size;
+    bool warm;
+};
@@ -0,0 +1,261 @@
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <string.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "meshlet.hpp"
+
+namespace
+{
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3 &p) const
+        {
+            unsigned int bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    // Sphere around the vertices, and the cone of the triangle normals
+    Meshlet computeBounds(const MeshData &mesh, const unsigned int *indices, size_t indexCount)
+    {
+        Meshlet meshlet;
+        memset(&meshlet, 0, sizeof(meshlet));
+
+        glm::vec3 minimum = mesh.vertices[indices[0]], maximum = minimum;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            minimum = glm::min(minimum, mesh.vertices[indices[i]]);
+            maximum = glm::max(maximum, mesh.vertices[indices[i]]);
+        }
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            glm::vec3 offset = mesh.vertices[indices[i]] - center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            const glm::vec3 &a = mesh.vertices[indices[i]];
+            glm::vec3 normal = glm::cross(mesh.vertices[indices[i + 1]] - a, mesh.vertices[indices[i + 2]] - a);
+            float length = glm::length(normal);
+            if (length == 0.0f)
+                continue;
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+
+        // The cone opens sideways by the widest normal's angle from the axis;
+        // past 84 degrees it is too wide to ever cull
+        float axisLength = glm::length(axis);
+        float minimumDot = 1.0f;
+        if (axisLength > 0.0f)
+        {
+            axis /= axisLength;
+            for (const glm::vec3 &normal : normals)
+                minimumDot = std::min(minimumDot, glm::dot(axis, normal));
+        }
+
+        for (int k = 0; k < 3; k++)
+            meshlet.center[k] = center[k];
+        meshlet.radius = sqrtf(radiusSquared);
+        if (axisLength > 0.0f && minimumDot > 0.1f)
+        {
+            for (int k = 0; k < 3; k++)
+                meshlet.coneAxis[k] = axis[k];
+            meshlet.coneCutoff = sqrtf(1.0f - minimumDot * minimumDot);
+        }
+        else
+            meshlet.coneCutoff = 1.0f;
+        return meshlet;
+    }
+}
+
+void buildMeshlets(MeshData &mesh, unsigned int maxVertices, unsigned int maxTriangles)
+{
+    mesh.meshlets.clear();
+    size_t vertexCount = mesh.vertices.size();
+    if (vertexCount == 0)
+        return;
+
+    // Neighbours are found through shared positions, so triangles of a
+    // faceted mesh that only share corners by position still connect
+    std::vector<unsigned int> positionOf(vertexCount);
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> positionIds;
+    for (size_t v = 0; v < vertexCount; v++)
+        positionOf[v] = positionIds.insert(std::make_pair(mesh.vertices[v], static_cast<unsigned int>(v))).first->second;
+
+    std::vector<unsigned int> vertexMeshlet(vertexCount, ~0u);
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<unsigned int> triangles, candidates, reordered;
+
+    for (const SubMesh &subMesh : mesh.subMeshes)
+    {
+        const unsigned int *indices = &mesh.indices[subMesh.indexOffset];
+        size_t triangleCount = subMesh.indexCount / 3;
+        if (triangleCount == 0)
+            continue;
+
+        // Triangles around each position
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacencyOffsets[positionOf[indices[i]] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(triangleCount * 3);
+        std::vector<unsigned int> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacency[cursor[positionOf[indices[i]]]++] = static_cast<unsigned int>(i / 3);
+
+        std::vector<glm::vec3> centroids(triangleCount), normals(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3 &a = mesh.vertices[indices[t * 3]];
+            const glm::vec3 &b = mesh.vertices[indices[t * 3 + 1]];
+            const glm::vec3 &c = mesh.vertices[indices[t * 3 + 2]];
+            centroids[t] = (a + b + c) / 3.0f;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            normals[t] = length > 0.0f ? normal / length : normal;
+        }
+
+        std::vector<char> assigned(triangleCount, 0);
+        std::vector<unsigned int> candidateMeshlet(triangleCount, ~0u);
+        reordered.clear();
+
+        // Seeds are taken in the existing triangle order, which keeps the
+        // meshlets in roughly the order the overdraw optimisation chose
+        for (size_t seed = 0; seed < triangleCount; seed++)
+        {
+            if (assigned[seed])
+                continue;
+
+            unsigned int id = static_cast<unsigned int>(mesh.meshlets.size());
+            unsigned int meshletVertices = 0;
+            glm::vec3 centroidSum(0.0f), normalSum(0.0f);
+            triangles.clear();
+            candidates.clear();
+
+            unsigned int next = static_cast<unsigned int>(seed);
+            while (true)
+            {
+                assigned[next] = 1;
+                triangles.push_back(next);
+                centroidSum += centroids[next];
+                normalSum += normals[next];
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int vertex = indices[next * 3 + k];
+                    if (vertexMeshlet[vertex] != id)
+                    {
+                        vertexMeshlet[vertex] = id;
+                        meshletVertices++;
+                    }
+
+                    unsigned int position = positionOf[vertex];
+                    for (unsigned int a = adjacencyOffsets[position]; a < adjacencyOffsets[position + 1]; a++)
+                    {
+                        unsigned int neighbour = adjacency[a];
+                        if (!assigned[neighbour] && candidateMeshlet[neighbour] != id)
+                        {
+                            candidateMeshlet[neighbour] = id;
+                            candidates.push_back(neighbour);
+                        }
+                    }
+                }
+                if (triangles.size() >= maxTriangles)
+                    break;
+
+                // Prefer neighbours adding the fewest vertices, then those
+                // close to the meshlet's centre and facing its way
+                glm::vec3 centroid = centroidSum / static_cast<float>(triangles.size());
+                float normalLength = glm::length(normalSum);
+                glm::vec3 direction = normalLength > 0.0f ? normalSum / normalLength : normalSum;
+                unsigned int bestNew = 4;
+                float bestCost = 0.0f;
+                size_t best = 0;
+                for (size_t c = 0; c < candidates.size(); )
+                {
+                    unsigned int candidate = candidates[c];
+                    if (assigned[candidate])
+                    {
+                        candidates[c] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+
+                    unsigned int added = 0;
+                    for (int k = 0; k < 3; k++)
+                        added += vertexMeshlet[indices[candidate * 3 + k]] != id;
+                    glm::vec3 offset = centroids[candidate] - centroid;
+                    float cost = glm::dot(offset, offset) * (2.0f - glm::dot(normals[candidate], direction));
+                    if (meshletVertices + added <= maxVertices &&
+                        (added < bestNew || (added == bestNew && cost < bestCost)))
+                    {
+                        bestNew = added;
+                        bestCost = cost;
+                        best = c;
+                    }
+                    c++;
+                }
+                if (bestNew == 4)
+                    break;
+                next = candidates[best];
+            }
+
+            std::sort(triangles.begin(), triangles.end());
+            unsigned int offset = static_cast<unsigned int>(subMesh.indexOffset + reordered.size());
+            for (unsigned int t : triangles)
+                reordered.insert(reordered.end(), indices + t * 3, indices + t * 3 + 3);
+            Meshlet meshlet = computeBounds(mesh, &reordered[offset - subMesh.indexOffset], triangles.size() * 3);
+            meshlet.indexOffset = offset;
+            meshlet.indexCount = static_cast<unsigned int>(triangles.size() * 3);
+            mesh.meshlets.push_back(meshlet);
+        }
+
+        std::copy(reordered.begin(), reordered.end(), mesh.indices.begin() + subMesh.indexOffset);
+    }
+}
+
+bool meshletBackfacing(const Meshlet &meshlet, const glm::vec3 &camera)
+{
+    glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+    glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+    glm::vec3 view = center - camera;
+    return glm::dot(view, axis) >= meshlet.coneCutoff * glm::length(view) + meshlet.radius;
+}
+
+size_t cullMeshlets(const Meshlet *meshlets, size_t meshletCount,
+                    const Frustum &modelFrustum, const glm::vec3 &modelCamera,
+                    std::vector<IndexRange> &outRanges)
+{
+    size_t firstRange = outRanges.size();
+    size_t visible = 0;
+    for (size_t i = 0; i < meshletCount; i++)
+    {
+        const Meshlet &meshlet = meshlets[i];
+        glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+        if (!sphereInFrustum(modelFrustum, center, meshlet.radius) || meshletBackfacing(meshlet, modelCamera))
+            continue;
+        visible++;
+
+        if (outRanges.size() > firstRange &&
+            outRanges.back().indexOffset + outRanges.back().indexCount == meshlet.indexOffset)
+            outRanges.back().indexCount += meshlet.indexCount;
+        else
+        {
+            IndexRange range = { meshlet.indexOffset, meshlet.indexCount };
+            outRanges.push_back(range);
+        }
+    }
+    return visible;
+}
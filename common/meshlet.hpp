@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "frustum.hpp"
+
+// A run of the index list, drawn with one call
+struct IndexRange
+{
+    unsigned int indexOffset;
+    unsigned int indexCount;
+};
+
+// Split every sub-mesh into meshlets of at most maxVertices vertices and
+// maxTriangles triangles, grown from a seed triangle across neighbours that
+// share the most vertices and face the same way. Triangles are reordered so
+// each meshlet is contiguous, keeping their previous order within it, and
+// the meshlets and their culling bounds are stored in mesh.meshlets.
+void buildMeshlets(MeshData &mesh, unsigned int maxVertices = 64, unsigned int maxTriangles = 124);
+
+// True if every triangle of the meshlet faces away from the camera. Both are
+// in model space, which must be uniformly scaled for the cone to hold.
+bool meshletBackfacing(const Meshlet &meshlet, const glm::vec3 &camera);
+
+// Append the index ranges of the meshlets that are inside the frustum and
+// not backfacing, merging neighbours into one range. Returns how many
+// meshlets are visible.
+size_t cullMeshlets(const Meshlet *meshlets, size_t meshletCount,
+                    const Frustum &modelFrustum, const glm::vec3 &modelCamera,
+                    std::vector<IndexRange> &outRanges);
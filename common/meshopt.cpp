@@ -0,0 +1,463 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "meshopt.hpp"
+
+namespace
+{
+    const unsigned int maxCacheSize = 64;
+
+    // Forsyth's vertex score: vertices near the front of the cache score
+    // highest, except the last triangle's which are reused less often, and
+    // vertices with few triangles left are boosted so they get finished off
+    float vertexScore(int cachePosition, unsigned int remaining, unsigned int cacheSize)
+    {
+        if (remaining == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = powf(1.0f - static_cast<float>(cachePosition - 3) / (cacheSize - 3), 1.5f);
+        }
+        return score + 2.0f / sqrtf(static_cast<float>(remaining));
+    }
+
+    // Rasterise one view of a mesh into a depth buffer, counting fragments
+    // that pass the depth test. axis is the viewing direction, sign picks
+    // which end it is seen from.
+    void rasterizeView(const unsigned int *indices, size_t indexCount, const glm::vec3 *positions,
+                       const glm::vec3 &minimum, const glm::vec3 &extent, int axis, float sign,
+                       OverdrawStats &stats)
+    {
+        const int resolution = 256;
+        int uAxis = (axis + 1) % 3, vAxis = (axis + 2) % 3;
+        float uScale = extent[uAxis] > 0.0f ? resolution / extent[uAxis] : 0.0f;
+        float vScale = extent[vAxis] > 0.0f ? resolution / extent[vAxis] : 0.0f;
+
+        std::vector<float> depth(resolution * resolution, 1e30f);
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            float x[3], y[3], z[3];
+            for (int k = 0; k < 3; k++)
+            {
+                const glm::vec3 &p = positions[indices[i + k]];
+                x[k] = (p[uAxis] - minimum[uAxis]) * uScale;
+                y[k] = (p[vAxis] - minimum[vAxis]) * vScale;
+                z[k] = p[axis] * sign;
+            }
+
+            float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+            if (area == 0.0f)
+                continue;
+
+            int minX = std::max(0, static_cast<int>(floorf(std::min(x[0], std::min(x[1], x[2])))));
+            int maxX = std::min(resolution - 1, static_cast<int>(ceilf(std::max(x[0], std::max(x[1], x[2])))));
+            int minY = std::max(0, static_cast<int>(floorf(std::min(y[0], std::min(y[1], y[2])))));
+            int maxY = std::min(resolution - 1, static_cast<int>(ceilf(std::max(y[0], std::max(y[1], y[2])))));
+
+            // Sample pixel centres with barycentric edge functions
+            for (int py = minY; py <= maxY; py++)
+            {
+                for (int px = minX; px <= maxX; px++)
+                {
+                    float cx = px + 0.5f, cy = py + 0.5f;
+                    float w0 = ((x[2] - x[1]) * (cy - y[1]) - (y[2] - y[1]) * (cx - x[1])) / area;
+                    float w1 = ((x[0] - x[2]) * (cy - y[2]) - (y[0] - y[2]) * (cx - x[2])) / area;
+                    float w2 = 1.0f - w0 - w1;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+
+                    float fragmentDepth = w0 * z[0] + w1 * z[1] + w2 * z[2];
+                    float &stored = depth[py * resolution + px];
+                    if (fragmentDepth < stored)
+                    {
+                        if (stored == 1e30f)
+                            stats.pixelsCovered++;
+                        stored = fragmentDepth;
+                        stats.pixelsShaded++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t indexCount,
+                                    size_t vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats = { 0, 0.0f, 0.0f };
+
+    // Each vertex remembers when it entered the cache; it has been evicted
+    // once cacheSize other vertices have been added since
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    size_t time = cacheSize + 1;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        unsigned int index = indices[i];
+        if (time - cacheTime[index] > cacheSize)
+        {
+            cacheTime[index] = time++;
+            stats.vertexShaderInvocations++;
+        }
+    }
+
+    if (indexCount >= 3)
+        stats.acmr = static_cast<float>(stats.vertexShaderInvocations) / (indexCount / 3);
+    if (vertexCount > 0)
+        stats.atvr = static_cast<float>(stats.vertexShaderInvocations) / vertexCount;
+    return stats;
+}
+
+OverdrawStats analyzeOverdraw(const unsigned int *indices, size_t indexCount,
+                              const glm::vec3 *positions, size_t vertexCount)
+{
+    OverdrawStats stats = { 0, 0, 0.0f };
+    if (vertexCount == 0)
+        return stats;
+
+    glm::vec3 minimum = positions[0], maximum = positions[0];
+    for (size_t i = 1; i < vertexCount; i++)
+    {
+        minimum = glm::min(minimum, positions[i]);
+        maximum = glm::max(maximum, positions[i]);
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        rasterizeView(indices, indexCount, positions, minimum, maximum - minimum, axis, 1.0f, stats);
+        rasterizeView(indices, indexCount, positions, minimum, maximum - minimum, axis, -1.0f, stats);
+    }
+
+    if (stats.pixelsCovered > 0)
+        stats.overdraw = static_cast<float>(stats.pixelsShaded) / stats.pixelsCovered;
+    return stats;
+}
+
+void optimizeVertexCache(unsigned int *indices, size_t indexCount,
+                         size_t vertexCount, unsigned int cacheSize)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+    cacheSize = std::max(4u, std::min(cacheSize, maxCacheSize));
+
+    // Triangles still to be emitted that use each vertex
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        remaining[indices[i]]++;
+
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[cursor[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v], cacheSize);
+
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> output(triangleCount * 3);
+    std::vector<char> emitted(triangleCount, 0);
+    unsigned int cache[maxCacheSize + 3], newCache[maxCacheSize + 3];
+    unsigned int cacheCount = 0;
+    size_t inputCursor = 0;
+    size_t best = 0;
+    bool haveBest = false;
+
+    // Changing a vertex's score changes the score of each triangle using it
+    auto rescore = [&](unsigned int vertex)
+    {
+        float newScore = vertexScore(cachePosition[vertex], remaining[vertex], cacheSize);
+        float delta = newScore - score[vertex];
+        score[vertex] = newScore;
+        for (unsigned int i = 0; i < remaining[vertex]; i++)
+            triangleScore[adjacency[offsets[vertex] + i]] += delta;
+    };
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        // Nothing in the cache has triangles left, so start on the next
+        // triangle in input order
+        if (!haveBest)
+        {
+            while (emitted[inputCursor])
+                inputCursor++;
+            best = inputCursor;
+        }
+
+        const unsigned int *triangle = indices + best * 3;
+        output[emittedCount * 3] = triangle[0];
+        output[emittedCount * 3 + 1] = triangle[1];
+        output[emittedCount * 3 + 2] = triangle[2];
+        emitted[best] = 1;
+
+        // Remove the triangle from its vertices' lists
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int vertex = triangle[k];
+            unsigned int *list = &adjacency[offsets[vertex]];
+            unsigned int count = remaining[vertex];
+            for (unsigned int i = 0; i < count; i++)
+            {
+                if (list[i] == best)
+                {
+                    std::swap(list[i], list[count - 1]);
+                    break;
+                }
+            }
+            remaining[vertex]--;
+        }
+
+        // The triangle's vertices move to the front of the cache
+        unsigned int newCount = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            if (std::find(newCache, newCache + newCount, triangle[k]) == newCache + newCount)
+                newCache[newCount++] = triangle[k];
+        }
+        unsigned int *triangleEnd = newCache + newCount;
+        for (unsigned int i = 0; i < cacheCount; i++)
+        {
+            if (std::find(newCache, triangleEnd, cache[i]) == triangleEnd)
+                newCache[newCount++] = cache[i];
+        }
+
+        // Vertices pushed off the end leave the cache
+        for (unsigned int i = cacheSize; i < newCount; i++)
+        {
+            cachePosition[newCache[i]] = -1;
+            rescore(newCache[i]);
+        }
+        cacheCount = std::min(newCount, cacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        for (unsigned int i = 0; i < cacheCount; i++)
+        {
+            cachePosition[cache[i]] = static_cast<int>(i);
+            rescore(cache[i]);
+        }
+
+        // The next triangle is the best one using a cached vertex
+        haveBest = false;
+        float bestScore = -1e30f;
+        for (unsigned int i = 0; i < cacheCount; i++)
+        {
+            unsigned int vertex = cache[i];
+            for (unsigned int j = 0; j < remaining[vertex]; j++)
+            {
+                unsigned int candidate = adjacency[offsets[vertex] + j];
+                if (triangleScore[candidate] > bestScore)
+                {
+                    bestScore = triangleScore[candidate];
+                    best = candidate;
+                    haveBest = true;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(unsigned int *indices, size_t indexCount,
+                      const glm::vec3 *positions, size_t vertexCount,
+                      float threshold, unsigned int cacheSize)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    // FIFO cache simulation, as in analyzeVertexCache, that can be reset
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    size_t time = cacheSize + 1;
+    auto misses = [&](size_t triangle)
+    {
+        unsigned int count = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int index = indices[triangle * 3 + k];
+            if (time - cacheTime[index] > cacheSize)
+            {
+                cacheTime[index] = time++;
+                count++;
+            }
+        }
+        return count;
+    };
+    auto resetCache = [&]() { time += cacheSize + 1; };
+
+    // Hard boundaries are where the vertex cache order had to start afresh,
+    // so moving what follows costs nothing
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (misses(t) == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(triangleCount);
+
+    // Soft boundaries split each of those further once the ACMR from the
+    // last boundary is within threshold of the whole cluster's
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++)
+    {
+        size_t start = hard[h], end = hard[h + 1];
+
+        resetCache();
+        size_t clusterMisses = 0;
+        for (size_t t = start; t < end; t++)
+            clusterMisses += misses(t);
+        float clusterAcmr = static_cast<float>(clusterMisses) / (end - start);
+
+        resetCache();
+        clusters.push_back(start);
+        size_t runMisses = 0, runTriangles = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            runMisses += misses(t);
+            runTriangles++;
+            if (t + 1 < end && runMisses <= clusterAcmr * threshold * runTriangles)
+            {
+                clusters.push_back(t + 1);
+                resetCache();
+                runMisses = 0;
+                runTriangles = 0;
+            }
+        }
+    }
+    size_t clusterCount = clusters.size();
+    clusters.push_back(triangleCount);
+
+    // Area weighted centroid and normal of each cluster and of the mesh
+    std::vector<glm::vec3> clusterCentroids(clusterCount), clusterNormals(clusterCount);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const glm::vec3 &a = positions[indices[t * 3]];
+            const glm::vec3 &b = positions[indices[t * 3 + 1]];
+            const glm::vec3 &d = positions[indices[t * 3 + 2]];
+            glm::vec3 cross = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(cross);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        clusterCentroids[c] = area > 0.0f ? centroid / area : centroid;
+        float normalLength = glm::length(normal);
+        clusterNormals[c] = normalLength > 0.0f ? normal / normalLength : normal;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters facing away from the centre are drawn first
+    std::vector<float> sortKey(clusterCount);
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        sortKey[c] = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return sortKey[a] > sortKey[b];
+    });
+
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    for (size_t c : order)
+        output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount,
+                           std::vector<unsigned int> &outRemap)
+{
+    const unsigned int unused = ~0u;
+    outRemap.assign(vertexCount, unused);
+
+    unsigned int next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        unsigned int &remapped = outRemap[indices[i]];
+        if (remapped == unused)
+            remapped = next++;
+        indices[i] = remapped;
+    }
+
+    // Unreferenced vertices go to the end
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (outRemap[v] == unused)
+            outRemap[v] = next++;
+    }
+    return next;
+}
+
+namespace
+{
+    template <typename T>
+    void remapStream(std::vector<T> &stream, const std::vector<unsigned int> &remap)
+    {
+        if (stream.size() != remap.size())
+            return;
+        std::vector<T> remapped(stream.size());
+        for (size_t v = 0; v < stream.size(); v++)
+            remapped[remap[v]] = stream[v];
+        stream.swap(remapped);
+    }
+}
+
+void optimizeMesh(MeshData &mesh, MeshOptimizationStats *outStats)
+{
+    size_t vertexCount = mesh.vertices.size();
+
+    // Statistics describe the full detail level, which comes first
+    size_t fullIndexCount = mesh.indices.size();
+    if (!mesh.lods.empty() && mesh.lods[0].subMeshCount > 0)
+    {
+        const SubMesh &last = mesh.subMeshes[mesh.lods[0].firstSubMesh + mesh.lods[0].subMeshCount - 1];
+        fullIndexCount = last.indexOffset + last.indexCount;
+    }
+    if (outStats)
+        outStats->before = analyzeVertexCache(mesh.indices.data(), fullIndexCount, vertexCount);
+
+    // Triangles only move within their material's range
+    for (const SubMesh &subMesh : mesh.subMeshes)
+    {
+        unsigned int *indices = mesh.indices.data() + subMesh.indexOffset;
+        optimizeVertexCache(indices, subMesh.indexCount, vertexCount);
+        optimizeOverdraw(indices, subMesh.indexCount, mesh.vertices.data(), vertexCount);
+    }
+
+    std::vector<unsigned int> remap;
+    optimizeVertexFetch(mesh.indices.data(), mesh.indices.size(), vertexCount, remap);
+    remapStream(mesh.vertices, remap);
+    remapStream(mesh.uvs, remap);
+    remapStream(mesh.normals, remap);
+    remapStream(mesh.tangents, remap);
+
+    if (outStats)
+        outStats->after = analyzeVertexCache(mesh.indices.data(), fullIndexCount, vertexCount);
+}
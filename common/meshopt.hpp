@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+
+// Post-transform vertex cache statistics for an indexed triangle list
+struct VertexCacheStats
+{
+    size_t vertexShaderInvocations;   // cache misses
+    float  acmr;                      // misses per triangle
+    float  atvr;                      // misses per unique vertex
+};
+
+// Simulate a FIFO post-transform cache of cacheSize entries over the index
+// list, as a rough model of how many times the vertex shader runs
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t indexCount,
+                                    size_t vertexCount, unsigned int cacheSize = 32);
+
+// Fraction of rasterised fragments that are later overwritten, measured by
+// rendering the mesh from the six axis directions
+struct OverdrawStats
+{
+    size_t pixelsCovered;
+    size_t pixelsShaded;
+    float  overdraw;                  // shaded / covered, 1 is ideal
+};
+
+OverdrawStats analyzeOverdraw(const unsigned int *indices, size_t indexCount,
+                              const glm::vec3 *positions, size_t vertexCount);
+
+// Reorder triangles so each vertex is reused while it is still in the
+// post-transform cache (Forsyth's linear-speed vertex cache optimisation)
+void optimizeVertexCache(unsigned int *indices, size_t indexCount,
+                         size_t vertexCount, unsigned int cacheSize = 32);
+
+// Reorder clusters of an optimizeVertexCache ordering so outward facing
+// triangles are drawn first and occlude the rest. Clusters are only cut
+// where the ACMR grows by at most threshold (Tipsify, Sander et al. 2007).
+void optimizeOverdraw(unsigned int *indices, size_t indexCount,
+                      const glm::vec3 *positions, size_t vertexCount,
+                      float threshold = 1.05f, unsigned int cacheSize = 32);
+
+// Renumber vertices in the order the index list first uses them, so vertex
+// fetch walks the buffers forwards. outRemap maps old to new vertices.
+size_t optimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount,
+                           std::vector<unsigned int> &outRemap);
+
+// Cache statistics of a mesh before and after optimizeMesh
+struct MeshOptimizationStats
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+};
+
+// Run the vertex cache and overdraw passes over each sub-mesh, then reorder
+// the vertex streams for fetch locality
+void optimizeMesh(MeshData &mesh, MeshOptimizationStats *outStats = NULL);
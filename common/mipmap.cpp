@@ -0,0 +1,278 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "mipmap.hpp"
+#include "parallel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SSE2
+#endif
+
+namespace
+{
+    // Rows below this are not worth a thread
+    const size_t minRowsPerThread = 16;
+
+    // Kaiser window half width in output texels, and its shape
+    const double kaiserRadius = 2.0;
+    const double kaiserBeta = 4.0;
+    const double pi = 3.14159265358979323846;
+
+    // Source rows kept decoded, enough for the 8 taps of the next output row
+    const unsigned int cachedRowCount = 10;
+
+    // One texel, RGBA in linear values
+    struct Pixel
+    {
+        float value[4];
+    };
+
+    // sum += pixel * weight, the inner loop of both filter passes
+    inline void accumulate(Pixel &sum, const Pixel &pixel, float weight)
+    {
+#ifdef MIPMAP_SSE2
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(pixel.value), _mm_set1_ps(weight));
+        _mm_storeu_ps(sum.value, _mm_add_ps(_mm_loadu_ps(sum.value), product));
+#else
+        for (int c = 0; c < 4; c++)
+            sum.value[c] += pixel.value[c] * weight;
+#endif
+    }
+
+    double srgbToLinear(double value)
+    {
+        return value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+    }
+
+    // Lookup tables for converting sRGB bytes to linear light and back
+    struct SrgbTables
+    {
+        float toLinear[256];
+        float thresholds[255];              // linear value halfway between byte i and i + 1
+        unsigned char guesses[4097];        // byte for a linear value of i / 4096, to within one
+
+        SrgbTables()
+        {
+            for (int i = 0; i < 256; i++)
+                toLinear[i] = static_cast<float>(srgbToLinear(i / 255.0));
+            for (int i = 0; i < 255; i++)
+                thresholds[i] = static_cast<float>(srgbToLinear((i + 0.5) / 255.0));
+            int byte = 0;
+            for (int i = 0; i <= 4096; i++)
+            {
+                while (byte < 255 && i / 4096.0f >= thresholds[byte])
+                    byte++;
+                guesses[i] = static_cast<unsigned char>(byte);
+            }
+        }
+
+        // Nearest sRGB byte, exact: the guess is corrected against the thresholds
+        unsigned char encode(float value) const
+        {
+            if (!(value > 0.0f))
+                return 0;
+            if (value >= 1.0f)
+                return 255;
+            int byte = guesses[static_cast<int>(value * 4096.0f)];
+            while (byte < 255 && value >= thresholds[byte])
+                byte++;
+            while (byte > 0 && value < thresholds[byte - 1])
+                byte--;
+            return static_cast<unsigned char>(byte);
+        }
+    };
+    const SrgbTables srgbTables;
+
+    unsigned char encodeUnorm(float value)
+    {
+        return static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, value * 255.0f + 0.5f)));
+    }
+
+    void decodeRow(const unsigned char *bytes, unsigned int width, uint32_t content, Pixel *outPixels)
+    {
+        for (unsigned int x = 0; x < width; x++, bytes += 4)
+        {
+            float *value = outPixels[x].value;
+            for (int c = 0; c < 3; c++)
+            {
+                if (content == MIP_CONTENT_SRGB)
+                    value[c] = srgbTables.toLinear[bytes[c]];
+                else if (content == MIP_CONTENT_NORMAL)
+                    value[c] = bytes[c] * (2.0f / 255.0f) - 1.0f;
+                else
+                    value[c] = bytes[c] * (1.0f / 255.0f);
+            }
+            value[3] = bytes[3] * (1.0f / 255.0f);
+        }
+    }
+
+    void encodeRow(const Pixel *pixels, unsigned int width, uint32_t content, unsigned char *outBytes)
+    {
+        for (unsigned int x = 0; x < width; x++, outBytes += 4)
+        {
+            const float *value = pixels[x].value;
+            if (content == MIP_CONTENT_SRGB)
+            {
+                for (int c = 0; c < 3; c++)
+                    outBytes[c] = srgbTables.encode(value[c]);
+            }
+            else if (content == MIP_CONTENT_NORMAL)
+            {
+                // Normals that cancel out point straight up
+                float length = sqrtf(value[0] * value[0] + value[1] * value[1] + value[2] * value[2]);
+                float normal[3] = { 0.0f, 0.0f, 1.0f };
+                if (length > 1e-6f)
+                {
+                    for (int c = 0; c < 3; c++)
+                        normal[c] = value[c] / length;
+                }
+                for (int c = 0; c < 3; c++)
+                    outBytes[c] = encodeUnorm(normal[c] * 0.5f + 0.5f);
+            }
+            else
+            {
+                for (int c = 0; c < 3; c++)
+                    outBytes[c] = encodeUnorm(value[c]);
+            }
+            outBytes[3] = encodeUnorm(value[3]);
+        }
+    }
+
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 20; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Windowed sinc at a distance in output texels
+    double kaiserWeight(double distance)
+    {
+        if (fabs(distance) >= kaiserRadius)
+            return 0.0;
+        double sinc = distance == 0.0 ? 1.0 : sin(pi * distance) / (pi * distance);
+        double u = distance / kaiserRadius;
+        return sinc * besselI0(kaiserBeta * sqrt(1.0 - u * u)) / besselI0(kaiserBeta);
+    }
+
+    struct Tap
+    {
+        unsigned int source;
+        float weight;
+    };
+
+    // Source texels and weights of every output texel along one axis;
+    // output i uses taps[first[i]] .. taps[first[i + 1] - 1]
+    struct AxisTaps
+    {
+        std::vector<unsigned int> first;
+        std::vector<Tap> taps;
+    };
+
+    void buildTaps(unsigned int sourceSize, unsigned int outputSize, uint32_t filter, AxisTaps &outTaps)
+    {
+        double scale = static_cast<double>(sourceSize) / outputSize;
+        for (unsigned int i = 0; i < outputSize; i++)
+        {
+            size_t begin = outTaps.taps.size();
+            outTaps.first.push_back(static_cast<unsigned int>(begin));
+            if (sourceSize == outputSize)
+            {
+                Tap tap = { i, 1.0f };
+                outTaps.taps.push_back(tap);
+                continue;
+            }
+
+            if (filter == MIP_FILTER_BOX)
+            {
+                // Each source texel weighted by how much of it the output covers
+                double low = i * scale, high = (i + 1) * scale;
+                for (unsigned int s = static_cast<unsigned int>(low); s < sourceSize && s < high; s++)
+                {
+                    Tap tap = { s, static_cast<float>(std::min<double>(high, s + 1) - std::max<double>(low, s)) };
+                    outTaps.taps.push_back(tap);
+                }
+            }
+            else
+            {
+                double center = (i + 0.5) * scale - 0.5;
+                int low = static_cast<int>(ceil(center - kaiserRadius * scale));
+                int high = static_cast<int>(floor(center + kaiserRadius * scale));
+                for (int s = low; s <= high; s++)
+                {
+                    double weight = kaiserWeight((s - center) / scale);
+                    if (weight == 0.0)
+                        continue;
+                    int wrapped = ((s % static_cast<int>(sourceSize)) + static_cast<int>(sourceSize)) % static_cast<int>(sourceSize);
+                    Tap tap = { static_cast<unsigned int>(wrapped), static_cast<float>(weight) };
+                    outTaps.taps.push_back(tap);
+                }
+            }
+
+            float total = 0.0f;
+            for (size_t t = begin; t < outTaps.taps.size(); t++)
+                total += outTaps.taps[t].weight;
+            for (size_t t = begin; t < outTaps.taps.size(); t++)
+                outTaps.taps[t].weight /= total;
+        }
+        outTaps.first.push_back(static_cast<unsigned int>(outTaps.taps.size()));
+    }
+}
+
+void downsampleImage(const unsigned char *rgba, unsigned int width, unsigned int height,
+                     uint32_t content, uint32_t filter, std::vector<unsigned char> &outImage,
+                     unsigned int threadCount)
+{
+    unsigned int outputWidth = std::max(1u, width / 2), outputHeight = std::max(1u, height / 2);
+    outImage.resize(static_cast<size_t>(outputWidth) * outputHeight * 4);
+
+    AxisTaps columnTaps, rowTaps;
+    buildTaps(width, outputWidth, filter, columnTaps);
+    buildTaps(height, outputHeight, filter, rowTaps);
+
+    // Filter down the columns into one row, then along that row
+    parallelFor(outputHeight, minRowsPerThread, threadCount, [&](size_t begin, size_t end)
+    {
+        std::vector<Pixel> cache(static_cast<size_t>(cachedRowCount) * width);
+        std::vector<unsigned int> cachedRows(cachedRowCount, ~0u);
+        unsigned int nextSlot = 0;
+        std::vector<Pixel> column(width), row(outputWidth);
+        const Pixel zero = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+
+        for (size_t y = begin; y < end; y++)
+        {
+            std::fill(column.begin(), column.end(), zero);
+            for (unsigned int t = rowTaps.first[y]; t < rowTaps.first[y + 1]; t++)
+            {
+                const Tap &tap = rowTaps.taps[t];
+                unsigned int slot = static_cast<unsigned int>(
+                    std::find(cachedRows.begin(), cachedRows.end(), tap.source) - cachedRows.begin());
+                if (slot == cachedRowCount)
+                {
+                    slot = nextSlot;
+                    nextSlot = (nextSlot + 1) % cachedRowCount;
+                    cachedRows[slot] = tap.source;
+                    decodeRow(rgba + static_cast<size_t>(tap.source) * width * 4, width, content, &cache[slot * width]);
+                }
+
+                const Pixel *source = &cache[slot * width];
+                for (unsigned int x = 0; x < width; x++)
+                    accumulate(column[x], source[x], tap.weight);
+            }
+
+            for (unsigned int x = 0; x < outputWidth; x++)
+            {
+                row[x] = zero;
+                for (unsigned int t = columnTaps.first[x]; t < columnTaps.first[x + 1]; t++)
+                    accumulate(row[x], column[columnTaps.taps[t].source], columnTaps.taps[t].weight);
+            }
+            encodeRow(row.data(), outputWidth, content, &outImage[y * outputWidth * 4]);
+        }
+    });
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+// How the values of an image are averaged when it is filtered down
+enum MipContent
+{
+    MIP_CONTENT_LINEAR = 1,     // every channel as stored, for data such as specular maps
+    MIP_CONTENT_SRGB,           // colour averaged in linear light and encoded back to sRGB
+    MIP_CONTENT_NORMAL          // xyz averaged as vectors in [-1, 1] and renormalised
+};
+
+enum MipFilter
+{
+    MIP_FILTER_KAISER = 1,      // Kaiser windowed sinc over 8 taps, sharp without aliasing
+    MIP_FILTER_BOX              // average of the pixels each texel covers
+};
+
+// Filter an RGBA8 image down to the next mip level, max(1, width / 2) by
+// max(1, height / 2). Filters wrap around the edges, as the textures repeat.
+// Rows are split over up to threadCount threads (0 uses every core), and the
+// arithmetic uses SSE2 where the compiler targets it.
+void downsampleImage(const unsigned char *rgba, unsigned int width, unsigned int height,
+                     uint32_t content, uint32_t filter, std::vector<unsigned char> &outImage,
+                     unsigned int threadCount = 0);
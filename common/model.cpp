@@ -3,256 +3,554 @@
 #include <string>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #include "model.hpp"
-#include "stb_image.hpp"
+#include "meshcache.hpp"
+#include "material.hpp"
+#include "uniforms.hpp"
+#include "resourcecache.hpp"
+#include "fileutil.hpp"
+#include "simplify.hpp"
+#include "trace.hpp"
+#include "bcn.hpp"
+#include "texturecache.hpp"
+#include "texturestreamer.hpp"
+#include "threadpool.hpp"
+#include "parallel.hpp"
 
-Model::Model(const char *path)
+GpuMesh::GpuMesh()
+    : VAO(0), vertexBuffer(0), elementBuffer(0), positionOffset(0.0f), positionScale(1.0f),
+      vertexCount(0), indexCount(0), indexSize(4), indexType(GL_UNSIGNED_INT)
 {
+    bounds.min = bounds.max = bounds.center = glm::vec3(0.0f);
+    bounds.radius = 0.0f;
+}
+
+GpuMesh::~GpuMesh()
+{
+    if (original || VAO == 0 || !ResourceCache::hasContext())
+        return;
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &elementBuffer);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+Model::Model()
+    : textureID(0)
+{
+}
+
+Model::Model(const char *path, bool optimize, float lodError)
+    : Model()
+{
+    // Models of a file already loaded share its mesh
+    bool created;
+    mesh = resourceCache().acquireMesh(path, optimize ? MESH_CACHE_OPTIMIZE : 0, lodError, created);
+    if (!created)
+        return;
+    
     // Load object
-    bool res = loadObj(path, vertices, uvs, normals);
+    CachedMesh cached;
+    bool res = loadObj(path, cached, optimize, lodError);
     
     // Setup buffers
-    setupBuffers();
+    if (res)
+        upload(path, cached);
 }
 
-void Model::draw(unsigned int &shaderID, bool Draw)
+void Model::upload(const char *path, const CachedMesh &cached, bool loadTextures)
 {
-    // Send material properties to the shader
-    glUniform1f(glGetUniformLocation(shaderID, "ka"), ka);
-    glUniform1f(glGetUniformLocation(shaderID, "kd"), kd);
-    glUniform1f(glGetUniformLocation(shaderID, "ks"), ks);
-    glUniform1f(glGetUniformLocation(shaderID, "Ns"), Ns);
+    TRACE_SCOPE("Model::upload", path);
     
-    // Bind the textures
-    unsigned int diffuseNum = 0;
-    unsigned int normalNum = 0;
-    for (unsigned int i = 0; i < textures.size(); i++)
-    {
-        // Bind texture
-        std::string name = textures[i].type;
-        glActiveTexture(GL_TEXTURE0 + i);
-        glUniform1i(glGetUniformLocation(shaderID, (name + "Map").c_str()), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
-    }
+    setupParts(*mesh, path, cached, loadTextures);
     
-    // Draw the triangles
-    if(Draw)
+    // A file with the same contents as a mesh already loaded uses its buffers
+    MeshHandle original = resourceCache().shareMeshContents(mesh, cached.header());
+    if (original && original->loaded())
     {
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(vertices.size()));
-        glBindVertexArray(0);
+        mesh->original = original;
+        mesh->VAO = original->VAO;
+        mesh->vertexBuffer = original->vertexBuffer;
+        mesh->elementBuffer = original->elementBuffer;
+        mesh->positionOffset = original->positionOffset;
+        mesh->positionScale = original->positionScale;
+        mesh->vertexCount = original->vertexCount;
+        mesh->indexCount = original->indexCount;
+        mesh->indexSize = original->indexSize;
+        mesh->indexType = original->indexType;
+        return;
     }
+    setupBuffers(*mesh, cached);
 }
 
-void Model::setupBuffers()
+void Model::draw(unsigned int &shaderID, bool Draw, unsigned int lod)
 {
-    // Create and bind the Vertex Array Object (VAO)
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-    
-    // Create Vertex Buffer Object
-    unsigned int vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-    
-    // Create uv buffer
-    unsigned int uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-    
-    // Create normal buffer
-    unsigned int normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-    
-    // Bind the vertex buffer
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    if (!mesh)
+        return;
+    const std::vector<ModelPart> &parts = mesh->parts;
+    const std::vector<MeshLod> &lods = mesh->lods;
     
-    // Bind the uv buffer
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    if (!Draw)
+    {
+        if (!parts.empty())
+            materialTable().get(material(0)).bind(shaderID);
+        return;
+    }
     
-    // Bind the normal buffer
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    if (lod >= lods.size())
+        return;
     
-     // Bind the VAO
+    // Draw the triangles of each material
+    bindVertexArray(shaderID);
+    for (unsigned int i = 0; i < lods[lod].subMeshCount; i++)
+    {
+        unsigned int index = lods[lod].firstSubMesh + i;
+        materialTable().get(material(index)).bind(shaderID);
+        drawPart(parts[index]);
+    }
     glBindVertexArray(0);
 }
 
-void Model::deleteBuffers()
+BoundingVolume Model::worldBounds(const glm::mat4 &modelMatrix) const
 {
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
-    glDeleteVertexArrays(1, &VAO);
+    // A model still loading is a point at its origin
+    static const GpuMesh empty;
+    return transformVolume(mesh ? mesh->bounds : empty.bounds, modelMatrix);
 }
 
-bool Model::loadObj(const char *path,
-                    std::vector<glm::vec3> &outVertices,
-                    std::vector<glm::vec2> &outUVs,
-                    std::vector<glm::vec3> &outNormals)
+unsigned int Model::selectLod(const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition,
+                              float pixelsPerUnit) const
 {
+    // The largest axis scale bounds how much the matrix can enlarge an error
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+                           std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
     
-    printf("Loading file %s\n", path);
+    // Distance to the nearest point of the bounding sphere
+    BoundingVolume world = worldBounds(modelMatrix);
+    float distance = glm::length(cameraPosition - world.center) - world.radius;
     
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> tempVertices;
-    std::vector<glm::vec2> tempUVs;
-    std::vector<glm::vec3> tempNormals;
+    if (!mesh)
+        return 0;
+    return ::selectLod(mesh->lods.data(), mesh->lods.size(), scale, distance, pixelsPerUnit);
+}
+
+void Model::bindVertexArray(unsigned int shaderID) const
+{
+    glBindVertexArray(mesh->VAO);
+    const ShaderUniforms &uniforms = shaderUniforms(shaderID);
+    setUniform(uniforms.positionOffset, mesh->positionOffset);
+    setUniform(uniforms.positionScale, mesh->positionScale);
+}
+
+void Model::drawPart(const ModelPart &part) const
+{
+    glDrawElements(GL_TRIANGLES, part.indexCount, mesh->indexType,
+                   (void*)(static_cast<size_t>(part.indexOffset) * mesh->indexSize));
+}
+
+void Model::drawRanges(const IndexRange *ranges, size_t rangeCount) const
+{
+    GLenum indexType = mesh->indexType;
+    unsigned int indexSize = mesh->indexSize;
+    if (rangeCount == 1)
+    {
+        glDrawElements(GL_TRIANGLES, ranges[0].indexCount, indexType,
+                       (void*)(static_cast<size_t>(ranges[0].indexOffset) * indexSize));
+        return;
+    }
     
-    FILE *file = fopen(path, "r");
-    if (file==NULL)
+    rangeCounts.resize(rangeCount);
+    rangeOffsets.resize(rangeCount);
+    for (size_t i = 0; i < rangeCount; i++)
     {
-        printf("Impossible to open the file. Check paths and directories.");
-        getchar();
-        return false;
+        rangeCounts[i] = ranges[i].indexCount;
+        rangeOffsets[i] = (const void*)(static_cast<size_t>(ranges[i].indexOffset) * indexSize);
     }
+    glMultiDrawElements(GL_TRIANGLES, rangeCounts.data(), indexType, rangeOffsets.data(),
+                        static_cast<GLsizei>(rangeCount));
+}
+
+void Model::setupParts(GpuMesh &mesh, const char *path, const CachedMesh &cached, bool loadTextures)
+{
+    std::vector<ModelPart> &parts = mesh.parts;
+    std::vector<Meshlet> &meshlets = mesh.meshlets;
+    BoundingVolume &bounds = mesh.bounds;
+    
+    // Libraries are named relative to the .obj file
+    std::string directory = directoryOf(path);
+    std::vector<std::string> libraries = cached.strings(MESH_SECTION_LIBRARIES);
+    for (std::string &library : libraries)
+        library = directory + library;
+    std::vector<std::string> names = cached.strings(MESH_SECTION_MATERIALS);
+    mesh.lods = cached.lods();
+    MeshBounds meshBounds = cached.bounds();
+    bounds.min = glm::vec3(meshBounds.min[0], meshBounds.min[1], meshBounds.min[2]);
+    bounds.max = glm::vec3(meshBounds.max[0], meshBounds.max[1], meshBounds.max[2]);
+    bounds.center = glm::vec3(meshBounds.center[0], meshBounds.center[1], meshBounds.center[2]);
+    bounds.radius = meshBounds.radius;
+    meshlets = cached.meshlets();
     
-    while (true)
+    size_t subMeshesSize;
+    const SubMesh *subMeshes = static_cast<const SubMesh *>(cached.section(MESH_SECTION_SUBMESHES, &subMeshesSize));
+    size_t subMeshCount = subMeshes ? subMeshesSize / sizeof(SubMesh) : 0;
+    
+    MaterialTable &table = materialTable();
+    unsigned int meshlet = 0;
+    for (size_t i = 0; i < subMeshCount; i++)
     {
-        // Read the first word of the line
-        char lineHeader[128];
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-        {
-            // If end of file reached exit the loop
-            break;
-        }
+        const SubMesh &subMesh = subMeshes[i];
+        const std::string &name = subMesh.material < names.size() ? names[subMesh.material] : std::string();
         
-        if (strcmp(lineHeader, "v") == 0)
-        {
-            // Read vertices
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            tempVertices.push_back(vertex);
-        }
-        else if (strcmp(lineHeader, "vt") == 0)
-        {
-            // Read texture co-ordinates
-            glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            tempUVs.push_back(uv);
-        }
-        else if (strcmp(lineHeader, "vn") == 0)
-        {
-            // Read vertex normals
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            tempNormals.push_back(normal);
-        }
-        else if (strcmp(lineHeader, "f") == 0)
+        ModelPart part;
+        part.indexOffset = subMesh.indexOffset;
+        part.indexCount = subMesh.indexCount;
+        part.material = table.acquire(libraries, name, path);
+        
+        // Meshlets are in index order, so each part's are the next run
+        while (meshlet < meshlets.size() && meshlets[meshlet].indexOffset < part.indexOffset)
+            meshlet++;
+        part.firstMeshlet = meshlet;
+        while (meshlet < meshlets.size() && meshlets[meshlet].indexOffset < part.indexOffset + part.indexCount)
+            meshlet++;
+        part.meshletCount = meshlet - part.firstMeshlet;
+        parts.push_back(part);
+    }
+    
+    // Load the texture maps named by the libraries the first time they are
+    // used, all together
+    if (!loadTextures)
+        return;
+    std::vector<Texture *> maps;
+    std::vector<TextureLoad> loads;
+    for (const ModelPart &part : parts)
+    {
+        for (Texture &texture : table.get(part.material).textures)
         {
-            // Read vertex indices
-            std::string vertex1, vertex2, vertex3;
-            unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n",
-                                 &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                                 &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                                 &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-            
-            // Check for error
-            if (matches != 9)
-            {
-                printf("File can't be read by loadObj().\n");
-                fclose(file);
-                return false;
-            }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices    .push_back(uvIndex[0]);
-            uvIndices    .push_back(uvIndex[1]);
-            uvIndices    .push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
+            if (texture.resource || std::find(maps.begin(), maps.end(), &texture) != maps.end())
+                continue;
+            maps.push_back(&texture);
+            loads.push_back(TextureLoad(texture.path, texture.type));
         }
-        else
+    }
+    Model::loadTextures(loads);
+    for (size_t i = 0; i < maps.size(); i++)
+        maps[i]->resource = loads[i].texture;
+}
+
+namespace
+{
+    // GL type and normalisation of each packed attribute format
+    void glVertexFormat(uint32_t type, GLenum &outType, GLboolean &outNormalized)
+    {
+        switch (type)
         {
-            // Remove comment line
-            char commentBuffer[1000];
-            fgets(commentBuffer, 1000, file);
+        case PACKED_FLOAT16:
+            outType = GL_HALF_FLOAT;
+            outNormalized = GL_FALSE;
+            break;
+        case PACKED_UNORM16:
+            outType = GL_UNSIGNED_SHORT;
+            outNormalized = GL_TRUE;
+            break;
+        case PACKED_SNORM10:
+            outType = GL_INT_2_10_10_10_REV;
+            outNormalized = GL_TRUE;
+            break;
+        default:
+            outType = GL_FLOAT;
+            outNormalized = GL_FALSE;
+            break;
         }
     }
+}
+
+void Model::setupBuffers(GpuMesh &mesh, const CachedMesh &cached)
+{
+    // The streams are already in their GPU layout, so they are uploaded
+    // straight from the mapped cache file without any intermediate copies
+    size_t verticesSize, indicesSize;
+    const void *vertexData = cached.section(MESH_SECTION_VERTICES, &verticesSize);
+    const void *indexData = cached.section(MESH_SECTION_INDICES, &indicesSize);
+    const PackedVertexLayout &layout = cached.vertexLayout();
     
-    // For each vertex of the triangle
-    for (unsigned int i = 0; i < vertexIndices.size(); i++)
+    mesh.vertexCount = cached.header().vertexCount;
+    mesh.indexCount = cached.header().indexCount;
+    mesh.indexSize = cached.header().indexSize;
+    mesh.indexType = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    mesh.positionOffset = glm::vec3(layout.positionOffset[0], layout.positionOffset[1], layout.positionOffset[2]);
+    mesh.positionScale = glm::vec3(layout.positionScale[0], layout.positionScale[1], layout.positionScale[2]);
+    
+    // Create and bind the Vertex Array Object (VAO)
+    glGenVertexArrays(1, &mesh.VAO);
+    glBindVertexArray(mesh.VAO);
+    
+    // Create the interleaved vertex buffer
+    glGenBuffers(1, &mesh.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, verticesSize, vertexData, GL_STATIC_DRAW);
+    
+    // Create index buffer
+    glGenBuffers(1, &mesh.elementBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, indexData, GL_STATIC_DRAW);
+    
+    // Point each shader input at its attribute in the vertex
+    for (uint32_t i = 0; i < layout.attributeCount; i++)
     {
-        // Get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
+        const PackedVertexAttribute &attribute = layout.attributes[i];
+        GLenum type;
+        GLboolean normalized;
+        glVertexFormat(attribute.type, type, normalized);
         
-        // Get the attributes
-        glm::vec3 vertex = tempVertices[vertexIndex - 1];
-        glm::vec2 uv = tempUVs[uvIndex - 1];
-        glm::vec3 normal = tempNormals[normalIndex - 1];
-        
-        // Copy the attributes to the buffers
-        outVertices.push_back(vertex);
-        outUVs.push_back(uv);
-        outNormals.push_back(normal);
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.components, type, normalized,
+                              layout.stride, (void*)(size_t)attribute.offset);
     }
     
-    // Close .obj file
-    fclose(file);
+     // Bind the VAO
+    glBindVertexArray(0);
+}
+
+void Model::deleteBuffers()
+{
+    mesh.reset();
+}
+
+bool Model::loadObj(const char *path, CachedMesh &mesh, bool optimize, float lodError, unsigned int threadCount)
+{
+    TRACE_SCOPE("Model::loadObj", path);
+    printf("Loading file %s\n", path);
+    
+    // Map the binary cache, parsing the .obj only when it is missing or stale
+    if (!mesh.load(path, optimize ? MESH_CACHE_OPTIMIZE : 0, lodError, threadCount))
+        return false;
     
+    MeshCacheStats stats = mesh.stats();
+    printf("%u indices, %u vertices%s, %zu levels of detail, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+           mesh.header().indexCount, mesh.header().vertexCount, mesh.wasWarm() ? " (cached)" : "",
+           mesh.lods().size(), stats.acmrBefore, stats.acmrAfter, stats.atvrBefore, stats.atvrAfter);
     return true;
 }
 
-void Model::addTexture(const char *path, const std::string type)
+void Model::addTexture(const char *path, const std::string type, bool flipVertically)
 {
     Texture texture;
-    texture.id = loadTexture(path);
+    texture.resource = loadTexture(path, type, flipVertically);
     texture.type = type;
-    textures.push_back(texture);
+    texture.path = path;
+    addTexture(texture);
+}
+
+void Model::addTexture(const Texture &texture)
+{
+    if (!mesh)
+        return;
+    
+    // The mesh's materials are shared with other models, so the texture
+    // goes on variants of them. Parts sharing a material share its variant.
+    MaterialTable &table = materialTable();
+    for (size_t i = materials.size(); i < mesh->parts.size(); i++)
+        materials.push_back(mesh->parts[i].material);
+    for (unsigned int &id : materials)
+        id = table.withTexture(id, texture);
 }
 
-unsigned int Model::loadTexture(const char *path)
+void Model::addTextures(std::vector<TextureLoad> &loads, unsigned int threadCount)
 {
+    loadTextures(loads, threadCount);
+    for (const TextureLoad &load : loads)
+    {
+        Texture texture;
+        texture.resource = load.texture;
+        texture.type = load.type;
+        texture.path = load.path;
+        addTexture(texture);
+    }
+}
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+namespace
+{
+    // A texture between reading its image and uploading it
+    struct PendingTexture
+    {
+        TextureHandle texture;
+        uint32_t usage;
+        uint32_t options;
+        CompressedTexture compressed;
+        bool loaded;
+    };
 
-    int width, height, numComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &numComponents, 0);
-    if (data)
+    // The part of loading that makes no GL calls, safe on any thread.
+    // Cooking compresses on up to threadCount threads (0 uses every core).
+    void readPendingTexture(PendingTexture &pending, unsigned int threadCount = 0)
     {
-        GLenum format;
-        if (numComponents == 1)
-            format = GL_RED;
-        else if (numComponents == 3)
-            format = GL_RGB;
-        else if (numComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        TRACE_SCOPE("Model::loadTexture", pending.texture->path);
+        uint64_t contentHash;
+        pending.loaded = loadTextureCache(pending.texture->path.c_str(), pending.usage, pending.options,
+                                          pending.compressed, contentHash, NULL, threadCount);
+        
+        // Files with the same bytes as a texture already loaded share it
+        if (pending.loaded)
+            pending.texture->original = resourceCache().shareTextureContents(pending.texture, contentHash);
+    }
+
+    void uploadPendingTexture(PendingTexture &pending)
+    {
+        GpuTexture &texture = *pending.texture;
+        if (!pending.loaded)
+        {
+            std::cout << "Texture " << texture.path << " failed to load." << std::endl;
+            return;
+        }
+        if (texture.original)
+            return;
+        
+        glGenTextures(1, &texture.id);
+        texture.owned = true;
+        Model::uploadCompressedTexture(texture, pending.compressed);
+    }
+
+    // Settings of a texture to load; acquiring it from the resource cache
+    // needs them, so the texture is set afterwards
+    PendingTexture pendingTexture(const std::string &type, bool flipVertically)
+    {
+        PendingTexture pending;
+        pending.usage = textureUsage(type);
+        pending.options = flipVertically ? TEXTURE_CACHE_FLIP_VERTICALLY : 0;
+        pending.loaded = false;
+        return pending;
+    }
+}
+
+TextureHandle Model::loadTexture(const char *path, const std::string &type, bool flipVertically)
+{
+    bool created;
+    PendingTexture pending = pendingTexture(type, flipVertically);
+    TextureHandle texture = resourceCache().acquireTexture(path, pending.usage, pending.options, created);
+    if (!created)
+        return texture;
+
+    pending.texture = texture;
+    readPendingTexture(pending);
+    uploadPendingTexture(pending);
+    return texture;
+}
+
+void Model::loadTextures(std::vector<TextureLoad> &loads, unsigned int threadCount)
+{
+    // Textures the resource cache has, or that come earlier in the list,
+    // are shared
+    std::vector<PendingTexture> pending;
+    for (TextureLoad &load : loads)
+    {
+        bool created;
+        PendingTexture texture = pendingTexture(load.type, load.flipVertically);
+        load.texture = resourceCache().acquireTexture(load.path.c_str(), texture.usage, texture.options, created);
+        if (created)
+        {
+            texture.texture = load.texture;
+            pending.push_back(texture);
+        }
+    }
+    if (pending.empty())
+        return;
 
-        stbi_image_free(data);
+    // Images differ a lot in size, so each is its own task rather than
+    // splitting the list evenly
+    if (threadCount == 0)
+        threadCount = hardwareThreadCount();
+    if (pending.size() == 1 || threadCount == 1)
+    {
+        for (PendingTexture &texture : pending)
+            readPendingTexture(texture, threadCount);
     }
     else
     {
-        std::cout << "Texture " << path << " failed to load." << std::endl;
-        stbi_image_free(data);
+        // Each task gets its share of the threads, so tasks compressing at
+        // once don't each start one per core
+        TRACE_SCOPE("Model::loadTextures");
+        ThreadPool pool(std::min<unsigned int>(threadCount, static_cast<unsigned int>(pending.size())));
+        unsigned int taskThreads = std::max(1u, threadCount / pool.threadCount());
+        for (PendingTexture &texture : pending)
+            pool.submit([&texture, taskThreads] { readPendingTexture(texture, taskThreads); });
+        pool.wait();
+    }
+
+    for (PendingTexture &texture : pending)
+        uploadPendingTexture(texture);
+}
+
+void Model::uploadTexture(unsigned int textureID, int width, int height, int components,
+                          const unsigned char *pixels)
+{
+    GLenum format;
+    if (components == 1)
+        format = GL_RED;
+    else if (components == 2)
+        format = GL_RG;
+    else if (components == 3)
+        format = GL_RGB;
+    else
+        format = GL_RGBA;
+
+    // Rows of 1 and 3 channel images are not always 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    {
+        TRACE_SCOPE("glTexImage2D");
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    }
+    {
+        TRACE_SCOPE("glGenerateMipmap");
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void Model::uploadCompressedTexture(GpuTexture &target, const CompressedTexture &texture)
+{
+    GLenum internalFormat;
+    bool supported = glBlockFormat(texture.format, internalFormat);
+
+    target.internalFormat = supported ? internalFormat : GL_RGBA8;
+    target.width = texture.width;
+    target.height = texture.height;
+    target.levels = static_cast<unsigned int>(texture.levels.size());
+
+    glBindTexture(GL_TEXTURE_2D, target.id);
+    std::vector<unsigned char> decompressed;
+    for (size_t level = 0; level < texture.levels.size(); level++)
+    {
+        GLsizei width = std::max(1u, texture.width >> level);
+        GLsizei height = std::max(1u, texture.height >> level);
+        const std::vector<unsigned char> &blocks = texture.levels[level];
+        if (supported)
+        {
+            TRACE_SCOPE("glCompressedTexImage2D");
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internalFormat, width, height, 0,
+                                   static_cast<GLsizei>(blocks.size()), blocks.data());
+        }
+        else
+        {
+            TRACE_SCOPE("decompressImage");
+            decompressed.resize(static_cast<size_t>(width) * height * 4);
+            decompressImage(blocks.data(), width, height, texture.format, decompressed.data());
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA8, width, height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, decompressed.data());
+        }
     }
 
-    return textureID;
+    // Sampling stops at the last stored level
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
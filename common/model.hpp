@@ -7,54 +7,169 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
-// Texture struct
-struct Texture
+#include "meshcache.hpp"
+#include "meshlet.hpp"
+#include "frustum.hpp"
+#include "material.hpp"
+#include "resourcecache.hpp"
+#include "ktx2.hpp"
+
+// Range of the index buffer drawn with one material
+struct ModelPart
 {
-    unsigned int id;
-    std::string type;
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    unsigned int material;      // index into materialTable()
+    unsigned int firstMeshlet;  // index into Model::meshlets
+    unsigned int meshletCount;
+};
+
+// Buffers and draw ranges of a cooked mesh, shared through the resource
+// cache by every model loaded from the same file
+struct GpuMesh
+{
+    std::vector<ModelPart> parts;
+    
+    // Levels of detail, each a range of parts, and the model space bounds
+    std::vector<MeshLod> lods;
+    BoundingVolume bounds;
+    
+    // Clusters of every part, for culling finer than the whole model
+    std::vector<Meshlet> meshlets;
+    
+    // Array buffers, owned unless they are those of a mesh with the same
+    // contents
+    unsigned int VAO;
+    unsigned int vertexBuffer;
+    unsigned int elementBuffer;
+    MeshHandle original;
+    
+    // Quantised positions decode as positionOffset + positionScale * value
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    
+    // Indexed draw parameters
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    unsigned int indexSize;
+    GLenum indexType;
+    
+    GpuMesh();
+    ~GpuMesh();
+    
+    // Empty until its model has loaded
+    bool loaded() const { return !lods.empty(); }
+    
+private:
+    GpuMesh(const GpuMesh &);
+    GpuMesh &operator=(const GpuMesh &);
+};
+
+// An image for Model::loadTextures to load
+struct TextureLoad
+{
+    std::string path;
+    std::string type;           // material map type, which picks the block format
+    bool flipVertically;        // first row of the image at the bottom
+    TextureHandle texture;      // set by loadTextures
+    
+    TextureLoad(const std::string &path, const std::string &type, bool flipVertically = false)
+        : path(path), type(type), flipVertically(flipVertically) {}
 };
 
 class Model
 {
 public:
-    // Model attributes
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
-    std::vector<Texture>   textures;
+    // Model attributes, the mesh is NULL or empty until loaded
+    MeshHandle mesh;
     unsigned int textureID;
-    float ka, kd, ks, Ns;
     
-    // Constructor
-    Model(const char *path);
+    // Material of each part of the mesh, in materialTable(). Empty while
+    // the model uses the mesh's own materials, which every model of the
+    // same file shares; addTexture gives the model materials of its own.
+    std::vector<unsigned int> materials;
+    
+    // Constructor. With optimize the mesh is reordered for the vertex cache,
+    // overdraw and vertex fetch when its cache is cooked. lodError is the
+    // error budget of the simplified levels, 0 for the full mesh only.
+    Model(const char *path, bool optimize = true, float lodError = meshCacheDefaultLodError);
+    
+    // Empty model that draws nothing until a mesh is uploaded
+    Model();
+    
+    // Loading in two steps, for meshes read on another thread: loadObj
+    // makes no GL calls, upload has to run on the GL thread and fills the
+    // mesh acquired from the resource cache. Without loadTextures the
+    // texture maps of the materials are left without a resource for the
+    // caller to load. threadCount is passed on to CachedMesh::load.
+    static bool loadObj(const char *path, CachedMesh &mesh, bool optimize, float lodError,
+                        unsigned int threadCount = 0);
+    void upload(const char *path, const CachedMesh &cached, bool loadTextures = true);
 
-    void draw(unsigned int& shaderID, bool Draw = true);
+    // Draw model, binding the material of each part. With Draw false only
+    // the first material is bound, for geometry drawn by the caller.
+    void draw(unsigned int& shaderID, bool Draw = true, unsigned int lod = 0);
+    
+    // Box and sphere around the model once placed by the model matrix
+    BoundingVolume worldBounds(const glm::mat4 &modelMatrix) const;
+    
+    // Coarsest level whose error stays under a pixel when drawn with the
+    // model matrix and seen from the camera position
+    unsigned int selectLod(const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition,
+                           float pixelsPerUnit) const;
+    
+    // Material the model draws part index of its mesh with
+    unsigned int material(size_t part) const
+    {
+        return part < materials.size() ? materials[part] : mesh->parts[part].material;
+    }
     
-    // Draw model
+    // Bind the VAO and the position decoding uniforms, then draw parts
+    void bindVertexArray(unsigned int shaderID) const;
+    void drawPart(const ModelPart &part) const;
     
-    // Add textures
-    void addTexture(const char *path, const std::string type);
+    // Draw several index ranges with one call
+    void drawRanges(const IndexRange *ranges, size_t rangeCount) const;
     
-    // Cleanup
+    // Add textures to every material of the model, leaving other models
+    // of the same file as they are. addTextures loads its images together
+    // like loadTextures.
+    void addTexture(const char *path, const std::string type, bool flipVertically = false);
+    void addTexture(const Texture &texture);
+    void addTextures(std::vector<TextureLoad> &loads, unsigned int threadCount = 0);
+    
+    // Fill a texture with a decoded image of 1 to 4 8-bit channels and
+    // build its mipmaps
+    static void uploadTexture(unsigned int textureID, int width, int height, int components,
+                              const unsigned char *pixels);
+    
+    // Fill the GL texture of target with block compressed levels and record
+    // its storage. Drivers without the block format get the levels
+    // decompressed.
+    static void uploadCompressedTexture(GpuTexture &target, const CompressedTexture &texture);
+    
+    // Cleanup. The buffers are freed once no other model uses the mesh.
     void deleteBuffers();
     
+    // Texture of the image at path, loaded through the texture cache in the
+    // block format of its map type and uploaded, unless the resource cache
+    // already has it
+    static TextureHandle loadTexture(const char *path, const std::string &type, bool flipVertically = false);
+    
+    // Load several textures at once: the images are read, decoded and
+    // compressed on up to threadCount threads (0 for one per core), then
+    // uploaded on this thread in the order given
+    static void loadTextures(std::vector<TextureLoad> &loads, unsigned int threadCount = 0);
+    
 private:
     
-    // Array buffers
-    unsigned int VAO;
-    unsigned int vertexBuffer;
-    unsigned int uvBuffer;
-    unsigned int normalBuffer;
+    // Scratch arrays for glMultiDrawElements
+    mutable std::vector<GLsizei> rangeCounts;
+    mutable std::vector<const void *> rangeOffsets;
     
-    // Load .obj file method
-    bool loadObj(const char *path,
-                 std::vector<glm::vec3> &inVertices,
-                 std::vector<glm::vec2> &inUVs,
-                 std::vector<glm::vec3> &inNormals);
+    // Look up the materials of the sub-meshes
+    static void setupParts(GpuMesh &mesh, const char *path, const CachedMesh &cached, bool loadTextures);
     
     // Setup buffers
-    void setupBuffers();
-    
-    // Load texture
-    unsigned int loadTexture(const char *path);
+    static void setupBuffers(GpuMesh &mesh, const CachedMesh &cached);
 };
@@ -0,0 +1,860 @@
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <string.h>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "fileutil.hpp"
+#include "parallel.hpp"
+
+namespace
+{
+    // Powers of ten that are exactly representable as floats
+    const float powersOfTen[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline void skipBlanks(const char *&p)
+    {
+        while (isBlank(*p))
+            p++;
+    }
+
+    inline void skipLine(const char *&p, const char *end)
+    {
+        while (p < end && *p != '\n')
+            p++;
+    }
+
+    // Read the next blank-separated word on the line
+    std::string parseWord(const char *&p)
+    {
+        skipBlanks(p);
+        const char *start = p;
+        while (*p != '\0' && *p != '\n' && !isBlank(*p))
+            p++;
+        return std::string(start, p);
+    }
+
+    // Read the rest of the line, without surrounding blanks
+    std::string parseRestOfLine(const char *&p)
+    {
+        skipBlanks(p);
+        const char *start = p;
+        while (*p != '\0' && *p != '\n')
+            p++;
+        const char *end = p;
+        while (end > start && isBlank(end[-1]))
+            end--;
+        return std::string(start, end);
+    }
+
+    // Parse a decimal float. Short mantissas with small exponents are
+    // computed exactly with a single float multiply or divide, which gives
+    // the same correctly rounded result as scanf. Anything else falls back
+    // to strtof.
+    bool parseFloat(const char *&p, float &out)
+    {
+        skipBlanks(p);
+        const char *start = p;
+
+        bool negative = false;
+        if (*p == '-' || *p == '+')
+        {
+            negative = (*p == '-');
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        while (isDigit(*p))
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits++;
+            p++;
+        }
+        if (*p == '.')
+        {
+            p++;
+            while (isDigit(*p))
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits++;
+                exponent--;
+                p++;
+            }
+        }
+        if (*p == 'e' || *p == 'E')
+        {
+            const char *q = p + 1;
+            bool negativeExponent = false;
+            if (*q == '-' || *q == '+')
+            {
+                negativeExponent = (*q == '-');
+                q++;
+            }
+            if (isDigit(*q))
+            {
+                int value = 0;
+                while (isDigit(*q))
+                {
+                    if (value < 10000)
+                        value = value * 10 + (*q - '0');
+                    q++;
+                }
+                exponent += negativeExponent ? -value : value;
+                p = q;
+            }
+        }
+
+        if (digits > 0 && digits <= 19 && mantissa <= (1u << 24) &&
+            exponent >= -10 && exponent <= 10)
+        {
+            float value = static_cast<float>(mantissa);
+            if (exponent < 0)
+                value /= powersOfTen[-exponent];
+            else
+                value *= powersOfTen[exponent];
+            out = negative ? -value : value;
+            return true;
+        }
+
+        // Slow path for long mantissas, large exponents, inf and nan
+        char *endPtr;
+        out = strtof(start, &endPtr);
+        p = endPtr;
+        return endPtr != start;
+    }
+
+    // Parse a signed decimal integer
+    bool parseInt(const char *&p, int &out)
+    {
+        bool negative = false;
+        if (*p == '-' || *p == '+')
+        {
+            negative = (*p == '-');
+            p++;
+        }
+        if (!isDigit(*p))
+            return false;
+
+        int value = 0;
+        while (isDigit(*p))
+        {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+        out = negative ? -value : value;
+        return true;
+    }
+
+    // Parse a face corner of the form v, v/t, v//n or v/t/n. Missing
+    // attributes are returned as index 0.
+    bool parseCorner(const char *&p, int &v, int &t, int &n)
+    {
+        skipBlanks(p);
+        t = 0;
+        n = 0;
+        if (!parseInt(p, v))
+            return false;
+
+        if (*p == '/')
+        {
+            p++;
+            if (*p != '/' && !parseInt(p, t))
+                return false;
+            if (*p == '/')
+            {
+                p++;
+                if (!parseInt(p, n))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Files smaller than this are parsed on the calling thread
+    const size_t minChunkSize = 1 << 20;
+
+    // Relative (negative) face indices are stored as a chunk-local index
+    // minus this bias until the chunk's offset into the global arrays is known
+    const int relativeBias = 1 << 30;
+
+    // Each face is stored as its corner count plus shading flags
+    const unsigned int faceSmooth = 1u << 31;    // smoothing group is on
+    const unsigned int faceInherit = 1u << 30;   // before any s line in the chunk
+    const unsigned int faceCornerMask = faceInherit - 1;
+
+    // Marks an absent uv or normal, and the end of a dedup chain
+    const unsigned int missingIndex = 0xffffffffu;
+
+    // A usemtl statement taking effect from a triangle onwards
+    struct MaterialSwitch
+    {
+        size_t      triangle;
+        std::string name;
+    };
+
+    // A run of consecutive triangles using one material
+    struct MaterialRun
+    {
+        size_t       first;
+        unsigned int material;
+    };
+
+    // Attributes and faces parsed from one line-aligned chunk
+    struct ObjChunk
+    {
+        const char *begin;
+        const char *end;
+
+        std::vector<glm::vec3>    vertices;
+        std::vector<glm::vec2>    uvs;
+        std::vector<glm::vec3>    normals;
+        std::vector<int>          corners;   // v, t, n triples of every face
+        std::vector<unsigned int> faces;     // corner count and flags per face
+
+        size_t triangleCount;
+        bool missingNormals;
+
+        // Smoothing state left by the last s line, and the state inherited
+        // from earlier chunks
+        bool sawSmoothing, endSmooth, startSmooth;
+
+        // mtllib files and usemtl statements, by chunk-local triangle
+        std::vector<std::string>    libraries;
+        std::vector<MaterialSwitch> materialSwitches;
+
+        // Offsets of this chunk's data in the merged arrays
+        size_t vertexOffset, uvOffset, normalOffset, triangleOffset;
+
+        const char *error;
+    };
+
+    // A face corner after index resolution
+    struct ResolvedCorner
+    {
+        unsigned int vertex;
+        unsigned int uv;
+        unsigned int normal;
+    };
+
+    // Reusable buffers for splitting polygons into triangles
+    struct PolygonScratch
+    {
+        std::vector<ResolvedCorner> corners;
+        std::vector<glm::vec3>      positions;
+        std::vector<glm::vec2>      projected;
+        std::vector<unsigned int>   remaining;
+        std::vector<unsigned int>   triangles;
+    };
+
+    // A distinct uv/normal combination for one position index
+    struct UniqueCorner
+    {
+        unsigned int uv;
+        unsigned int normal;
+        unsigned int next;
+    };
+
+    inline int encodeIndex(int index, size_t localCount)
+    {
+        if (index >= 0)
+            return index;
+        return static_cast<int>(localCount) + index - relativeBias;
+    }
+
+    // Turn a stored index into a 0-based index into the merged array
+    inline bool resolveIndex(int index, size_t chunkOffset, size_t count, size_t &out)
+    {
+        long long global;
+        if (index > 0)
+            global = index - 1;
+        else
+            global = static_cast<long long>(chunkOffset) + index + relativeBias;
+
+        if (global < 0 || global >= static_cast<long long>(count))
+            return false;
+        out = static_cast<size_t>(global);
+        return true;
+    }
+
+    // Newell's method, robust for non-planar and concave polygons
+    glm::vec3 polygonNormal(const glm::vec3 *positions, unsigned int count)
+    {
+        glm::vec3 normal(0.0f);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            const glm::vec3 &a = positions[i];
+            const glm::vec3 &b = positions[(i + 1) % count];
+            normal.x += (a.y - b.y) * (a.z + b.z);
+            normal.y += (a.z - b.z) * (a.x + b.x);
+            normal.z += (a.x - b.x) * (a.y + b.y);
+        }
+        return normal;
+    }
+
+    inline float cross2(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c)
+    {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    // Split a polygon into count - 2 triangles of local corner indices. Convex
+    // polygons are fanned; concave ones are ear-clipped in the polygon's
+    // plane, falling back to a fan if they are too degenerate to clip.
+    void triangulatePolygon(PolygonScratch &scratch, unsigned int count)
+    {
+        std::vector<unsigned int> &triangles = scratch.triangles;
+        triangles.clear();
+
+        if (count > 3)
+        {
+            // Project onto the axis plane the polygon faces most
+            glm::vec3 normal = polygonNormal(scratch.positions.data(), count);
+            glm::vec3 absNormal = glm::abs(normal);
+            int dropAxis = absNormal.x > absNormal.y ? (absNormal.x > absNormal.z ? 0 : 2)
+                                                     : (absNormal.y > absNormal.z ? 1 : 2);
+            int u = (dropAxis + 1) % 3;
+            int v = (dropAxis + 2) % 3;
+            float orientation = normal[dropAxis] >= 0.0f ? 1.0f : -1.0f;
+
+            scratch.projected.resize(count);
+            for (unsigned int i = 0; i < count; i++)
+                scratch.projected[i] = glm::vec2(scratch.positions[i][u], scratch.positions[i][v]);
+            const glm::vec2 *points = scratch.projected.data();
+
+            bool convex = true;
+            for (unsigned int i = 0; i < count && convex; i++)
+                convex = cross2(points[i], points[(i + 1) % count], points[(i + 2) % count]) * orientation >= 0.0f;
+
+            if (!convex)
+            {
+                std::vector<unsigned int> &remaining = scratch.remaining;
+                remaining.resize(count);
+                for (unsigned int i = 0; i < count; i++)
+                    remaining[i] = i;
+
+                while (remaining.size() > 3)
+                {
+                    size_t n = remaining.size();
+                    bool clipped = false;
+                    for (size_t i = 0; i < n && !clipped; i++)
+                    {
+                        unsigned int a = remaining[(i + n - 1) % n];
+                        unsigned int b = remaining[i];
+                        unsigned int c = remaining[(i + 1) % n];
+                        if (cross2(points[a], points[b], points[c]) * orientation <= 0.0f)
+                            continue;
+
+                        // An ear contains none of the other remaining corners
+                        bool ear = true;
+                        for (size_t j = 0; j < n && ear; j++)
+                        {
+                            unsigned int k = remaining[j];
+                            if (k == a || k == b || k == c)
+                                continue;
+                            ear = !(cross2(points[a], points[b], points[k]) * orientation >= 0.0f &&
+                                    cross2(points[b], points[c], points[k]) * orientation >= 0.0f &&
+                                    cross2(points[c], points[a], points[k]) * orientation >= 0.0f);
+                        }
+                        if (!ear)
+                            continue;
+
+                        triangles.push_back(a);
+                        triangles.push_back(b);
+                        triangles.push_back(c);
+                        remaining.erase(remaining.begin() + i);
+                        clipped = true;
+                    }
+                    if (!clipped)
+                        break;
+                }
+
+                // Fan whatever is left
+                for (size_t i = 1; i + 1 < remaining.size(); i++)
+                {
+                    triangles.push_back(remaining[0]);
+                    triangles.push_back(remaining[i]);
+                    triangles.push_back(remaining[i + 1]);
+                }
+                return;
+            }
+        }
+
+        for (unsigned int i = 1; i + 1 < count; i++)
+        {
+            triangles.push_back(0);
+            triangles.push_back(i);
+            triangles.push_back(i + 1);
+        }
+    }
+
+    // Parse the v, vt, vn, s, f, usemtl and mtllib lines of a chunk
+    void parseChunk(ObjChunk &chunk)
+    {
+        size_t size = chunk.end - chunk.begin;
+
+        // Rough guesses from typical line lengths to avoid most regrowth
+        chunk.vertices.reserve(size / 96);
+        chunk.uvs.reserve(size / 96);
+        chunk.normals.reserve(size / 96);
+        chunk.corners.reserve(size / 12);
+        chunk.faces.reserve(size / 48);
+
+        bool smooth = true;
+        const char *p = chunk.begin;
+        const char *end = chunk.end;
+        while (p < end)
+        {
+            // Find the first word of the line
+            while (p < end && (isBlank(*p) || *p == '\n'))
+                p++;
+            if (p >= end)
+                break;
+
+            if (p[0] == 'v' && isBlank(p[1]))
+            {
+                // Read vertices
+                p += 1;
+                glm::vec3 vertex;
+                if (!parseFloat(p, vertex.x) || !parseFloat(p, vertex.y) ||
+                    !parseFloat(p, vertex.z))
+                {
+                    chunk.error = "File can't be read by loadObj().";
+                    return;
+                }
+                chunk.vertices.push_back(vertex);
+            }
+            else if (p[0] == 'v' && p[1] == 't' && isBlank(p[2]))
+            {
+                // Read texture co-ordinates
+                p += 2;
+                glm::vec2 uv;
+                if (!parseFloat(p, uv.x) || !parseFloat(p, uv.y))
+                {
+                    chunk.error = "File can't be read by loadObj().";
+                    return;
+                }
+                chunk.uvs.push_back(uv);
+            }
+            else if (p[0] == 'v' && p[1] == 'n' && isBlank(p[2]))
+            {
+                // Read vertex normals
+                p += 2;
+                glm::vec3 normal;
+                if (!parseFloat(p, normal.x) || !parseFloat(p, normal.y) ||
+                    !parseFloat(p, normal.z))
+                {
+                    chunk.error = "File can't be read by loadObj().";
+                    return;
+                }
+                chunk.normals.push_back(normal);
+            }
+            else if (p[0] == 'f' && isBlank(p[1]))
+            {
+                // Read every corner of the face, in any of the v, v/t, v//n
+                // and v/t/n forms
+                p += 1;
+                unsigned int cornerCount = 0;
+                skipBlanks(p);
+                while (*p != '\n' && *p != '\0' && *p != '#')
+                {
+                    int vertexIndex, uvIndex, normalIndex;
+                    if (!parseCorner(p, vertexIndex, uvIndex, normalIndex))
+                    {
+                        chunk.error = "File can't be read by loadObj().";
+                        return;
+                    }
+                    chunk.corners.push_back(encodeIndex(vertexIndex, chunk.vertices.size()));
+                    chunk.corners.push_back(encodeIndex(uvIndex, chunk.uvs.size()));
+                    chunk.corners.push_back(encodeIndex(normalIndex, chunk.normals.size()));
+                    chunk.missingNormals |= (normalIndex == 0);
+                    cornerCount++;
+                    skipBlanks(p);
+                }
+                if (cornerCount < 3 || cornerCount > faceCornerMask)
+                {
+                    chunk.error = "File can't be read by loadObj().";
+                    return;
+                }
+
+                unsigned int flags = chunk.sawSmoothing ? (smooth ? faceSmooth : 0) : faceInherit;
+                chunk.faces.push_back(cornerCount | flags);
+                chunk.triangleCount += cornerCount - 2;
+            }
+            else if (strncmp(p, "usemtl", 6) == 0 && isBlank(p[6]))
+            {
+                // Material for the faces that follow
+                p += 6;
+                MaterialSwitch materialSwitch;
+                materialSwitch.triangle = chunk.triangleCount;
+                materialSwitch.name = parseRestOfLine(p);
+                chunk.materialSwitches.push_back(materialSwitch);
+            }
+            else if (strncmp(p, "mtllib", 6) == 0 && isBlank(p[6]))
+            {
+                // Material library files
+                p += 6;
+                for (std::string name = parseWord(p); !name.empty(); name = parseWord(p))
+                    chunk.libraries.push_back(name);
+            }
+            else if (p[0] == 's' && isBlank(p[1]))
+            {
+                // Smoothing group, where "off" and 0 mean flat shading
+                p += 1;
+                skipBlanks(p);
+                smooth = !((p[0] == 'o' && p[1] == 'f' && p[2] == 'f') ||
+                           (p[0] == '0' && !isDigit(p[1])));
+                chunk.sawSmoothing = true;
+                chunk.endSmooth = smooth;
+            }
+
+            // Skip the rest of the line, including comments
+            skipLine(p, end);
+        }
+    }
+
+    // Resolve the faces of a chunk to global indices, triangulate them and
+    // assign generated normals to corners that have none. Flat normals are
+    // written straight into their slots; smooth slots are summed afterwards.
+    void resolveChunk(ObjChunk &chunk,
+                      const std::vector<glm::vec3> &vertices, size_t uvCount,
+                      size_t normalCount, std::vector<glm::vec3> &normals,
+                      ResolvedCorner *out)
+    {
+        const size_t vertexCount = vertices.size();
+        const size_t smoothBase = normalCount;
+        const size_t flatBase = normalCount + vertexCount;
+
+        PolygonScratch scratch;
+        size_t triangle = chunk.triangleOffset;
+        const int *corner = chunk.corners.data();
+        for (unsigned int face : chunk.faces)
+        {
+            unsigned int count = face & faceCornerMask;
+            bool smooth = (face & faceInherit) ? chunk.startSmooth : (face & faceSmooth) != 0;
+
+            // Get the indices of its attributes
+            scratch.corners.resize(count);
+            scratch.positions.resize(count);
+            bool generate = false;
+            for (unsigned int i = 0; i < count; i++, corner += 3)
+            {
+                size_t vertex, uv = 0, normal = 0;
+                if (!resolveIndex(corner[0], chunk.vertexOffset, vertexCount, vertex) ||
+                    (corner[1] && !resolveIndex(corner[1], chunk.uvOffset, uvCount, uv)) ||
+                    (corner[2] && !resolveIndex(corner[2], chunk.normalOffset, normalCount, normal)))
+                {
+                    chunk.error = "Face index out of range in loadObj().";
+                    return;
+                }
+
+                ResolvedCorner &resolved = scratch.corners[i];
+                resolved.vertex = static_cast<unsigned int>(vertex);
+                resolved.uv = corner[1] ? static_cast<unsigned int>(uv) : missingIndex;
+                resolved.normal = static_cast<unsigned int>(normal);
+                if (!corner[2])
+                {
+                    resolved.normal = static_cast<unsigned int>(smooth ? smoothBase + vertex : flatBase + triangle);
+                    generate = true;
+                }
+                scratch.positions[i] = vertices[vertex];
+            }
+
+            // One flat normal per face, stored in the slot of its first triangle
+            if (generate && !smooth)
+            {
+                glm::vec3 normal = polygonNormal(scratch.positions.data(), count);
+                float length = glm::length(normal);
+                normals[flatBase + triangle] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+            }
+
+            triangulatePolygon(scratch, count);
+            for (unsigned int index : scratch.triangles)
+                *out++ = scratch.corners[index];
+            triangle += count - 2;
+        }
+    }
+}
+
+unsigned int defaultObjThreadCount()
+{
+    return hardwareThreadCount();
+}
+
+bool parseObj(const char *data, size_t size,
+              MeshData &outMesh,
+              unsigned int threadCount)
+{
+    if (threadCount == 0)
+        threadCount = defaultObjThreadCount();
+    outMesh = MeshData();
+
+    // Split the file into line-aligned chunks, one per thread
+    size_t chunkCount = std::min<size_t>(threadCount, size / minChunkSize + 1);
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char *begin = data;
+    const char *end = data + size;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        const char *chunkEnd = data + size * (i + 1) / chunkCount;
+        while (chunkEnd < end && chunkEnd[-1] != '\n')
+            chunkEnd++;
+        chunks[i].begin = begin;
+        chunks[i].end = std::max(begin, chunkEnd);
+        chunks[i].triangleCount = 0;
+        chunks[i].missingNormals = false;
+        chunks[i].sawSmoothing = false;
+        chunks[i].endSmooth = true;
+        chunks[i].error = NULL;
+        begin = chunks[i].end;
+    }
+
+    // Parse the chunks in parallel
+    runParallel(chunkCount, [&chunks](size_t i) { parseChunk(chunks[i]); });
+
+    // Work out where each chunk's data goes in the merged arrays, and the
+    // smoothing state each chunk inherits from the ones before it
+    size_t vertexCount = 0, uvCount = 0, normalCount = 0, triangleCount = 0;
+    bool smooth = true, missingNormals = false;
+    for (ObjChunk &chunk : chunks)
+    {
+        if (chunk.error)
+        {
+            printf("%s\n", chunk.error);
+            return false;
+        }
+        chunk.vertexOffset   = vertexCount;
+        chunk.uvOffset       = uvCount;
+        chunk.normalOffset   = normalCount;
+        chunk.triangleOffset = triangleCount;
+        vertexCount   += chunk.vertices.size();
+        uvCount       += chunk.uvs.size();
+        normalCount   += chunk.normals.size();
+        triangleCount += chunk.triangleCount;
+
+        chunk.startSmooth = smooth;
+        if (chunk.sawSmoothing)
+            smooth = chunk.endSmooth;
+        missingNormals |= chunk.missingNormals;
+    }
+
+    // Merge the attribute arrays so indices can refer to any chunk. When
+    // normals are missing the normal array gets one smooth slot per position
+    // and one flat slot per triangle after the file's own normals.
+    size_t generatedNormals = missingNormals ? vertexCount + triangleCount : 0;
+    std::vector<glm::vec3> tempVertices(vertexCount);
+    std::vector<glm::vec2> tempUVs(uvCount);
+    std::vector<glm::vec3> tempNormals(normalCount + generatedNormals, glm::vec3(0.0f));
+    runParallel(chunkCount, [&](size_t i)
+    {
+        const ObjChunk &chunk = chunks[i];
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(), tempVertices.begin() + chunk.vertexOffset);
+        std::copy(chunk.uvs.begin(), chunk.uvs.end(), tempUVs.begin() + chunk.uvOffset);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), tempNormals.begin() + chunk.normalOffset);
+    });
+
+    // Resolve and triangulate every face, each chunk filling its own range
+    std::vector<ResolvedCorner> resolved(triangleCount * 3);
+    runParallel(chunkCount, [&](size_t i)
+    {
+        ObjChunk &chunk = chunks[i];
+        resolveChunk(chunk, tempVertices, uvCount, normalCount, tempNormals,
+                     resolved.data() + chunk.triangleOffset * 3);
+    });
+
+    for (const ObjChunk &chunk : chunks)
+    {
+        if (chunk.error)
+        {
+            printf("%s\n", chunk.error);
+            return false;
+        }
+    }
+
+    // Smooth normals are the sum of the face normals around each position,
+    // weighted by the corner angle so the result does not depend on how
+    // polygons were split into triangles
+    if (missingNormals)
+    {
+        const size_t smoothBase = normalCount;
+        const size_t flatBase = normalCount + vertexCount;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const ResolvedCorner *corner = &resolved[t * 3];
+            if ((corner[0].normal < smoothBase || corner[0].normal >= flatBase) &&
+                (corner[1].normal < smoothBase || corner[1].normal >= flatBase) &&
+                (corner[2].normal < smoothBase || corner[2].normal >= flatBase))
+                continue;
+
+            glm::vec3 position[3] = {
+                tempVertices[corner[0].vertex],
+                tempVertices[corner[1].vertex],
+                tempVertices[corner[2].vertex]
+            };
+            glm::vec3 faceNormal = glm::cross(position[1] - position[0], position[2] - position[0]);
+            float area = glm::length(faceNormal);
+            if (area == 0.0f)
+                continue;
+            faceNormal /= area;
+
+            for (int i = 0; i < 3; i++)
+            {
+                if (corner[i].normal < smoothBase || corner[i].normal >= flatBase)
+                    continue;
+
+                glm::vec3 edge1 = position[(i + 1) % 3] - position[i];
+                glm::vec3 edge2 = position[(i + 2) % 3] - position[i];
+                float lengths = glm::length(edge1) * glm::length(edge2);
+                if (lengths == 0.0f)
+                    continue;
+                float angle = acosf(glm::clamp(glm::dot(edge1, edge2) / lengths, -1.0f, 1.0f));
+                tempNormals[corner[i].normal] += faceNormal * angle;
+            }
+        }
+        for (size_t i = smoothBase; i < flatBase; i++)
+        {
+            float length = glm::length(tempNormals[i]);
+            if (length > 0.0f)
+                tempNormals[i] /= length;
+        }
+    }
+
+    // Split the triangles into runs by material, with the material in force
+    // at the end of each chunk carrying over into the next
+    std::unordered_map<std::string, unsigned int> materialIds;
+    std::vector<MaterialRun> runs;
+    std::string currentMaterial;
+    size_t runStart = 0;
+    for (const ObjChunk &chunk : chunks)
+    {
+        for (const MaterialSwitch &materialSwitch : chunk.materialSwitches)
+        {
+            size_t first = chunk.triangleOffset + materialSwitch.triangle;
+            if (first > runStart)
+            {
+                auto inserted = materialIds.insert(std::make_pair(currentMaterial, (unsigned int)materialIds.size()));
+                if (inserted.second)
+                    outMesh.materials.push_back(currentMaterial);
+                runs.push_back({ runStart, inserted.first->second });
+                runStart = first;
+            }
+            currentMaterial = materialSwitch.name;
+        }
+
+        for (const std::string &library : chunk.libraries)
+        {
+            if (std::find(outMesh.materialLibraries.begin(), outMesh.materialLibraries.end(), library) == outMesh.materialLibraries.end())
+                outMesh.materialLibraries.push_back(library);
+        }
+    }
+    if (triangleCount > runStart || runs.empty())
+    {
+        auto inserted = materialIds.insert(std::make_pair(currentMaterial, (unsigned int)materialIds.size()));
+        if (inserted.second)
+            outMesh.materials.push_back(currentMaterial);
+        runs.push_back({ runStart, inserted.first->second });
+    }
+
+    // Gather each material's triangles together so every material is drawn
+    // with one call, keeping the file order within a material
+    std::vector<ResolvedCorner> sorted;
+    if (outMesh.materials.size() > 1)
+        sorted.resize(resolved.size());
+    size_t written = 0;
+    for (unsigned int material = 0; material < outMesh.materials.size(); material++)
+    {
+        SubMesh subMesh;
+        subMesh.indexOffset = static_cast<unsigned int>(written * 3);
+        subMesh.material = material;
+        for (size_t r = 0; r < runs.size(); r++)
+        {
+            if (runs[r].material != material)
+                continue;
+            size_t first = runs[r].first;
+            size_t last = r + 1 < runs.size() ? runs[r + 1].first : triangleCount;
+            if (!sorted.empty())
+                std::copy(resolved.begin() + first * 3, resolved.begin() + last * 3, sorted.begin() + written * 3);
+            written += last - first;
+        }
+        subMesh.indexCount = static_cast<unsigned int>(written * 3) - subMesh.indexOffset;
+        outMesh.subMeshes.push_back(subMesh);
+    }
+    if (!sorted.empty())
+        resolved.swap(sorted);
+
+    // Give each distinct (position, uv, normal) combination one vertex. The
+    // lookup is hashed on the position index, and each bucket chains the
+    // few uv/normal combinations that share that position.
+    std::vector<unsigned int> bucketHead(vertexCount, missingIndex);
+    std::vector<UniqueCorner> uniqueCorners;
+    uniqueCorners.reserve(vertexCount + vertexCount / 2);
+
+    outMesh.vertices.reserve(vertexCount + vertexCount / 2);
+    outMesh.uvs.reserve(vertexCount + vertexCount / 2);
+    outMesh.normals.reserve(vertexCount + vertexCount / 2);
+    outMesh.indices.resize(resolved.size());
+    for (size_t c = 0; c < resolved.size(); c++)
+    {
+        unsigned int vertex = resolved[c].vertex;
+        unsigned int uv = resolved[c].uv;
+        unsigned int normal = resolved[c].normal;
+
+        unsigned int index = missingIndex;
+        for (unsigned int e = bucketHead[vertex]; e != missingIndex; e = uniqueCorners[e].next)
+        {
+            if (uniqueCorners[e].uv == uv && uniqueCorners[e].normal == normal)
+            {
+                index = e;
+                break;
+            }
+        }
+
+        if (index == missingIndex)
+        {
+            // Copy the attributes to the buffers, missing ones are zeroed
+            index = static_cast<unsigned int>(uniqueCorners.size());
+            uniqueCorners.push_back({ uv, normal, bucketHead[vertex] });
+            bucketHead[vertex] = index;
+
+            outMesh.vertices.push_back(tempVertices[vertex]);
+            outMesh.uvs.push_back(uv != missingIndex ? tempUVs[uv] : glm::vec2(0.0f));
+            outMesh.normals.push_back(tempNormals[normal]);
+        }
+        outMesh.indices[c] = index;
+    }
+
+    return true;
+}
+
+bool loadObjFile(const char *path,
+                 MeshData &outMesh,
+                 unsigned int threadCount)
+{
+    std::vector<char> data;
+    if (!readFile(path, data))
+    {
+        printf("Impossible to open %s. Check paths and directories.\n", path);
+        return false;
+    }
+
+    return parseObj(data.data(), data.size() - 1, outMesh, threadCount);
+}
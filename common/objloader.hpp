@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+// A range of the index list drawn with one material
+struct SubMesh
+{
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    unsigned int material;      // index into MeshData::materials
+};
+
+// A detail level: a run of sub-meshes, one per material, that may be drawn
+// in place of the full mesh once its simplification error is small on screen
+struct MeshLod
+{
+    unsigned int firstSubMesh;
+    unsigned int subMeshCount;
+    float        error;         // largest deviation from the full mesh, in model units
+};
+
+// A cluster of nearby triangles, contiguous in the index list, with the
+// bounds used to cull it: a sphere, and a cone around the triangle normals
+// that is backfacing as a whole for cameras inside the opposite cone
+struct Meshlet
+{
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float        center[3];
+    float        radius;
+    float        coneAxis[3];
+    float        coneCutoff;    // sine of the normals' spread, 1 if never backfacing
+};
+
+// Indexed triangle mesh. Every distinct combination of position, uv and
+// normal in the file becomes one vertex, referenced by the index list.
+// Triangles are grouped by their usemtl material, one sub-mesh per material.
+struct MeshData
+{
+    std::vector<glm::vec3>    vertices;
+    std::vector<glm::vec2>    uvs;
+    std::vector<glm::vec3>    normals;
+    std::vector<glm::vec4>    tangents;            // from generateTangents, w is the bitangent sign
+    std::vector<unsigned int> indices;
+
+    std::vector<SubMesh>      subMeshes;
+    std::vector<std::string>  materials;           // usemtl names, "" for none
+    std::vector<std::string>  materialLibraries;   // mtllib files
+    std::vector<MeshLod>      lods;                // from generateLods, level 0 is the full mesh
+    std::vector<Meshlet>      meshlets;            // from buildMeshlets, in index order
+};
+
+// Number of threads used when a thread count of 0 is requested
+unsigned int defaultObjThreadCount();
+
+// Parse the contents of a .obj file held in memory into an indexed mesh,
+// replacing the contents of outMesh. Faces may use any of the v, v/t, v//n
+// and v/t/n corner forms with absolute or negative (relative) indices;
+// polygons are fanned, or ear-clipped when concave. Corners without a normal
+// get a generated one: smooth, or flat where the smoothing group is off.
+// Large files are split into line-aligned chunks that are parsed on up to
+// threadCount threads (0 uses every core).
+bool parseObj(const char *data, size_t size,
+              MeshData &outMesh,
+              unsigned int threadCount = 0);
+
+// Load a .obj file from disk
+bool loadObjFile(const char *path,
+                 MeshData &outMesh,
+                 unsigned int threadCount = 0);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stddef.h>
+
+// Number of threads the hardware runs at once, at least 1
+inline unsigned int hardwareThreadCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+// Run task(0) .. task(count - 1) on their own threads and wait for them
+template <typename Task>
+void runParallel(size_t count, const Task &task)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    for (size_t i = 1; i < count; i++)
+        threads.emplace_back(task, i);
+    task(0);
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+// Split items 0 .. itemCount - 1 into contiguous ranges of at least
+// minItems and run task(begin, end) on each, one thread per range, using up
+// to threadCount threads (0 uses every core)
+template <typename Task>
+void parallelFor(size_t itemCount, size_t minItems, unsigned int threadCount, const Task &task)
+{
+    if (threadCount == 0)
+        threadCount = hardwareThreadCount();
+    size_t rangeCount = std::min<size_t>(threadCount, itemCount / std::max<size_t>(minItems, 1) + 1);
+    runParallel(rangeCount, [&](size_t i)
+    {
+        task(itemCount * i / rangeCount, itemCount * (i + 1) / rangeCount);
+    });
+}
@@ -0,0 +1,180 @@
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "renderqueue.hpp"
+#include "material.hpp"
+#include "uniforms.hpp"
+
+RenderQueue::RenderQueue()
+    : cameraPosition(0.0f), viewProjection(1.0f), haveCamera(false), pixelsPerUnit(0.0f),
+      fullTriangles(0), meshletsDrawn(0), meshletsCulled(0), objectsCulled(0)
+{
+    memset(&sorted, 0, sizeof(sorted));
+    memset(&unsorted, 0, sizeof(unsorted));
+}
+
+void RenderQueue::setCamera(const glm::vec3 &position, const glm::mat4 &cameraViewProjection,
+                            float viewPixelsPerUnit)
+{
+    cameraPosition = position;
+    viewProjection = cameraViewProjection;
+    frustum = extractFrustum(viewProjection);
+    pixelsPerUnit = viewPixelsPerUnit;
+    haveCamera = true;
+}
+
+bool RenderQueue::submit(Model &model, const glm::mat4 &modelMatrix)
+{
+    if (!model.mesh || !model.mesh->loaded())
+        return false;
+    const GpuMesh &mesh = *model.mesh;
+
+    const MeshLod &full = mesh.lods[0];
+    for (unsigned int i = full.firstSubMesh; i < full.firstSubMesh + full.subMeshCount; i++)
+        fullTriangles += mesh.parts[i].indexCount / 3;
+
+    if (haveCamera && !volumeInFrustum(frustum, model.worldBounds(modelMatrix)))
+    {
+        objectsCulled++;
+        return false;
+    }
+
+    Object object;
+    object.model = &model;
+    object.modelMatrix = modelMatrix;
+
+    unsigned int objectIndex = static_cast<unsigned int>(objects.size());
+    objects.push_back(object);
+
+    // Meshlets are culled in model space, against the frustum planes of the
+    // model view projection and the camera position moved into the model
+    Frustum modelFrustum = extractFrustum(viewProjection * modelMatrix);
+    glm::vec3 modelCamera(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+
+    unsigned int lod = pixelsPerUnit > 0.0f ? model.selectLod(modelMatrix, cameraPosition, pixelsPerUnit) : 0;
+    const MeshLod &level = mesh.lods[lod];
+    for (unsigned int i = level.firstSubMesh; i < level.firstSubMesh + level.subMeshCount; i++)
+    {
+        const ModelPart &part = mesh.parts[i];
+        Item item;
+        item.material = model.material(i);
+        item.textureKey = materialTable().get(item.material).textureKey();
+        item.object = objectIndex;
+        item.part = i;
+        item.firstRange = static_cast<unsigned int>(ranges.size());
+
+        if (haveCamera && part.meshletCount > 0)
+        {
+            size_t visible = cullMeshlets(&mesh.meshlets[part.firstMeshlet], part.meshletCount,
+                                          modelFrustum, modelCamera, ranges);
+            meshletsDrawn += static_cast<unsigned int>(visible);
+            meshletsCulled += part.meshletCount - static_cast<unsigned int>(visible);
+        }
+        else
+        {
+            IndexRange range = { part.indexOffset, part.indexCount };
+            ranges.push_back(range);
+        }
+
+        item.rangeCount = static_cast<unsigned int>(ranges.size()) - item.firstRange;
+        if (item.rangeCount > 0)
+            items.push_back(item);
+    }
+
+    return true;
+}
+
+void RenderQueue::flush(unsigned int shaderID, int modelLoc)
+{
+    const MaterialTable &table = materialTable();
+    const ShaderUniforms &uniforms = shaderUniforms(shaderID);
+
+    // Model::draw sets the matrix, VAO and position decoding per object and
+    // binds every part's material, whether or not the last object used it
+    memset(&unsorted, 0, sizeof(unsorted));
+    for (const Item &item : items)
+    {
+        const Material &material = table.get(item.material);
+        unsorted.draws++;
+        unsorted.materialBinds++;
+        unsorted.textureBinds += material.textureCount();
+        unsorted.uniformCalls += material.uniformCount();
+    }
+    unsorted.uniformCalls += 3 * static_cast<unsigned int>(objects.size());
+    unsorted.vertexArrayBinds = static_cast<unsigned int>(objects.size());
+    unsorted.triangles = fullTriangles;
+    unsorted.meshlets = meshletsDrawn + meshletsCulled;
+    unsorted.objects = static_cast<unsigned int>(objects.size()) + objectsCulled;
+
+    // Group by material, then by object so parts of one model stay together.
+    // Materials sampling the same array or texture come one after another.
+    std::sort(items.begin(), items.end(), [](const Item &a, const Item &b)
+    {
+        if (a.textureKey != b.textureKey)
+            return a.textureKey < b.textureKey;
+        if (a.material != b.material)
+            return a.material < b.material;
+        if (a.object != b.object)
+            return a.object < b.object;
+        return a.part < b.part;
+    });
+
+    // Other draws since the last flush may have bound any texture
+    memset(&sorted, 0, sizeof(sorted));
+    bindings.reset();
+    unsigned int currentMaterial = ~0u;
+    unsigned int currentObject = ~0u;
+    const GpuMesh *currentMesh = NULL;
+    for (const Item &item : items)
+    {
+        const Object &object = objects[item.object];
+
+        if (item.material != currentMaterial)
+        {
+            const Material &material = table.get(item.material);
+            material.bind(uniforms, bindings);
+            currentMaterial = item.material;
+            sorted.materialBinds++;
+            sorted.uniformCalls += material.uniformCount();
+        }
+
+        if (item.object != currentObject)
+        {
+            glUniformMatrix4fv(modelLoc, 1, false, &object.modelMatrix[0][0]);
+            currentObject = item.object;
+            sorted.uniformCalls++;
+        }
+
+        // Models sharing a mesh share its vertex array
+        if (object.model->mesh.get() != currentMesh)
+        {
+            object.model->bindVertexArray(shaderID);
+            currentMesh = object.model->mesh.get();
+            sorted.vertexArrayBinds++;
+            sorted.uniformCalls += 2;
+        }
+
+        object.model->drawRanges(&ranges[item.firstRange], item.rangeCount);
+        sorted.draws++;
+        for (unsigned int i = item.firstRange; i < item.firstRange + item.rangeCount; i++)
+            sorted.triangles += ranges[i].indexCount / 3;
+    }
+    sorted.textureBinds = bindings.bindCount();
+    sorted.meshlets = meshletsDrawn;
+    sorted.meshletsCulled = meshletsCulled;
+    sorted.objects = static_cast<unsigned int>(objects.size());
+    sorted.objectsCulled = objectsCulled;
+    glBindVertexArray(0);
+
+    items.clear();
+    objects.clear();
+    ranges.clear();
+    fullTriangles = 0;
+    meshletsDrawn = 0;
+    meshletsCulled = 0;
+    objectsCulled = 0;
+}
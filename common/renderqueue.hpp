@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "model.hpp"
+#include "meshlet.hpp"
+#include "frustum.hpp"
+
+// GL state changes made while drawing a frame
+struct RenderStats
+{
+    unsigned int draws;
+    unsigned int materialBinds;
+    unsigned int textureBinds;
+    unsigned int uniformCalls;
+    unsigned int vertexArrayBinds;
+    unsigned int triangles;
+    unsigned int meshlets;          // drawn
+    unsigned int meshletsCulled;    // outside the frustum or backfacing
+    unsigned int objects;           // drawn
+    unsigned int objectsCulled;     // bounds outside the frustum
+};
+
+// Collects the model draws of a frame and issues them sorted by material,
+// so each material's uniforms and textures are set once per frame rather
+// than once per object that uses it. Materials whose first map is in the
+// same texture array are drawn together, and textures already bound are
+// not bound again.
+class RenderQueue
+{
+public:
+    RenderQueue();
+
+    // Viewpoint used to pick each model's level of detail and cull its
+    // meshlets. pixelsPerUnit is the viewport height divided by
+    // 2 tan(fovy / 2); 0 draws full detail.
+    void setCamera(const glm::vec3 &position, const glm::mat4 &viewProjection, float pixelsPerUnit);
+
+    // Queue the visible meshlets of each part of the model's level of
+    // detail. Returns false, queueing nothing, if the model's bounds are
+    // outside the frustum.
+    bool submit(Model &model, const glm::mat4 &modelMatrix);
+
+    // Draw and clear the queue
+    void flush(unsigned int shaderID, int modelLoc);
+
+    // State changes of the last flush, and what drawing the same objects one
+    // at a time in submission order with Model::draw at full detail would
+    // have made
+    const RenderStats &sortedStats() const { return sorted; }
+    const RenderStats &unsortedStats() const { return unsorted; }
+
+private:
+    struct Item
+    {
+        unsigned int textureKey;    // Material::textureKey
+        unsigned int material;
+        unsigned int object;    // index into objects
+        unsigned int part;      // index into Model::parts
+        unsigned int firstRange;
+        unsigned int rangeCount;
+    };
+
+    struct Object
+    {
+        Model *model;
+        glm::mat4 modelMatrix;
+    };
+
+    std::vector<Item> items;
+    std::vector<Object> objects;
+    std::vector<IndexRange> ranges;
+    TextureBindings bindings;
+    glm::vec3 cameraPosition;
+    glm::mat4 viewProjection;
+    Frustum frustum;
+    bool haveCamera;
+    float pixelsPerUnit;
+    unsigned int fullTriangles;
+    unsigned int meshletsDrawn;
+    unsigned int meshletsCulled;
+    unsigned int objectsCulled;
+    RenderStats sorted;
+    RenderStats unsorted;
+};
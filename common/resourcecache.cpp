@@ -0,0 +1,174 @@
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "resourcecache.hpp"
+#include "model.hpp"
+#include "fileutil.hpp"
+
+namespace
+{
+    std::atomic<bool> glContextAlive(true);
+
+    // Count the entries of a weak reference table still in use
+    template <typename Table>
+    size_t liveCount(const Table &table)
+    {
+        size_t count = 0;
+        for (const auto &entry : table)
+        {
+            if (!entry.second.expired())
+                count++;
+        }
+        return count;
+    }
+}
+
+GpuTexture::GpuTexture()
+    : id(0), owned(false), internalFormat(0), width(0), height(0), levels(0), baseLevel(0), managed(false), layer(0)
+{
+}
+
+GpuTexture::~GpuTexture()
+{
+    if (owned && id != 0 && ResourceCache::hasContext())
+        glDeleteTextures(1, &id);
+}
+
+ResourceCache::ResourceCache()
+{
+    memset(&counts, 0, sizeof(counts));
+}
+
+TextureHandle ResourceCache::acquireTexture(const char *path, uint32_t usage, uint32_t options, bool &outCreated)
+{
+    // The same image flipped or compressed for another usage is a
+    // different texture
+    std::string canonical = canonicalPath(path);
+    char settings[32];
+    snprintf(settings, sizeof(settings), "\n%u\n%u", usage, options);
+    std::string key = canonical + settings;
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<GpuTexture> &entry = texturePaths[key];
+    TextureHandle texture = entry.lock();
+    outCreated = !texture;
+    if (texture)
+    {
+        counts.textureHits++;
+        return texture;
+    }
+    
+    counts.textureMisses++;
+    texture = std::make_shared<GpuTexture>();
+    texture->path = canonical;
+    entry = texture;
+    return texture;
+}
+
+TextureHandle ResourceCache::shareTextureContents(const TextureHandle &texture, uint64_t contentHash)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<GpuTexture> &entry = textureContents[contentHash];
+    TextureHandle original = entry.lock();
+    if (original && original != texture)
+    {
+        counts.textureContentHits++;
+        return original;
+    }
+    entry = texture;
+    return TextureHandle();
+}
+
+MeshHandle ResourceCache::acquireMesh(const char *path, uint32_t options, float lodError, bool &outCreated)
+{
+    // The same file cooked differently is a different mesh
+    char settings[64];
+    snprintf(settings, sizeof(settings), "\n%u\n%.9g", options, lodError);
+    std::string key = canonicalPath(path) + settings;
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<GpuMesh> &entry = meshPaths[key];
+    MeshHandle mesh = entry.lock();
+    outCreated = !mesh;
+    if (mesh)
+    {
+        counts.meshHits++;
+        return mesh;
+    }
+    
+    counts.meshMisses++;
+    mesh = std::make_shared<GpuMesh>();
+    entry = mesh;
+    return mesh;
+}
+
+MeshHandle ResourceCache::shareMeshContents(const MeshHandle &mesh, const MeshCacheHeader &header)
+{
+    uint64_t key = hashBytes(&header.options, sizeof(header.options), header.sourceHash);
+    key = hashBytes(&header.lodError, sizeof(header.lodError), key);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<GpuMesh> &entry = meshContents[key];
+    MeshHandle original = entry.lock();
+    if (original && original != mesh)
+    {
+        counts.meshContentHits++;
+        return original;
+    }
+    entry = mesh;
+    return MeshHandle();
+}
+
+ResourceCacheStats ResourceCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counts;
+}
+
+size_t ResourceCache::textureCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return liveCount(texturePaths);
+}
+
+size_t ResourceCache::meshCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return liveCount(meshPaths);
+}
+
+std::vector<TextureHandle> ResourceCache::liveTextures() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<TextureHandle> textures;
+    for (const auto &entry : texturePaths)
+    {
+        if (TextureHandle texture = entry.second.lock())
+            textures.push_back(texture);
+    }
+    return textures;
+}
+
+void ResourceCache::contextDestroyed()
+{
+    glContextAlive = false;
+}
+
+bool ResourceCache::hasContext()
+{
+    return glContextAlive;
+}
+
+ResourceCache &resourceCache()
+{
+    static ResourceCache cache;
+    return cache;
+}
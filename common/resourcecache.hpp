@@ -0,0 +1,121 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "meshcache.hpp"
+
+// Array texture holding packed textures as layers, defined in texturearray.hpp
+struct GpuTextureArray;
+
+// GL texture shared by every material using the same image. While original
+// is set the texture draws as original instead: a placeholder until the
+// image is uploaded, or a texture already loaded from the same bytes.
+struct GpuTexture
+{
+    unsigned int id;
+    bool owned;                             // id is deleted with the texture
+    std::string path;                       // canonical path of the file
+    std::shared_ptr<GpuTexture> original;
+
+    // Storage of id for packing it into an array: GL internal format, size
+    // of level 0 and mip levels. internalFormat is 0 if it cannot be packed.
+    unsigned int internalFormat;
+    unsigned int width, height, levels;
+
+    // First level in video memory, the larger ones not loaded or evicted.
+    // Managed textures have their levels moved in and out by a
+    // TextureResidency, so are never packed.
+    unsigned int baseLevel;
+    bool managed;
+
+    // Once packed the image is layer of array and id is 0
+    std::shared_ptr<GpuTextureArray> array;
+    unsigned int layer;
+
+    GpuTexture();
+    ~GpuTexture();
+
+    unsigned int glId() const { return original ? original->glId() : id; }
+
+    // The texture drawn in place of this one, following original
+    const GpuTexture &drawn() const { return original ? original->drawn() : *this; }
+
+private:
+    GpuTexture(const GpuTexture &);
+    GpuTexture &operator=(const GpuTexture &);
+};
+
+typedef std::shared_ptr<GpuTexture> TextureHandle;
+
+// Buffers and draw ranges of a mesh, defined with Model
+struct GpuMesh;
+typedef std::shared_ptr<GpuMesh> MeshHandle;
+
+struct ResourceCacheStats
+{
+    unsigned int textureHits;           // path already loaded or loading
+    unsigned int textureMisses;         // new path, so a new texture
+    unsigned int textureContentHits;    // misses with the bytes of a loaded texture
+    unsigned int meshHits;
+    unsigned int meshMisses;
+    unsigned int meshContentHits;
+};
+
+// Textures and meshes shared by reference count, found by canonical path
+// and by content hash. The cache only holds weak references, so each
+// resource is freed with its last handle. Safe to use from any thread.
+class ResourceCache
+{
+public:
+    ResourceCache();
+
+    // Texture of the image at path cooked for a TextureUsage and
+    // TextureCacheOptions. outCreated is set when the texture is new and
+    // empty, for the caller to load.
+    TextureHandle acquireTexture(const char *path, uint32_t usage, uint32_t options, bool &outCreated);
+
+    // Record the hash of a new texture's file. Returns a live texture with
+    // the same bytes, which the new one should use as its original, or NULL.
+    TextureHandle shareTextureContents(const TextureHandle &texture, uint64_t contentHash);
+
+    // Mesh cooked from path with the mesh cache options and LOD error, with
+    // outCreated set as for textures
+    MeshHandle acquireMesh(const char *path, uint32_t options, float lodError, bool &outCreated);
+
+    // Like shareTextureContents, for a mesh cooked from a file with the
+    // same source hash, options and LOD error
+    MeshHandle shareMeshContents(const MeshHandle &mesh, const MeshCacheHeader &header);
+
+    ResourceCacheStats stats() const;
+
+    // Live resources
+    size_t textureCount() const;
+    size_t meshCount() const;
+    std::vector<TextureHandle> liveTextures() const;
+
+    // Call before the GL context is destroyed. Resources freed after that
+    // leave their GL objects to the driver, which frees them with the
+    // context.
+    static void contextDestroyed();
+    static bool hasContext();
+
+private:
+    ResourceCache(const ResourceCache &);
+    ResourceCache &operator=(const ResourceCache &);
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<GpuTexture>> texturePaths;
+    std::unordered_map<uint64_t, std::weak_ptr<GpuTexture>> textureContents;
+    std::unordered_map<std::string, std::weak_ptr<GpuMesh>> meshPaths;
+    std::unordered_map<uint64_t, std::weak_ptr<GpuMesh>> meshContents;
+    ResourceCacheStats counts;
+};
+
+// The cache shared by all models
+ResourceCache &resourceCache();
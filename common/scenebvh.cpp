@@ -0,0 +1,457 @@
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <float.h>
+
+#include <glm/glm.hpp>
+
+#include "scenebvh.hpp"
+#include "parallel.hpp"
+
+namespace
+{
+    const unsigned int binCount = 16;
+    const unsigned int maxLeafSize = 8;
+
+    // Scenes smaller than this build on one thread
+    const size_t parallelBuildThreshold = 16384;
+
+    float halfArea(const glm::vec3 &min, const glm::vec3 &max)
+    {
+        glm::vec3 extent = glm::max(max - min, glm::vec3(0.0f));
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    // Distance along the ray to where it enters the box, if it hits
+    bool rayBox(const glm::vec3 &origin, const glm::vec3 &inverseDirection,
+                const glm::vec3 &min, const glm::vec3 &max, float &outEnter)
+    {
+        glm::vec3 t1 = (min - origin) * inverseDirection;
+        glm::vec3 t2 = (max - origin) * inverseDirection;
+        glm::vec3 near = glm::min(t1, t2), far = glm::max(t1, t2);
+        float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        float exit = std::min(std::min(far.x, far.y), far.z);
+        outEnter = enter;
+        return exit >= enter;
+    }
+}
+
+SceneBvh::SceneBvh()
+{
+}
+
+bool SceneBvh::splitNode(std::vector<Node> &outNodes, unsigned int nodeIndex, unsigned int first,
+                         unsigned int count, unsigned int &outLeftCount)
+{
+    glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+    glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+    for (unsigned int i = first; i < first + count; i++)
+    {
+        const Box &box = boxes[objectIndices[i]];
+        minimum = glm::min(minimum, box.min);
+        maximum = glm::max(maximum, box.max);
+        centroidMin = glm::min(centroidMin, centroids[objectIndices[i]]);
+        centroidMax = glm::max(centroidMax, centroids[objectIndices[i]]);
+    }
+    outNodes[nodeIndex].min = minimum;
+    outNodes[nodeIndex].max = maximum;
+    outNodes[nodeIndex].first = first;
+    outNodes[nodeIndex].count = count;
+    if (count <= 2)
+        return false;
+
+    // Bin the centroids along each axis and sweep the bin boundaries for the
+    // split with the smallest area weighted object count
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    unsigned int bestBin = 0;
+    glm::vec3 centroidExtent = centroidMax - centroidMin;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (centroidExtent[axis] <= 0.0f)
+            continue;
+        float binScale = binCount / centroidExtent[axis];
+
+        Box bins[binCount];
+        unsigned int binObjects[binCount] = {};
+        for (Box &bin : bins)
+        {
+            bin.min = glm::vec3(FLT_MAX);
+            bin.max = glm::vec3(-FLT_MAX);
+        }
+        for (unsigned int i = first; i < first + count; i++)
+        {
+            unsigned int object = objectIndices[i];
+            unsigned int bin = std::min(binCount - 1, static_cast<unsigned int>((centroids[object][axis] - centroidMin[axis]) * binScale));
+            bins[bin].min = glm::min(bins[bin].min, boxes[object].min);
+            bins[bin].max = glm::max(bins[bin].max, boxes[object].max);
+            binObjects[bin]++;
+        }
+
+        // Areas and counts of everything right of each boundary
+        float rightArea[binCount];
+        unsigned int rightObjects[binCount];
+        glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+        unsigned int sweepCount = 0;
+        for (unsigned int b = binCount - 1; b > 0; b--)
+        {
+            sweepMin = glm::min(sweepMin, bins[b].min);
+            sweepMax = glm::max(sweepMax, bins[b].max);
+            sweepCount += binObjects[b];
+            rightArea[b] = halfArea(sweepMin, sweepMax);
+            rightObjects[b] = sweepCount;
+        }
+
+        sweepMin = glm::vec3(FLT_MAX);
+        sweepMax = glm::vec3(-FLT_MAX);
+        sweepCount = 0;
+        for (unsigned int b = 1; b < binCount; b++)
+        {
+            sweepMin = glm::min(sweepMin, bins[b - 1].min);
+            sweepMax = glm::max(sweepMax, bins[b - 1].max);
+            sweepCount += binObjects[b - 1];
+            if (sweepCount == 0 || rightObjects[b] == 0)
+                continue;
+            float cost = halfArea(sweepMin, sweepMax) * sweepCount + rightArea[b] * rightObjects[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    // Stay a leaf when splitting would not pay for the extra node
+    float leafCost = halfArea(minimum, maximum) * count;
+    if (count <= maxLeafSize && (bestAxis < 0 || bestCost >= leafCost))
+        return false;
+
+    unsigned int *begin = &objectIndices[first];
+    unsigned int *middle;
+    if (bestAxis >= 0)
+    {
+        float binScale = binCount / centroidExtent[bestAxis];
+        float axisMin = centroidMin[bestAxis];
+        const std::vector<glm::vec3> &objectCentroids = centroids;
+        middle = std::partition(begin, begin + count, [&](unsigned int object)
+        {
+            unsigned int bin = std::min(binCount - 1, static_cast<unsigned int>((objectCentroids[object][bestAxis] - axisMin) * binScale));
+            return bin < bestBin;
+        });
+    }
+    else
+    {
+        // Every centroid is in the same place, so any halving will do
+        middle = begin + count / 2;
+    }
+
+    outLeftCount = static_cast<unsigned int>(middle - begin);
+    if (outLeftCount == 0 || outLeftCount == count)
+        outLeftCount = count / 2;
+
+    unsigned int left = static_cast<unsigned int>(outNodes.size());
+    outNodes.resize(outNodes.size() + 2);
+    outNodes[nodeIndex].first = left;
+    outNodes[nodeIndex].count = 0;
+    return true;
+}
+
+void SceneBvh::buildSubtree(std::vector<Node> &outNodes, unsigned int nodeIndex, unsigned int first,
+                            unsigned int count)
+{
+    unsigned int leftCount;
+    if (!splitNode(outNodes, nodeIndex, first, count, leftCount))
+        return;
+    unsigned int left = outNodes[nodeIndex].first;
+    buildSubtree(outNodes, left, first, leftCount);
+    buildSubtree(outNodes, left + 1, first + leftCount, count - leftCount);
+}
+
+void SceneBvh::build(const BoundingVolume *objects, size_t objectCount, unsigned int threadCount)
+{
+    boxes.resize(objectCount);
+    centroids.resize(objectCount);
+    for (size_t i = 0; i < objectCount; i++)
+    {
+        boxes[i].min = objects[i].min;
+        boxes[i].max = objects[i].max;
+        centroids[i] = (objects[i].min + objects[i].max) * 0.5f;
+    }
+    objectIndices.resize(objectCount);
+    std::iota(objectIndices.begin(), objectIndices.end(), 0u);
+
+    nodes.clear();
+    if (objectCount == 0)
+    {
+        linkParents();
+        return;
+    }
+    nodes.reserve(objectCount / 2 * 2 + 1);
+    nodes.resize(1);
+
+    if (threadCount == 0)
+        threadCount = hardwareThreadCount();
+    if (threadCount <= 1 || objectCount < parallelBuildThreshold)
+    {
+        buildSubtree(nodes, 0, 0, static_cast<unsigned int>(objectCount));
+        linkParents();
+        return;
+    }
+
+    // Split the top of the tree on this thread until there are a few
+    // subtrees per thread, then build those independently. Each subtree
+    // owns its own range of objectIndices.
+    struct Task
+    {
+        unsigned int node;
+        unsigned int first;
+        unsigned int count;
+    };
+    std::vector<Task> pending;
+    Task root = { 0, 0, static_cast<unsigned int>(objectCount) };
+    pending.push_back(root);
+    size_t head = 0;
+    while (head < pending.size() && pending.size() - head < 4 * threadCount)
+    {
+        Task task = pending[head++];
+        unsigned int leftCount;
+        if (!splitNode(nodes, task.node, task.first, task.count, leftCount))
+            continue;
+        Task left = { nodes[task.node].first, task.first, leftCount };
+        Task right = { nodes[task.node].first + 1, task.first + leftCount, task.count - leftCount };
+        pending.push_back(left);
+        pending.push_back(right);
+    }
+    std::vector<Task> tasks(pending.begin() + head, pending.end());
+
+    std::vector<std::vector<Node> > subtrees(tasks.size());
+    std::atomic<size_t> nextTask(0);
+    runParallel(std::min<size_t>(threadCount, tasks.size()), [&](size_t)
+    {
+        for (size_t i = nextTask++; i < tasks.size(); i = nextTask++)
+        {
+            subtrees[i].resize(1);
+            buildSubtree(subtrees[i], 0, tasks[i].first, tasks[i].count);
+        }
+    });
+
+    // Splice each subtree in: its root replaces the task's node and the rest
+    // is appended, with child indices moved to where they land
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+        const std::vector<Node> &subtree = subtrees[i];
+        unsigned int base = static_cast<unsigned int>(nodes.size()) - 1;
+        for (size_t n = 0; n < subtree.size(); n++)
+        {
+            Node node = subtree[n];
+            if (node.count == 0)
+                node.first += base;
+            if (n == 0)
+                nodes[tasks[i].node] = node;
+            else
+                nodes.push_back(node);
+        }
+    }
+    linkParents();
+}
+
+void SceneBvh::linkParents()
+{
+    parents.assign(nodes.size(), ~0u);
+    objectLeaves.assign(boxes.size(), 0);
+    for (unsigned int n = 0; n < nodes.size(); n++)
+    {
+        const Node &node = nodes[n];
+        if (node.count == 0)
+        {
+            parents[node.first] = n;
+            parents[node.first + 1] = n;
+        }
+        else
+        {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+                objectLeaves[objectIndices[i]] = n;
+        }
+    }
+}
+
+void SceneBvh::fitLeaf(Node &node) const
+{
+    node.min = glm::vec3(FLT_MAX);
+    node.max = glm::vec3(-FLT_MAX);
+    for (unsigned int i = node.first; i < node.first + node.count; i++)
+    {
+        node.min = glm::min(node.min, boxes[objectIndices[i]].min);
+        node.max = glm::max(node.max, boxes[objectIndices[i]].max);
+    }
+}
+
+void SceneBvh::refit(const BoundingVolume *objects)
+{
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        boxes[i].min = objects[i].min;
+        boxes[i].max = objects[i].max;
+    }
+
+    // Children always come after their parent, so a backwards pass sees
+    // every child before the node that contains it
+    for (size_t n = nodes.size(); n-- > 0; )
+    {
+        Node &node = nodes[n];
+        if (node.count > 0)
+            fitLeaf(node);
+        else
+        {
+            node.min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+            node.max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+        }
+    }
+}
+
+void SceneBvh::refitObject(unsigned int object, const BoundingVolume &bounds)
+{
+    boxes[object].min = bounds.min;
+    boxes[object].max = bounds.max;
+
+    unsigned int n = objectLeaves[object];
+    fitLeaf(nodes[n]);
+    for (n = parents[n]; n != ~0u; n = parents[n])
+    {
+        Node &node = nodes[n];
+        glm::vec3 minimum = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+        glm::vec3 maximum = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+
+        // Nodes further up can't change either
+        if (minimum == node.min && maximum == node.max)
+            break;
+        node.min = minimum;
+        node.max = maximum;
+    }
+}
+
+void SceneBvh::cull(const Frustum &frustum, std::vector<unsigned int> &outObjects) const
+{
+    if (nodes.empty())
+        return;
+
+    // Each entry carries the planes its box still straddles; planes the box
+    // is entirely inside are dropped for its descendants
+    struct Entry
+    {
+        unsigned int node;
+        unsigned int planeMask;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    Entry root = { 0, 0x3f };
+    stack.push_back(root);
+
+    while (!stack.empty())
+    {
+        Entry entry = stack.back();
+        stack.pop_back();
+        const Node &node = nodes[entry.node];
+
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++)
+        {
+            if (!(entry.planeMask & (1u << p)))
+                continue;
+            const glm::vec4 &plane = frustum.planes[p];
+            glm::vec3 normal(plane);
+            glm::vec3 furthest(normal.x >= 0.0f ? node.max.x : node.min.x,
+                               normal.y >= 0.0f ? node.max.y : node.min.y,
+                               normal.z >= 0.0f ? node.max.z : node.min.z);
+            glm::vec3 nearest(normal.x >= 0.0f ? node.min.x : node.max.x,
+                              normal.y >= 0.0f ? node.min.y : node.max.y,
+                              normal.z >= 0.0f ? node.min.z : node.max.z);
+            if (glm::dot(normal, furthest) + plane.w < 0.0f)
+                outside = true;
+            else if (glm::dot(normal, nearest) + plane.w >= 0.0f)
+                entry.planeMask &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+
+        if (node.count == 0)
+        {
+            Entry left = { node.first, entry.planeMask };
+            Entry right = { node.first + 1, entry.planeMask };
+            stack.push_back(right);
+            stack.push_back(left);
+            continue;
+        }
+
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+        {
+            unsigned int object = objectIndices[i];
+            if (entry.planeMask == 0 || boxInFrustum(frustum, boxes[object].min, boxes[object].max))
+                outObjects.push_back(object);
+        }
+    }
+}
+
+int SceneBvh::pick(const glm::vec3 &origin, const glm::vec3 &direction, float *outDistance) const
+{
+    int hit = -1;
+    float nearest = FLT_MAX;
+    glm::vec3 inverseDirection = 1.0f / direction;
+
+    struct Entry
+    {
+        unsigned int node;
+        float enter;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    Entry root = { 0, 0.0f };
+    if (!nodes.empty() && rayBox(origin, inverseDirection, nodes[0].min, nodes[0].max, root.enter))
+        stack.push_back(root);
+
+    while (!stack.empty())
+    {
+        Entry entry = stack.back();
+        stack.pop_back();
+        if (entry.enter >= nearest)
+            continue;
+        const Node &node = nodes[entry.node];
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+                unsigned int object = objectIndices[i];
+                float enter;
+                if (rayBox(origin, inverseDirection, boxes[object].min, boxes[object].max, enter) && enter < nearest)
+                {
+                    nearest = enter;
+                    hit = static_cast<int>(object);
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so the further one is often skipped
+        Entry children[2] = { { node.first, 0.0f }, { node.first + 1, 0.0f } };
+        bool hits[2];
+        for (int c = 0; c < 2; c++)
+            hits[c] = rayBox(origin, inverseDirection, nodes[children[c].node].min, nodes[children[c].node].max,
+                             children[c].enter);
+        if (hits[0] && hits[1])
+        {
+            if (children[0].enter > children[1].enter)
+                std::swap(children[0], children[1]);
+            stack.push_back(children[1]);
+            stack.push_back(children[0]);
+        }
+        else if (hits[0] || hits[1])
+            stack.push_back(children[hits[0] ? 0 : 1]);
+    }
+
+    if (outDistance)
+        *outDistance = hit >= 0 ? nearest : 0.0f;
+    return hit;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+// Bounding volume hierarchy over the boxes of a scene's objects, used to
+// cull whole groups of objects at once and to pick objects with rays. Nodes
+// are split with a binned surface area heuristic.
+class SceneBvh
+{
+public:
+    SceneBvh();
+
+    // Build over the world bounds of objects 0 .. objectCount - 1. Large
+    // scenes build their subtrees on up to threadCount threads (0 uses
+    // every core).
+    void build(const BoundingVolume *objects, size_t objectCount, unsigned int threadCount = 0);
+
+    // Fit the node boxes to moved objects without changing the tree: every
+    // object at once, or one object along its path to the root. Either is
+    // much cheaper than a rebuild, but the tree gets looser as objects move
+    // away from where it was built.
+    void refit(const BoundingVolume *objects);
+    void refitObject(unsigned int object, const BoundingVolume &bounds);
+
+    // Append the objects whose box is at least partly inside the frustum.
+    // Nodes entirely inside skip the plane tests for everything below them.
+    void cull(const Frustum &frustum, std::vector<unsigned int> &outObjects) const;
+
+    // Nearest object whose box the ray enters, or -1. outDistance is in
+    // multiples of direction, 0 if the origin is inside the box.
+    int pick(const glm::vec3 &origin, const glm::vec3 &direction, float *outDistance = NULL) const;
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t objectCount() const { return boxes.size(); }
+
+private:
+    struct Box
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // 32 bytes; the children of an interior node are next to each other
+    struct Node
+    {
+        glm::vec3 min;
+        unsigned int first;     // left child, or first objectIndices entry of a leaf
+        glm::vec3 max;
+        unsigned int count;     // objects in a leaf, 0 for interior nodes
+    };
+
+    bool splitNode(std::vector<Node> &outNodes, unsigned int nodeIndex, unsigned int first,
+                   unsigned int count, unsigned int &outLeftCount);
+    void buildSubtree(std::vector<Node> &outNodes, unsigned int nodeIndex, unsigned int first,
+                      unsigned int count);
+    void fitLeaf(Node &node) const;
+    void linkParents();
+
+    std::vector<Node> nodes;
+    std::vector<Box> boxes;
+    std::vector<glm::vec3> centroids;
+    std::vector<unsigned int> objectIndices;    // objects in leaf order
+    std::vector<unsigned int> parents;
+    std::vector<unsigned int> objectLeaves;     // leaf holding each object
+};
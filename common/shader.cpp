@@ -1,104 +1,255 @@
-#include <stdio.h>
-#include <string>
 #include <vector>
-#include <iostream>
-#include <fstream>
-#include <algorithm>
-#include <sstream>
-using namespace std;
-
-#include <stdlib.h>
+#include <string>
+#include <chrono>
+#include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
 #include <GL/glew.h>
 
 #include "shader.hpp"
+#include "uniforms.hpp"
+#include "uniformblocks.hpp"
+#include "fileutil.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    const uint32_t programCacheMagic = 0x47504743;     // "CGPG"
+    const uint32_t programCacheVersion = 1;
+
+    struct ProgramCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binarySize;
+    };
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
-
-    // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if(VertexShaderStream.is_open()){
-        std::stringstream sstr;
-        sstr << VertexShaderStream.rdbuf();
-        VertexShaderCode = sstr.str();
-        VertexShaderStream.close();
-    }else{
-        printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-        getchar();
-        return 0;
+    // The source as compiled, with the defines after the #version line,
+    // which has to come first
+    bool readShader(const char *path, const char *defines, std::string &outSource)
+    {
+        std::vector<char> file;
+        if (!readFile(path, file))
+        {
+            printf("Impossible to open %s. Are you in the right directory?\n", path);
+            return false;
+        }
+        outSource.assign(file.data(), file.size() - 1);
+
+        if (defines && *defines)
+        {
+            size_t position = 0;
+            if (outSource.compare(0, 8, "#version") == 0)
+            {
+                position = outSource.find('\n');
+                position = position == std::string::npos ? outSource.size() : position + 1;
+            }
+            outSource.insert(position, std::string(defines) + "\n");
+        }
+        return true;
+    }
+
+    bool compileShader(GLuint shaderID, const char *path, const std::string &source)
+    {
+        const char *pointer = source.c_str();
+        glShaderSource(shaderID, 1, &pointer, NULL);
+
+        // Drivers may compile lazily, so the span ends once the status is known
+        GLint result = GL_FALSE;
+        {
+            TRACE_SCOPE("glCompileShader", path);
+            glCompileShader(shaderID);
+            glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
+        }
+        if (result == GL_TRUE)
+            return true;
+
+        GLint logLength = 0;
+        glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &logLength);
+        std::vector<char> log(logLength + 1, '\0');
+        if (logLength > 0)
+            glGetShaderInfoLog(shaderID, logLength, NULL, log.data());
+        printf("Compiling shader %s failed:\n%s\n", path, log.data());
+        return false;
+    }
+
+    bool linkStatus(GLuint programID)
+    {
+        GLint result = GL_FALSE;
+        glGetProgramiv(programID, GL_LINK_STATUS, &result);
+        return result == GL_TRUE;
+    }
+
+    void printLinkLog(GLuint programID)
+    {
+        GLint logLength = 0;
+        glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &logLength);
+        std::vector<char> log(logLength + 1, '\0');
+        if (logLength > 0)
+            glGetProgramInfoLog(programID, logLength, NULL, log.data());
+        printf("Linking program failed:\n%s\n", log.data());
+    }
+
+    // Drivers may support the extension and still offer no binary formats
+    bool programBinariesSupported()
+    {
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+            return false;
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
     }
 
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if(FragmentShaderStream.is_open()){
-        std::stringstream sstr;
-        sstr << FragmentShaderStream.rdbuf();
-        FragmentShaderCode = sstr.str();
-        FragmentShaderStream.close();
+    // Binaries only load into the driver that made them
+    uint64_t programKey(const std::string &vertexSource, const std::string &fragmentSource, const char *defines)
+    {
+        uint64_t key = hashBytes(&programCacheVersion, sizeof(programCacheVersion));
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : strings)
+        {
+            const char *value = reinterpret_cast<const char *>(glGetString(name));
+            if (value)
+                key = hashBytes(value, strlen(value) + 1, key);
+        }
+        if (defines)
+            key = hashBytes(defines, strlen(defines) + 1, key);
+        key = hashBytes(vertexSource.data(), vertexSource.size() + 1, key);
+        return hashBytes(fragmentSource.data(), fragmentSource.size() + 1, key);
     }
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
-
-    // Compile Vertex Shader
-    printf("Compiling shader : %s\n", vertex_file_path);
-    char const * VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-    glCompileShader(VertexShaderID);
-
-    // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-        std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-        printf("%s\n", &VertexShaderErrorMessage[0]);
+    // Programs sharing a fragment shader but built with another vertex
+    // shader or defines get files of their own. The sources are left out of
+    // the name, so an edited shader replaces its old binary.
+    std::string programCachePath(const char *vertexPath, const char *fragmentPath, const char *defines)
+    {
+        uint64_t hash = hashBytes(vertexPath, strlen(vertexPath) + 1);
+        if (defines)
+            hash = hashBytes(defines, strlen(defines) + 1, hash);
+        char name[32];
+        snprintf(name, sizeof(name), ".%016llx.glprogram", static_cast<unsigned long long>(hash));
+        return fragmentPath + std::string(name);
     }
 
-    // Compile Fragment Shader
-    printf("Compiling shader : %s\n", fragment_file_path);
-    char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-    glCompileShader(FragmentShaderID);
-
-    // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-        std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-        printf("%s\n", &FragmentShaderErrorMessage[0]);
+    // False if there is no binary for the key or the driver rejects it
+    bool loadProgramBinary(GLuint programID, const std::string &cachePath, uint64_t key)
+    {
+        TRACE_SCOPE("glProgramBinary", cachePath);
+        MappedFile file;
+        if (!file.open(cachePath.c_str()) || file.size() < sizeof(ProgramCacheHeader))
+            return false;
+
+        ProgramCacheHeader header;
+        memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != programCacheMagic || header.version != programCacheVersion || header.key != key ||
+            header.binarySize != file.size() - sizeof(header))
+            return false;
+
+        glProgramBinary(programID, header.binaryFormat, file.data() + sizeof(header),
+                        static_cast<GLsizei>(header.binarySize));
+        if (linkStatus(programID))
+            return true;
+        printf("Program cache %s was rejected by the driver, compiling from source\n", cachePath.c_str());
+        return false;
     }
 
-    // Link the program
-    printf("Linking program\n");
+    void saveProgramBinary(GLuint programID, const std::string &cachePath, uint64_t key)
+    {
+        GLint length = 0;
+        glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<unsigned char> cache(sizeof(ProgramCacheHeader) + length);
+        GLsizei written = 0;
+        GLenum format = 0;
+        glGetProgramBinary(programID, length, &written, &format, cache.data() + sizeof(ProgramCacheHeader));
+
+        ProgramCacheHeader header;
+        header.magic = programCacheMagic;
+        header.version = programCacheVersion;
+        header.key = key;
+        header.binaryFormat = format;
+        header.binarySize = static_cast<uint32_t>(written);
+        memcpy(cache.data(), &header, sizeof(header));
+        if (!writeFileAtomic(cachePath.c_str(), cache.data(), sizeof(header) + written))
+            printf("Could not write program cache %s\n", cachePath.c_str());
+    }
+}
+
+unsigned int LoadShaders(const char *vertex_file_path, const char *fragment_file_path, const char *defines)
+{
+    TRACE_SCOPE("LoadShaders");
+    auto start = std::chrono::steady_clock::now();
+
+    std::string vertexSource, fragmentSource;
+    if (!readShader(vertex_file_path, defines, vertexSource) ||
+        !readShader(fragment_file_path, defines, fragmentSource))
+        return 0;
+
     GLuint ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, FragmentShaderID);
-    glLinkProgram(ProgramID);
-
-    // Check the program
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-        std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-        printf("%s\n", &ProgramErrorMessage[0]);
+    bool binaries = programBinariesSupported();
+    uint64_t key = programKey(vertexSource, fragmentSource, defines);
+    std::string cachePath = programCachePath(vertex_file_path, fragment_file_path, defines);
+
+    bool linked = binaries && loadProgramBinary(ProgramID, cachePath, key);
+    if (linked)
+    {
+        printf("Loaded program %s + %s from its binary cache in %.2f ms\n", vertex_file_path, fragment_file_path,
+               millisecondsSince(start));
+    }
+    else
+    {
+        // Compile and link from source
+        auto compileStart = std::chrono::steady_clock::now();
+        GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+        GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+        bool compiled = compileShader(VertexShaderID, vertex_file_path, vertexSource);
+        compiled = compileShader(FragmentShaderID, fragment_file_path, fragmentSource) && compiled;
+        double compileTime = millisecondsSince(compileStart);
+
+        auto linkStart = std::chrono::steady_clock::now();
+        glAttachShader(ProgramID, VertexShaderID);
+        glAttachShader(ProgramID, FragmentShaderID);
+        if (binaries)
+            glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        {
+            TRACE_SCOPE("glLinkProgram");
+            glLinkProgram(ProgramID);
+            linked = linkStatus(ProgramID);
+        }
+        double linkTime = millisecondsSince(linkStart);
+        if (compiled && !linked)
+            printLinkLog(ProgramID);
+
+        glDetachShader(ProgramID, VertexShaderID);
+        glDetachShader(ProgramID, FragmentShaderID);
+        glDeleteShader(VertexShaderID);
+        glDeleteShader(FragmentShaderID);
+
+        if (linked)
+        {
+            printf("Compiled program %s + %s in %.2f ms (compile %.2f ms, link %.2f ms)\n", vertex_file_path,
+                   fragment_file_path, millisecondsSince(start), compileTime, linkTime);
+            if (binaries)
+                saveProgramBinary(ProgramID, cachePath, key);
+        }
     }
 
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
-    
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
+    // Attach the shared uniform blocks, and enumerate the active uniforms
+    // once for the draw code to set them by resolved location
+    if (linked)
+    {
+        bindUniformBlocks(ProgramID);
+        uniformTable(ProgramID);
+    }
 
     return ProgramID;
 }
-
@@ -0,0 +1,413 @@
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <string.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "simplify.hpp"
+
+namespace
+{
+    // Sum of squared distances to a set of planes, as a symmetric 4x4 matrix.
+    // Planes are unweighted, so the error is a squared distance that bounds
+    // the distance to every plane in the set.
+    struct Quadric
+    {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+
+        Quadric()
+        {
+            memset(this, 0, sizeof(*this));
+        }
+
+        void addPlane(const glm::vec3 &normal, float distance)
+        {
+            double x = normal.x, y = normal.y, z = normal.z, d = distance;
+            a00 += x * x; a01 += x * y; a02 += x * z;
+            a11 += y * y; a12 += y * z; a22 += z * z;
+            b0 += x * d; b1 += y * d; b2 += z * d;
+            c += d * d;
+        }
+
+        void add(const Quadric &other)
+        {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02;
+            a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+        }
+
+        double error(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + a11 * y * y + a22 * z * z +
+                            2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                            2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return result > 0.0 ? result : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        unsigned int from;      // position vertex that moves
+        unsigned int to;        // position vertex it moves onto
+        double error;
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3 &p) const
+        {
+            unsigned int bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+}
+
+size_t simplifyMesh(unsigned int *outIndices, const unsigned int *indices, size_t indexCount,
+                    const glm::vec3 *positions, size_t vertexCount,
+                    size_t targetIndexCount, float maxError, float *outError)
+{
+    size_t triangleCount = indexCount / 3;
+    std::vector<unsigned int> corners(indices, indices + triangleCount * 3);
+    double maxCollapseError = 0.0;
+
+    // Vertices that differ only in uv or normal share a position vertex,
+    // which is what the topology and quadrics are built on
+    std::vector<unsigned int> positionOf(vertexCount);
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> positionIds;
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        auto inserted = positionIds.insert(std::make_pair(positions[v], static_cast<unsigned int>(v)));
+        positionOf[v] = inserted.first->second;
+    }
+
+    // Each position's quadric holds the planes of the triangles around it
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3 &a = positions[corners[t * 3]];
+        const glm::vec3 &b = positions[corners[t * 3 + 1]];
+        const glm::vec3 &c = positions[corners[t * 3 + 2]];
+        glm::vec3 cross = glm::cross(b - a, c - a);
+        float length = glm::length(cross);
+        if (length == 0.0f)
+            continue;
+        glm::vec3 normal = cross / length;
+        for (int k = 0; k < 3; k++)
+            quadrics[positionOf[corners[t * 3 + k]]].addPlane(normal, -glm::dot(normal, a));
+    }
+
+    // Positions on an open border or a non-manifold edge never move. An edge
+    // is manifold when it is used exactly once in each direction.
+    std::vector<char> locked(vertexCount, 0);
+    {
+        std::unordered_map<unsigned long long, int> edges;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned long long a = positionOf[corners[t * 3 + k]];
+                unsigned long long b = positionOf[corners[t * 3 + (k + 1) % 3]];
+                edges[(a << 32) | b]++;
+            }
+        }
+        for (const auto &edge : edges)
+        {
+            unsigned long long reverse = (edge.first << 32) | (edge.first >> 32);
+            auto found = edges.find(reverse);
+            if (edge.second != 1 || found == edges.end() || found->second != 1)
+            {
+                locked[edge.first >> 32] = 1;
+                locked[edge.first & 0xffffffffu] = 1;
+            }
+        }
+    }
+
+    double errorLimit = static_cast<double>(maxError) * maxError;
+    std::vector<char> dead(triangleCount, 0);
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<char> touched(vertexCount);
+    std::vector<Collapse> collapses;
+    std::vector<std::pair<unsigned int, unsigned int> > vertexMap;
+    size_t liveTriangles = triangleCount;
+
+    while (liveTriangles * 3 > targetIndexCount)
+    {
+        // Triangles around each position vertex
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (!dead[t])
+            {
+                for (int k = 0; k < 3; k++)
+                    adjacencyOffsets[positionOf[corners[t * 3 + k]] + 1]++;
+            }
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(adjacencyOffsets[vertexCount]);
+        std::vector<unsigned int> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (!dead[t])
+            {
+                for (int k = 0; k < 3; k++)
+                    adjacency[cursor[positionOf[corners[t * 3 + k]]]++] = static_cast<unsigned int>(t);
+            }
+        }
+
+        // Every edge, in both directions, that is within the error limit
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (dead[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = positionOf[corners[t * 3 + k]];
+                unsigned int b = positionOf[corners[t * 3 + (k + 1) % 3]];
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    unsigned int from = direction ? b : a, to = direction ? a : b;
+                    if (locked[from])
+                        continue;
+                    Quadric combined = quadrics[from];
+                    combined.add(quadrics[to]);
+                    Collapse collapse = { from, to, combined.error(positions[to]) };
+                    if (collapse.error <= errorLimit)
+                        collapses.push_back(collapse);
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b)
+        {
+            return a.error < b.error;
+        });
+
+        // Apply the cheapest collapses; a vertex whose triangles changed this
+        // pass waits for the adjacency to be rebuilt
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t applied = 0;
+        for (const Collapse &collapse : collapses)
+        {
+            if (liveTriangles * 3 <= targetIndexCount)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            const unsigned int *around = &adjacency[adjacencyOffsets[collapse.from]];
+            size_t aroundCount = adjacencyOffsets[collapse.from + 1] - adjacencyOffsets[collapse.from];
+
+            // Triangles on the collapsing edge say which of the target's
+            // vertices each of the moving vertex's vertices becomes
+            vertexMap.clear();
+            bool valid = true;
+            for (size_t i = 0; i < aroundCount && valid; i++)
+            {
+                const unsigned int *triangle = &corners[around[i] * 3];
+                unsigned int fromVertex = 0, toVertex = 0;
+                bool hasTo = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    if (positionOf[triangle[k]] == collapse.from)
+                        fromVertex = triangle[k];
+                    else if (positionOf[triangle[k]] == collapse.to)
+                    {
+                        toVertex = triangle[k];
+                        hasTo = true;
+                    }
+                }
+                if (!hasTo)
+                    continue;
+
+                bool known = false;
+                for (const auto &mapping : vertexMap)
+                {
+                    if (mapping.first == fromVertex)
+                    {
+                        known = true;
+                        valid = mapping.second == toVertex;
+                    }
+                }
+                if (!known)
+                    vertexMap.push_back(std::make_pair(fromVertex, toVertex));
+            }
+
+            // Every other triangle must have a vertex to move to, and must
+            // not flip over or collapse to a sliver
+            for (size_t i = 0; i < aroundCount && valid; i++)
+            {
+                const unsigned int *triangle = &corners[around[i] * 3];
+                glm::vec3 before[3], after[3];
+                bool hasTo = false, mapped = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    before[k] = after[k] = positions[triangle[k]];
+                    if (positionOf[triangle[k]] == collapse.to)
+                        hasTo = true;
+                    if (positionOf[triangle[k]] == collapse.from)
+                    {
+                        after[k] = positions[collapse.to];
+                        for (const auto &mapping : vertexMap)
+                            mapped = mapped || mapping.first == triangle[k];
+                    }
+                }
+                if (hasTo)
+                    continue;
+                if (!mapped)
+                {
+                    valid = false;
+                    break;
+                }
+
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                float lengths = glm::length(normalBefore) * glm::length(normalAfter);
+                valid = lengths > 0.0f && glm::dot(normalBefore, normalAfter) > 0.25f * lengths;
+            }
+            if (!valid)
+                continue;
+
+            // Apply: triangles on the edge disappear, the rest move over
+            for (size_t i = 0; i < aroundCount; i++)
+            {
+                unsigned int t = around[i];
+                unsigned int *triangle = &corners[t * 3];
+                bool hasTo = false;
+                for (int k = 0; k < 3; k++)
+                    hasTo = hasTo || positionOf[triangle[k]] == collapse.to;
+
+                for (int k = 0; k < 3; k++)
+                    touched[positionOf[triangle[k]]] = 1;
+
+                if (hasTo)
+                {
+                    dead[t] = 1;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    if (positionOf[triangle[k]] != collapse.from)
+                        continue;
+                    for (const auto &mapping : vertexMap)
+                    {
+                        if (mapping.first == triangle[k])
+                        {
+                            triangle[k] = mapping.second;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            maxCollapseError = std::max(maxCollapseError, collapse.error);
+            applied++;
+        }
+
+        if (applied == 0)
+            break;
+    }
+
+    size_t outCount = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (dead[t])
+            continue;
+        for (int k = 0; k < 3; k++)
+            outIndices[outCount++] = corners[t * 3 + k];
+    }
+
+    if (outError)
+        *outError = static_cast<float>(sqrt(maxCollapseError));
+    return outCount;
+}
+
+void generateLods(MeshData &mesh, float errorBudget, unsigned int maxLods)
+{
+    mesh.lods.clear();
+    MeshLod full = { 0, static_cast<unsigned int>(mesh.subMeshes.size()), 0.0f };
+    mesh.lods.push_back(full);
+    if (errorBudget <= 0.0f || mesh.vertices.empty())
+        return;
+
+    // The budget is relative to the size of the mesh
+    glm::vec3 minimum = mesh.vertices[0], maximum = mesh.vertices[0];
+    for (const glm::vec3 &position : mesh.vertices)
+    {
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    float levelBudget = errorBudget * 0.5f * glm::length(maximum - minimum);
+
+    size_t fullIndexCount = 0;
+    for (const SubMesh &subMesh : mesh.subMeshes)
+        fullIndexCount += subMesh.indexCount;
+    size_t previousIndexCount = fullIndexCount;
+    float previousError = 0.0f;
+    size_t subMeshCount = mesh.subMeshes.size();
+
+    std::vector<unsigned int> simplified;
+    for (unsigned int level = 1; level < maxLods; level++, levelBudget *= 2.0f)
+    {
+        // Each level halves the one before, and its error on top of the
+        // previous level's must stay within a budget that doubles per level
+        size_t previousSubMesh = mesh.lods.back().firstSubMesh;
+        std::vector<SubMesh> levelSubMeshes;
+        std::vector<unsigned int> levelIndices;
+        size_t levelIndexCount = 0;
+        float levelError = previousError;
+        for (size_t i = 0; i < subMeshCount; i++)
+        {
+            SubMesh subMesh = mesh.subMeshes[previousSubMesh + i];
+            size_t target = (subMesh.indexCount / 3 / 2) * 3;
+
+            simplified.resize(subMesh.indexCount);
+            float error = 0.0f;
+            size_t count = simplifyMesh(simplified.data(), &mesh.indices[subMesh.indexOffset], subMesh.indexCount,
+                                        mesh.vertices.data(), mesh.vertices.size(), target,
+                                        levelBudget - previousError, &error);
+
+            subMesh.indexOffset = static_cast<unsigned int>(mesh.indices.size() + levelIndices.size());
+            subMesh.indexCount = static_cast<unsigned int>(count);
+            levelSubMeshes.push_back(subMesh);
+            levelIndices.insert(levelIndices.end(), simplified.begin(), simplified.begin() + count);
+            levelIndexCount += count;
+            levelError = std::max(levelError, previousError + error);
+        }
+
+        // Stop once a level saves too little to be worth drawing
+        if (levelIndexCount == 0 || levelIndexCount > previousIndexCount * 3 / 4)
+            break;
+
+        MeshLod lod = { static_cast<unsigned int>(mesh.subMeshes.size()),
+                        static_cast<unsigned int>(subMeshCount), levelError };
+        mesh.lods.push_back(lod);
+        mesh.subMeshes.insert(mesh.subMeshes.end(), levelSubMeshes.begin(), levelSubMeshes.end());
+        mesh.indices.insert(mesh.indices.end(), levelIndices.begin(), levelIndices.end());
+        previousIndexCount = levelIndexCount;
+        previousError = levelError;
+    }
+}
+
+unsigned int selectLod(const MeshLod *lods, size_t lodCount, float scale, float distance,
+                       float pixelsPerUnit, float pixelThreshold)
+{
+    distance = std::max(distance, 1e-6f);
+    unsigned int selected = 0;
+    for (size_t i = 1; i < lodCount; i++)
+    {
+        float pixels = lods[i].error * scale * pixelsPerUnit / distance;
+        if (pixels <= pixelThreshold)
+            selected = static_cast<unsigned int>(i);
+    }
+    return selected;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+
+// Simplify a triangle list towards targetIndexCount indices by collapsing
+// edges in order of their quadric error (Garland and Heckbert), stopping
+// early rather than moving the surface further than maxError model units.
+// Vertices only ever collapse onto other existing vertices, so the result
+// indexes the same vertex buffer. Open borders are kept in place, and a
+// vertex split by a uv or normal seam may only collapse along the seam.
+// Writes up to indexCount indices to outIndices and returns how many, with
+// the largest error of any collapse in outError.
+size_t simplifyMesh(unsigned int *outIndices, const unsigned int *indices, size_t indexCount,
+                    const glm::vec3 *positions, size_t vertexCount,
+                    size_t targetIndexCount, float maxError, float *outError = NULL);
+
+// Add up to maxLods - 1 coarser levels to a mesh, each simplified from the
+// one before to about half its triangles. errorBudget is the largest error
+// of the first level, as a fraction of the mesh's bounding radius, and the
+// budget doubles with every level after it, so errors grow with the level.
+// A level's error includes the error of the levels it was built from. The
+// chain ends when a level saves less than a quarter of the triangles.
+void generateLods(MeshData &mesh, float errorBudget, unsigned int maxLods = 5);
+
+// Index of the coarsest level whose error, seen from distance, covers at
+// most pixelThreshold pixels. scale is the model matrix scale and
+// pixelsPerUnit the screen height divided by 2 tan(fovy / 2).
+unsigned int selectLod(const MeshLod *lods, size_t lodCount, float scale, float distance,
+                       float pixelsPerUnit, float pixelThreshold = 1.0f);
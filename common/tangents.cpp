@@ -0,0 +1,157 @@
+#include <vector>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "tangents.hpp"
+#include "parallel.hpp"
+
+namespace
+{
+    // Work below this many items is not worth a thread
+    const size_t minItemsPerThread = 4096;
+
+    struct FaceTangent
+    {
+        glm::vec3 tangent;      // unit length, zero if the uvs are degenerate
+        bool preserving;        // uv winding matches the triangle's
+    };
+
+    glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3(0.0f);
+    }
+
+    // Component of v in the plane with the given unit normal
+    glm::vec3 projectToPlane(const glm::vec3 &v, const glm::vec3 &normal)
+    {
+        return v - normal * glm::dot(normal, v);
+    }
+
+    // Any unit vector perpendicular to normal, for vertices without a usable
+    // uv mapping
+    glm::vec3 perpendicular(const glm::vec3 &normal)
+    {
+        glm::vec3 axis = fabsf(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 tangent = safeNormalize(projectToPlane(axis, normal));
+        return tangent == glm::vec3(0.0f) ? axis : tangent;
+    }
+}
+
+void generateTangents(MeshData &mesh, unsigned int threadCount)
+{
+    size_t vertexCount = mesh.vertices.size();
+    size_t triangleCount = mesh.indices.size() / 3;
+    const std::vector<unsigned int> &indices = mesh.indices;
+
+    if (mesh.uvs.size() != vertexCount || mesh.normals.size() != vertexCount)
+    {
+        mesh.tangents.assign(vertexCount, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+        return;
+    }
+
+    // Direction of increasing u across each face
+    std::vector<FaceTangent> faces(triangleCount);
+    parallelFor(triangleCount, minItemsPerThread, threadCount, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; t++)
+        {
+            unsigned int a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+            glm::vec3 edge1 = mesh.vertices[b] - mesh.vertices[a];
+            glm::vec3 edge2 = mesh.vertices[c] - mesh.vertices[a];
+            glm::vec2 uvEdge1 = mesh.uvs[b] - mesh.uvs[a];
+            glm::vec2 uvEdge2 = mesh.uvs[c] - mesh.uvs[a];
+
+            float signedArea = uvEdge1.x * uvEdge2.y - uvEdge1.y * uvEdge2.x;
+            faces[t].preserving = signedArea > 0.0f;
+            faces[t].tangent = glm::vec3(0.0f);
+            if (signedArea != 0.0f)
+            {
+                glm::vec3 tangent = edge1 * uvEdge2.y - edge2 * uvEdge1.y;
+                faces[t].tangent = safeNormalize(tangent) * (signedArea > 0.0f ? 1.0f : -1.0f);
+            }
+        }
+    });
+
+    // Corners using each vertex
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> corners(triangleCount * 3);
+    std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        corners[cursor[indices[i]]++] = static_cast<unsigned int>(i);
+
+    // Angle weighted sums of the projected face tangents around each vertex,
+    // kept apart for faces with preserved and mirrored uvs
+    std::vector<glm::vec3> preservedSum(vertexCount), mirroredSum(vertexCount);
+    parallelFor(vertexCount, minItemsPerThread, threadCount, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            glm::vec3 normal = safeNormalize(mesh.normals[v]);
+            glm::vec3 preserved(0.0f), mirrored(0.0f);
+
+            for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+            {
+                unsigned int corner = corners[i];
+                const FaceTangent &face = faces[corner / 3];
+                glm::vec3 tangent = safeNormalize(projectToPlane(face.tangent, normal));
+                if (tangent == glm::vec3(0.0f))
+                    continue;
+
+                // Angle of the face at this corner, measured in the tangent plane
+                size_t first = corner - corner % 3;
+                glm::vec3 position = mesh.vertices[v];
+                glm::vec3 next = mesh.vertices[indices[first + (corner + 1) % 3]];
+                glm::vec3 previous = mesh.vertices[indices[first + (corner + 2) % 3]];
+                glm::vec3 toNext = safeNormalize(projectToPlane(next - position, normal));
+                glm::vec3 toPrevious = safeNormalize(projectToPlane(previous - position, normal));
+                float angle = acosf(glm::clamp(glm::dot(toNext, toPrevious), -1.0f, 1.0f));
+
+                if (face.preserving)
+                    preserved += tangent * angle;
+                else
+                    mirrored += tangent * angle;
+            }
+
+            preservedSum[v] = preserved;
+            mirroredSum[v] = mirrored;
+        }
+    });
+
+    // Vertices where mirrored and preserved faces meet are split, the
+    // mirrored faces moving to a copy of the vertex
+    mesh.tangents.resize(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        glm::vec3 preserved = safeNormalize(preservedSum[v]);
+        glm::vec3 mirrored = safeNormalize(mirroredSum[v]);
+
+        if (preserved != glm::vec3(0.0f) && mirrored != glm::vec3(0.0f))
+        {
+            unsigned int copy = static_cast<unsigned int>(mesh.vertices.size());
+            mesh.vertices.push_back(mesh.vertices[v]);
+            mesh.uvs.push_back(mesh.uvs[v]);
+            mesh.normals.push_back(mesh.normals[v]);
+            mesh.tangents.push_back(glm::vec4(mirrored, -1.0f));
+
+            for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+            {
+                const FaceTangent &face = faces[corners[i] / 3];
+                if (!face.preserving && face.tangent != glm::vec3(0.0f))
+                    mesh.indices[corners[i]] = copy;
+            }
+            mesh.tangents[v] = glm::vec4(preserved, 1.0f);
+        }
+        else if (mirrored != glm::vec3(0.0f))
+            mesh.tangents[v] = glm::vec4(mirrored, -1.0f);
+        else if (preserved != glm::vec3(0.0f))
+            mesh.tangents[v] = glm::vec4(preserved, 1.0f);
+        else
+            mesh.tangents[v] = glm::vec4(perpendicular(safeNormalize(mesh.normals[v])), 1.0f);
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "objloader.hpp"
+
+// Generate a MikkTSpace style tangent for every vertex of a mesh. Each
+// face's uv tangent is projected into the plane of the vertex normal and
+// averaged weighted by the face's angle at the vertex. Faces whose uvs are
+// mirrored are averaged separately, splitting the vertex where both kinds
+// meet, and set the sign in w so the bitangent is w * cross(normal, tangent).
+// Work is spread over up to threadCount threads (0 uses every core).
+void generateTangents(MeshData &mesh, unsigned int threadCount = 0);
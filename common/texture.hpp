@@ -1,7 +1,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <common/stb_image.hpp>
+#include <common/mipmap.hpp>
 
-unsigned int loadTexture(const char *path)
+// mipContent says how the mip levels, filtered on the CPU, average the image
+unsigned int loadTexture(const char *path, bool flipVertically = true, uint32_t mipContent = MIP_CONTENT_SRGB)
 {
     // Create and bind texture
     unsigned int textureID;
@@ -10,23 +12,25 @@ unsigned int loadTexture(const char *path)
     
     // Load texture image from file
     int width, height, nChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load(path, &width, &height, &nChannels, 0);
+    // Per thread, so other loads keep their own setting
+    stbi_set_flip_vertically_on_load_thread(flipVertically);
+    unsigned char *data = stbi_load(path, &width, &height, &nChannels, 4);
     
     if (data)
     {
-        // Deal with different number of colour channels
-        GLenum format;
-        if (nChannels == 1)
-            format = GL_RED;
-        else if (nChannels == 3)
-            format = GL_RGB;
-        else if (nChannels == 4)
-            format = GL_RGBA;
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
+        // Upload every level, each filtered down from the one before
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
                      GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        std::vector<unsigned char> level(data, data + width * height * 4), next;
+        for (int i = 1; width > 1 || height > 1; i++)
+        {
+            downsampleImage(level.data(), width, height, mipContent, MIP_FILTER_KAISER, next);
+            level.swap(next);
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, width, height, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, level.data());
+        }
         
         // Set texture wrapping options
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -0,0 +1,152 @@
+#include <vector>
+#include <map>
+#include <tuple>
+#include <memory>
+#include <algorithm>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "texturearray.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    bool isCompressed(GLenum internalFormat)
+    {
+        return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+               internalFormat == GL_COMPRESSED_RG_RGTC2 || internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+
+    // Bytes of one level: 4x4 blocks of 8 bytes for BC1 and 16 for the
+    // other block formats, or RGBA8 texels
+    size_t levelBytes(GLenum internalFormat, unsigned int width, unsigned int height)
+    {
+        if (!isCompressed(internalFormat))
+            return static_cast<size_t>(width) * height * 4;
+        size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+        return blocks * (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16);
+    }
+}
+
+GpuTextureArray::GpuTextureArray()
+    : id(0), layerCount(0)
+{
+}
+
+GpuTextureArray::~GpuTextureArray()
+{
+    if (id != 0 && ResourceCache::hasContext())
+        glDeleteTextures(1, &id);
+}
+
+TexturePackStats packTextureArrays(const std::vector<TextureHandle> &textures)
+{
+    TRACE_SCOPE("packTextureArrays");
+    TexturePackStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    typedef std::tuple<unsigned int, unsigned int, unsigned int, unsigned int> StorageKey;
+    std::map<StorageKey, std::vector<GpuTexture *>> groups;
+    for (const TextureHandle &texture : textures)
+    {
+        if (!texture || texture->original || texture->array || texture->managed || texture->id == 0 ||
+            texture->internalFormat == 0)
+            continue;
+        groups[StorageKey(texture->internalFormat, texture->width, texture->height, texture->levels)]
+            .push_back(texture.get());
+    }
+
+    GLuint buffer = 0;
+    size_t bufferSize = 0;
+    for (auto &group : groups)
+    {
+        std::vector<GpuTexture *> &members = group.second;
+        if (members.size() < 2)
+        {
+            stats.unpacked += static_cast<unsigned int>(members.size());
+            continue;
+        }
+
+        const GpuTexture &first = *members[0];
+        GLenum internalFormat = first.internalFormat;
+        bool compressed = isCompressed(internalFormat);
+        GLsizei layers = static_cast<GLsizei>(members.size());
+
+        std::shared_ptr<GpuTextureArray> array = std::make_shared<GpuTextureArray>();
+        array->layerCount = static_cast<unsigned int>(layers);
+        glGenTextures(1, &array->id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+        for (unsigned int level = 0; level < first.levels; level++)
+        {
+            unsigned int width = std::max(1u, first.width >> level), height = std::max(1u, first.height >> level);
+            if (compressed)
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, width, height, layers, 0,
+                                       static_cast<GLsizei>(levelBytes(internalFormat, width, height) * layers), NULL);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, width, height, layers, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(first.levels) - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // The largest level sizes the buffer each level passes through
+        size_t largest = levelBytes(internalFormat, first.width, first.height);
+        if (largest > bufferSize)
+        {
+            if (buffer == 0)
+                glGenBuffers(1, &buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, largest, NULL, GL_STREAM_COPY);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            bufferSize = largest;
+        }
+
+        // Read each level into the buffer and write it to the layer from
+        // there, so the pixels never come back to the CPU
+        for (GLint layer = 0; layer < layers; layer++)
+        {
+            GpuTexture &texture = *members[layer];
+            for (unsigned int level = 0; level < first.levels; level++)
+            {
+                unsigned int width = std::max(1u, first.width >> level), height = std::max(1u, first.height >> level);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+                glBindTexture(GL_TEXTURE_2D, texture.id);
+                if (compressed)
+                    glGetCompressedTexImage(GL_TEXTURE_2D, level, NULL);
+                else
+                    glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+                if (compressed)
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, internalFormat,
+                                              static_cast<GLsizei>(levelBytes(internalFormat, width, height)), NULL);
+                else
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1,
+                                    GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            if (texture.owned)
+                glDeleteTextures(1, &texture.id);
+            texture.id = 0;
+            texture.owned = false;
+            texture.array = array;
+            texture.layer = static_cast<unsigned int>(layer);
+        }
+
+        stats.arrays++;
+        stats.packed += static_cast<unsigned int>(layers);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    if (buffer != 0)
+        glDeleteBuffers(1, &buffer);
+    return stats;
+}
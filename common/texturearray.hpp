@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "resourcecache.hpp"
+
+// GL_TEXTURE_2D_ARRAY whose layers are the images of textures with the same
+// format, size and mip count. Materials sample it with a layer index, so
+// drawing materials whose maps share arrays binds no textures in between.
+struct GpuTextureArray
+{
+    unsigned int id;
+    unsigned int layerCount;
+
+    GpuTextureArray();
+    ~GpuTextureArray();
+
+private:
+    GpuTextureArray(const GpuTextureArray &);
+    GpuTextureArray &operator=(const GpuTextureArray &);
+};
+
+struct TexturePackStats
+{
+    unsigned int arrays;        // made by this pack
+    unsigned int packed;        // textures moved into them
+    unsigned int unpacked;      // loaded textures with nothing to share an array with
+};
+
+// Move every loaded texture that has the format, size and mip count of
+// another into the layers of one array per group, freeing its 2D texture.
+// The levels are copied on the GPU through a pixel buffer. Textures still
+// loading, standing in for another, already packed or managed by a
+// TextureResidency are left alone.
+TexturePackStats packTextureArrays(const std::vector<TextureHandle> &textures);
@@ -0,0 +1,217 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+#include "texturecache.hpp"
+#include "bcn.hpp"
+#include "mipmap.hpp"
+#include "fileutil.hpp"
+#include "trace.hpp"
+#include "stb_image.hpp"
+
+namespace
+{
+    const char sourceKey[] = "coursework.source";
+
+    // What a cache file was cooked from, stored under sourceKey
+    struct TextureCacheSource
+    {
+        uint32_t version;
+        uint32_t usage;
+        uint32_t options;
+        uint32_t reserved;
+        uint64_t sourceSize;
+        int64_t  sourceModifiedTime;
+        uint64_t sourceHash;
+    };
+
+    bool findSource(const Ktx2KeyValues &keyValues, TextureCacheSource &outSource)
+    {
+        for (const std::pair<std::string, std::string> &keyValue : keyValues)
+        {
+            if (keyValue.first == sourceKey && keyValue.second.size() == sizeof(outSource))
+            {
+                memcpy(&outSource, keyValue.second.data(), sizeof(outSource));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Textures of the same bytes sampled or cooked differently are stored
+    // differently
+    uint64_t contentHash(uint64_t sourceHash, uint32_t usage, uint32_t options)
+    {
+        uint32_t settings[2] = { usage, options };
+        return hashBytes(settings, sizeof(settings), sourceHash);
+    }
+
+}
+
+uint32_t textureUsage(const std::string &type)
+{
+    if (type == "normal")
+        return TEXTURE_USAGE_NORMAL;
+    if (type == "diffuse")
+        return TEXTURE_USAGE_COLOR;
+    return TEXTURE_USAGE_DATA;
+}
+
+uint32_t textureCacheFormat(uint32_t usage, bool hasAlpha)
+{
+    if (usage == TEXTURE_USAGE_NORMAL)
+        return BLOCK_BC5;
+    if (usage == TEXTURE_USAGE_COLOR)
+        return BLOCK_BC7;
+    return hasAlpha ? BLOCK_BC3 : BLOCK_BC1;
+}
+
+std::string textureCachePath(const char *imagePath, uint32_t usage, uint32_t options)
+{
+    std::string path = imagePath;
+    if (usage == TEXTURE_USAGE_NORMAL)
+        path += ".normal";
+    else if (usage == TEXTURE_USAGE_COLOR)
+        path += ".color";
+    else
+        path += ".data";
+    if (options & TEXTURE_CACHE_FLIP_VERTICALLY)
+        path += ".flip";
+    if (options & TEXTURE_CACHE_BOX_MIPS)
+        path += ".box";
+    return path + ".ktx2";
+}
+
+uint32_t textureMipContent(uint32_t usage)
+{
+    if (usage == TEXTURE_USAGE_NORMAL)
+        return MIP_CONTENT_NORMAL;
+    if (usage == TEXTURE_USAGE_COLOR)
+        return MIP_CONTENT_SRGB;
+    return MIP_CONTENT_LINEAR;
+}
+
+void compressTexture(const unsigned char *rgba, unsigned int width, unsigned int height, uint32_t usage,
+                     uint32_t options, uint32_t format, CompressedTexture &outTexture, unsigned int threadCount)
+{
+    uint32_t content = textureMipContent(usage);
+    uint32_t filter = (options & TEXTURE_CACHE_BOX_MIPS) ? MIP_FILTER_BOX : MIP_FILTER_KAISER;
+
+    outTexture.format = format;
+    outTexture.width = width;
+    outTexture.height = height;
+    outTexture.levels.clear();
+
+    std::vector<unsigned char> level(rgba, rgba + static_cast<size_t>(width) * height * 4), next;
+    for (;;)
+    {
+        outTexture.levels.push_back(std::vector<unsigned char>(compressedImageSize(format, width, height)));
+        compressImage(level.data(), width, height, format, outTexture.levels.back().data(), threadCount);
+        if (width == 1 && height == 1)
+            break;
+
+        downsampleImage(level.data(), width, height, content, filter, next, threadCount);
+        level.swap(next);
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+}
+
+bool loadTextureCache(const char *imagePath, uint32_t usage, uint32_t options, CompressedTexture &outTexture,
+                      uint64_t &outContentHash, bool *outWarm, unsigned int threadCount)
+{
+    if (outWarm)
+        *outWarm = false;
+
+    std::string cachePath = textureCachePath(imagePath, usage, options);
+    uint64_t sourceSize = 0;
+    int64_t sourceModifiedTime = 0;
+    bool haveSource = getFileInfo(imagePath, sourceSize, sourceModifiedTime);
+
+    // Warm path: the cache matches the source's size, and either its
+    // modification time or, if that changed, its content hash
+    MappedFile file;
+    Ktx2KeyValues keyValues;
+    TextureCacheSource source;
+    bool parsed = false;
+    if (file.open(cachePath.c_str()))
+    {
+        TRACE_SCOPE("readKtx2");
+        parsed = readKtx2(file.data(), file.size(), outTexture, &keyValues);
+    }
+    if (parsed && findSource(keyValues, source) &&
+        source.version == textureCacheVersion && source.usage == usage && source.options == options)
+    {
+        bool fresh = !haveSource;
+        if (haveSource && source.sourceSize == sourceSize)
+        {
+            fresh = source.sourceModifiedTime == sourceModifiedTime;
+            if (!fresh)
+            {
+                std::vector<char> image;
+                fresh = readFile(imagePath, image) &&
+                        hashBytes(image.data(), image.size() - 1) == source.sourceHash;
+            }
+        }
+
+        if (fresh)
+        {
+            outContentHash = contentHash(source.sourceHash, usage, options);
+            if (outWarm)
+                *outWarm = true;
+            return true;
+        }
+    }
+    file.close();
+
+    // Cold path: decode the image and cook a new cache
+    std::vector<char> image;
+    if (!haveSource || !readFile(imagePath, image))
+        return false;
+
+    int width, height, components;
+    unsigned char *pixels;
+    {
+        // Per thread, so loads on other threads with other options and the
+        // global setting are left alone
+        TRACE_SCOPE("stbi_load");
+        stbi_set_flip_vertically_on_load_thread((options & TEXTURE_CACHE_FLIP_VERTICALLY) != 0);
+        pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(image.data()),
+                                       static_cast<int>(image.size() - 1), &width, &height, &components, 4);
+    }
+    if (!pixels)
+        return false;
+
+    bool hasAlpha = false;
+    for (size_t i = 3; i < static_cast<size_t>(width) * height * 4 && !hasAlpha; i += 4)
+        hasAlpha = pixels[i] != 255;
+
+    {
+        TRACE_SCOPE("compressTexture");
+        compressTexture(pixels, width, height, usage, options, textureCacheFormat(usage, hasAlpha), outTexture,
+                        threadCount);
+    }
+    stbi_image_free(pixels);
+
+    source.version = textureCacheVersion;
+    source.usage = usage;
+    source.options = options;
+    source.reserved = 0;
+    source.sourceSize = sourceSize;
+    source.sourceModifiedTime = sourceModifiedTime;
+    source.sourceHash = hashBytes(image.data(), image.size() - 1);
+    outContentHash = contentHash(source.sourceHash, usage, options);
+
+    TRACE_SCOPE("writeKtx2");
+    keyValues.clear();
+    keyValues.push_back(std::make_pair(std::string("KTXwriter"), std::string("Computer_Graphics_Coursework", 29)));
+    keyValues.push_back(std::make_pair(std::string(sourceKey),
+                                       std::string(reinterpret_cast<const char *>(&source), sizeof(source))));
+    std::vector<unsigned char> cache;
+    writeKtx2(outTexture, keyValues, cache);
+    if (!writeFileAtomic(cachePath.c_str(), cache.data(), cache.size()))
+        printf("Could not write texture cache %s\n", cachePath.c_str());
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+#include "ktx2.hpp"
+
+// Compressed texture cache, written next to each image as
+// <file>.<usage>[.flip][.box].ktx2, one file for each usage and options the
+// image is loaded with. An image is decoded, mipmapped and block compressed
+// once; later runs upload the stored levels without decoding it. The KTX2
+// key/value data records the source the file was cooked from, checked like
+// the mesh cache's header.
+
+const uint32_t textureCacheVersion = 3;
+
+// How a texture is sampled, which picks its block format
+enum TextureUsage
+{
+    TEXTURE_USAGE_COLOR = 1,    // diffuse maps, BC7
+    TEXTURE_USAGE_NORMAL,       // tangent space x and y in BC5, z rebuilt by the shader
+    TEXTURE_USAGE_DATA          // specular and other maps, BC1 or BC3 with alpha
+};
+
+// Processing applied when cooking, recorded so a cache cooked with other
+// options is rebuilt
+enum TextureCacheOptions
+{
+    TEXTURE_CACHE_FLIP_VERTICALLY = 1,  // first row of the image at the bottom, as GL expects
+    TEXTURE_CACHE_BOX_MIPS = 2          // box filtered mip levels rather than Kaiser
+};
+
+// Usage of a material map type such as "diffuse" or "normal"
+uint32_t textureUsage(const std::string &type);
+
+// Block format of a usage, for images with or without alpha
+uint32_t textureCacheFormat(uint32_t usage, bool hasAlpha);
+
+// Path of the cache file for an image cooked for a usage and options
+std::string textureCachePath(const char *imagePath, uint32_t usage, uint32_t options);
+
+// How the mip levels of a usage are filtered: colour in linear light and
+// normals renormalised
+uint32_t textureMipContent(uint32_t usage);
+
+// Build the mip chain of an RGBA8 image, filtered for its usage and the
+// options' filter, and compress every level, using up to threadCount
+// threads (0 uses every core)
+void compressTexture(const unsigned char *rgba, unsigned int width, unsigned int height, uint32_t usage,
+                     uint32_t options, uint32_t format, CompressedTexture &outTexture,
+                     unsigned int threadCount = 0);
+
+// Load the compressed levels of an image, cooking its cache first if it is
+// missing, stale or was cooked for another usage or options. outContentHash
+// identifies the image's bytes, usage and options, for the resource cache to
+// share textures with the same contents. Cooking compresses on up to
+// threadCount threads (0 uses every core). Makes no GL calls and changes no
+// stb_image setting but the calling thread's flip.
+bool loadTextureCache(const char *imagePath, uint32_t usage, uint32_t options, CompressedTexture &outTexture,
+                      uint64_t &outContentHash, bool *outWarm = NULL, unsigned int threadCount = 0);
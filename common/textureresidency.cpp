@@ -0,0 +1,257 @@
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "textureresidency.hpp"
+#include "model.hpp"
+#include "bcn.hpp"
+
+namespace
+{
+    // Levels read from disk and streaming at once
+    const unsigned int maxLoadsInFlight = 4;
+
+    unsigned int levelSize(unsigned int size, size_t level)
+    {
+        return std::max(1u, size >> level);
+    }
+}
+
+TextureResidency::TextureResidency(size_t budgetBytes, size_t bytesPerFrame, unsigned int minimumSize)
+    : streamer(bytesPerFrame), budget(budgetBytes), minimumSize(minimumSize), frame(0), loads(0), evictions(0)
+{
+}
+
+size_t TextureResidency::initialLevel(const CompressedTexture &texture) const
+{
+    size_t level = 0;
+    while (level + 1 < texture.levels.size() &&
+           std::max(levelSize(texture.width, level), levelSize(texture.height, level)) > minimumSize)
+        level++;
+    return level;
+}
+
+bool TextureResidency::add(const TextureHandle &texture, const char *cachePath, const CompressedTexture &compressed)
+{
+    // Textures small enough to upload whole are left alone
+    if (initialLevel(compressed) == 0)
+        return false;
+
+    // The smallest level checks the file holds what is being uploaded
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    CompressedTexture header;
+    std::vector<unsigned char> blocks;
+    size_t lastLevel = compressed.levels.size() - 1;
+    if (!file->open(cachePath) ||
+        !readKtx2Level(file->data(), file->size(), static_cast<uint32_t>(lastLevel), header, blocks) ||
+        header.format != compressed.format || header.width != compressed.width ||
+        header.height != compressed.height || blocks != compressed.levels[lastLevel])
+        return false;
+
+    Entry entry;
+    entry.texture = texture;
+    entry.file = file;
+    entry.format = compressed.format;
+    entry.minimumLevel = static_cast<unsigned int>(initialLevel(compressed));
+    entry.wantedLevel = entry.minimumLevel;
+    entry.lastUsed = 0;
+    entry.loading = false;
+    entry.loadingLevel = 0;
+    entries[texture.get()] = entry;
+    texture->managed = true;
+    return true;
+}
+
+void TextureResidency::request(const TextureHandle &texture, float projectedPixels)
+{
+    if (!texture)
+        return;
+    auto found = entries.find(&texture->drawn());
+    if (found == entries.end())
+        return;
+
+    // Level whose texels are about the size of a pixel
+    Entry &entry = found->second;
+    const GpuTexture &gpu = *entry.texture;
+    float texels = static_cast<float>(std::max(gpu.width, gpu.height));
+    float level = projectedPixels > 0.0f ? floorf(log2f(texels / projectedPixels)) : 1e9f;
+    unsigned int wanted = static_cast<unsigned int>(std::min(std::max(level, 0.0f), static_cast<float>(entry.minimumLevel)));
+
+    if (entry.lastUsed != frame || wanted < entry.wantedLevel)
+        entry.wantedLevel = wanted;
+    entry.lastUsed = frame;
+}
+
+void TextureResidency::request(const Model &model, const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition,
+                               float pixelsPerUnit)
+{
+    if (!model.mesh || !model.mesh->loaded())
+        return;
+
+    // From inside the bounding sphere every texel may show
+    BoundingVolume world = model.worldBounds(modelMatrix);
+    float distance = glm::length(cameraPosition - world.center) - world.radius;
+    float pixels = distance > 0.0f ? 2.0f * world.radius * pixelsPerUnit / distance : 1e9f;
+
+    const MaterialTable &table = materialTable();
+    for (size_t i = 0; i < model.mesh->parts.size(); i++)
+    {
+        for (const Texture &texture : table.get(model.material(i)).textures)
+            request(texture.resource, pixels);
+    }
+}
+
+size_t TextureResidency::levelBytes(const Entry &entry, unsigned int level) const
+{
+    const GpuTexture &texture = *entry.texture;
+    return compressedImageSize(entry.format, levelSize(texture.width, level), levelSize(texture.height, level));
+}
+
+size_t TextureResidency::entryBytes(const Entry &entry) const
+{
+    const GpuTexture &texture = *entry.texture;
+    if (texture.id == 0)
+        return 0;
+    size_t bytes = 0;
+    for (unsigned int level = texture.baseLevel; level < texture.levels; level++)
+        bytes += levelBytes(entry, level);
+    if (entry.loading)
+        bytes += levelBytes(entry, entry.loadingLevel);
+    return bytes;
+}
+
+size_t TextureResidency::residentBytes(const GpuTexture &texture) const
+{
+    auto found = entries.find(&texture);
+    return found == entries.end() ? 0 : entryBytes(found->second);
+}
+
+size_t TextureResidency::evictOne()
+{
+    // Levels not used this frame go first, oldest first, then levels finer
+    // than this frame asked for
+    Entry *victim = NULL;
+    for (auto &item : entries)
+    {
+        Entry &entry = item.second;
+        const GpuTexture &texture = *entry.texture;
+        if (entry.loading || texture.id == 0 || texture.baseLevel >= entry.minimumLevel)
+            continue;
+        if (entry.lastUsed == frame && texture.baseLevel >= entry.wantedLevel)
+            continue;
+        if (!victim || entry.lastUsed < victim->lastUsed ||
+            (entry.lastUsed == victim->lastUsed && texture.baseLevel < victim->texture->baseLevel))
+            victim = &entry;
+    }
+    if (!victim)
+        return 0;
+
+    // A 0x0 image frees the level's memory
+    GpuTexture &texture = *victim->texture;
+    unsigned int level = texture.baseLevel;
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level + 1));
+    glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), texture.internalFormat, 0, 0, 0, 0, NULL);
+    texture.baseLevel = level + 1;
+    evictions++;
+    return levelBytes(*victim, level);
+}
+
+void TextureResidency::update()
+{
+    // Levels streamed in are sampled from now on
+    streamer.update();
+    size_t total = 0;
+    unsigned int inFlight = 0;
+    std::vector<Entry *> wanting;
+    for (auto item = entries.begin(); item != entries.end();)
+    {
+        Entry &entry = item->second;
+        if (entry.loading && entry.texture->baseLevel <= entry.loadingLevel)
+            entry.loading = false;
+
+        // Textures only the residency holds are freed
+        if (!entry.loading && entry.texture.use_count() == 1)
+        {
+            entry.texture->managed = false;
+            item = entries.erase(item);
+            continue;
+        }
+
+        total += entryBytes(entry);
+        if (entry.loading)
+            inFlight++;
+        else if (entry.texture->id != 0 && entry.lastUsed == frame && entry.wantedLevel < entry.texture->baseLevel)
+            wanting.push_back(&entry);
+        ++item;
+    }
+
+    // Over budget, from a smaller budget or textures added, evict first
+    while (total > budget)
+    {
+        size_t freed = evictOne();
+        if (freed == 0)
+            break;
+        total -= freed;
+    }
+
+    // Textures furthest from the level they want load first
+    std::sort(wanting.begin(), wanting.end(), [](const Entry *a, const Entry *b)
+    {
+        return a->texture->baseLevel - a->wantedLevel > b->texture->baseLevel - b->wantedLevel;
+    });
+    for (Entry *entry : wanting)
+    {
+        if (inFlight >= maxLoadsInFlight)
+            break;
+
+        unsigned int level = entry->texture->baseLevel - 1;
+        size_t bytes = levelBytes(*entry, level);
+        while (total + bytes > budget)
+        {
+            size_t freed = evictOne();
+            if (freed == 0)
+                break;
+            total -= freed;
+        }
+        if (total + bytes > budget)
+            break;
+
+        CompressedTexture header;
+        std::vector<unsigned char> blocks;
+        if (!readKtx2Level(entry->file->data(), entry->file->size(), level, header, blocks))
+            continue;
+        streamer.uploadLevel(entry->texture, entry->format, level, blocks);
+        entry->loading = true;
+        entry->loadingLevel = level;
+        total += bytes;
+        inFlight++;
+        loads++;
+    }
+
+    frame++;
+}
+
+TextureResidencyStats TextureResidency::stats() const
+{
+    TextureResidencyStats stats;
+    stats.textures = static_cast<unsigned int>(entries.size());
+    stats.loads = loads;
+    stats.evictions = evictions;
+    stats.budgetBytes = budget;
+    stats.residentBytes = 0;
+    for (const auto &item : entries)
+        stats.residentBytes += entryBytes(item.second);
+    return stats;
+}
+
+void TextureResidency::resetStats()
+{
+    loads = 0;
+    evictions = 0;
+}
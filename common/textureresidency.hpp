@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include "resourcecache.hpp"
+#include "texturestreamer.hpp"
+#include "fileutil.hpp"
+#include "ktx2.hpp"
+
+class Model;
+
+struct TextureResidencyStats
+{
+    unsigned int textures;          // managed
+    unsigned int loads;             // levels streamed in since the last reset
+    unsigned int evictions;         // levels dropped since the last reset
+    size_t residentBytes;
+    size_t budgetBytes;
+};
+
+// Keeps the mip levels of textures in video memory as far as the views of
+// them need and a budget allows. A managed texture starts with its small
+// levels only. Each frame the objects drawn ask for the level their size on
+// screen needs, and the next larger levels are read from the texture's KTX2
+// cache and streamed in through a TextureStreamer. To stay in budget, the
+// largest level of the texture used longest ago, or finer than it needs, is
+// evicted. Works on any GL 3.3 context, software ones included.
+class TextureResidency
+{
+public:
+    // budgetBytes of video memory across the managed textures, streaming
+    // at most bytesPerFrame. Textures start with the levels no larger than
+    // minimumSize texels.
+    explicit TextureResidency(size_t budgetBytes = 256 << 20, size_t bytesPerFrame = 4 << 20,
+                              unsigned int minimumSize = 128);
+
+    // First level a texture starts with, for loaders to leave the larger
+    // ones out of its upload
+    size_t initialLevel(const CompressedTexture &texture) const;
+
+    // Manage a texture being uploaded from initialLevel() of compressed,
+    // whose larger levels are read from the KTX2 file at cachePath when
+    // needed. Returns false, leaving the texture alone, if the file cannot
+    // be mapped or does not hold the same levels, or the texture is small
+    // enough to upload whole.
+    bool add(const TextureHandle &texture, const char *cachePath, const CompressedTexture &compressed);
+
+    // Ask for the level that draws a texture projectedPixels across. Each
+    // texture gets the finest level asked for in the frame.
+    void request(const TextureHandle &texture, float projectedPixels);
+
+    // Ask for the maps of a model's materials, sized as if each spans the
+    // model's bounding sphere
+    void request(const Model &model, const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition,
+                 float pixelsPerUnit);
+
+    // On the GL thread once per frame, after the requests: stream in the
+    // levels asked for and evict levels to stay in budget
+    void update();
+
+    void setBudget(size_t budgetBytes) { budget = budgetBytes; }
+
+    // Video memory of a managed texture's levels from its base level, 0 for
+    // textures not managed
+    size_t residentBytes(const GpuTexture &texture) const;
+
+    TextureResidencyStats stats() const;
+    void resetStats();
+
+private:
+    TextureResidency(const TextureResidency &);
+    TextureResidency &operator=(const TextureResidency &);
+
+    struct Entry
+    {
+        TextureHandle texture;
+        std::shared_ptr<MappedFile> file;
+        uint32_t format;                // BlockFormat
+        unsigned int minimumLevel;      // never evicted
+        unsigned int wantedLevel;
+        uint64_t lastUsed;              // frame of the last request
+        bool loading;                   // loadingLevel is streaming in
+        unsigned int loadingLevel;
+    };
+
+    size_t levelBytes(const Entry &entry, unsigned int level) const;
+    size_t entryBytes(const Entry &entry) const;
+
+    // Drop the largest level of the least recently used texture that can
+    // spare one. Returns the bytes freed, 0 if none could.
+    size_t evictOne();
+
+    std::unordered_map<const GpuTexture *, Entry> entries;
+    TextureStreamer streamer;
+    size_t budget;
+    unsigned int minimumSize;
+    uint64_t frame;
+    unsigned int loads, evictions;
+};
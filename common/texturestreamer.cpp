@@ -0,0 +1,258 @@
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "texturestreamer.hpp"
+#include "bcn.hpp"
+
+namespace
+{
+    unsigned int levelSize(unsigned int size, size_t level)
+    {
+        return std::max(1u, size >> level);
+    }
+
+    // Bytes of one row of 4x4 blocks
+    size_t blockRowBytes(const CompressedTexture &texture, size_t level)
+    {
+        return compressedImageSize(texture.format, levelSize(texture.width, level), 1);
+    }
+}
+
+bool glBlockFormat(uint32_t format, GLenum &outInternalFormat)
+{
+    switch (format)
+    {
+    case BLOCK_BC1:
+        outInternalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        return GLEW_EXT_texture_compression_s3tc != 0;
+    case BLOCK_BC3:
+        outInternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        return GLEW_EXT_texture_compression_s3tc != 0;
+    case BLOCK_BC5:
+        outInternalFormat = GL_COMPRESSED_RG_RGTC2;
+        return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+    default:
+        outInternalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+        return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+    }
+}
+
+TextureStreamer::TextureStreamer(size_t segmentBytes, unsigned int segmentCount)
+    : buffer(0), segmentBytes(segmentBytes), fences(segmentCount, (GLsync)NULL), nextSegment(0)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    if (!ResourceCache::hasContext())
+        return;
+    
+    for (GLsync fence : fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    for (const Job &job : jobs)
+    {
+        if (job.created)
+            glDeleteTextures(1, &job.id);
+    }
+    if (buffer != 0)
+        glDeleteBuffers(1, &buffer);
+}
+
+void TextureStreamer::createBuffer()
+{
+    // The buffer is made on first use, as the streamer can be created
+    // before the GL context
+    if (buffer != 0)
+        return;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, segmentBytes * fences.size(), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::upload(const TextureHandle &texture, CompressedTexture &compressed, size_t firstLevel)
+{
+    createBuffer();
+    
+    jobs.push_back(Job());
+    Job &job = jobs.back();
+    job.texture = texture;
+    job.compressed.format = compressed.format;
+    job.compressed.width = compressed.width;
+    job.compressed.height = compressed.height;
+    job.compressed.levels.swap(compressed.levels);
+    glBlockFormat(job.compressed.format, job.internalFormat);
+    job.created = true;
+    job.firstLevel = std::min(firstLevel, job.compressed.levels.size() - 1);
+    job.endLevel = job.compressed.levels.size();
+    job.level = job.firstLevel;
+    job.row = 0;
+    
+    // Storage for every level up front, filled band by band later. Levels
+    // with rows wider than a segment are uploaded from client memory now.
+    bool direct = blockRowBytes(job.compressed, job.firstLevel) > segmentBytes;
+    glGenTextures(1, &job.id);
+    glBindTexture(GL_TEXTURE_2D, job.id);
+    for (size_t level = job.firstLevel; level < job.endLevel; level++)
+    {
+        const std::vector<unsigned char> &blocks = job.compressed.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), job.internalFormat,
+                               levelSize(job.compressed.width, level), levelSize(job.compressed.height, level), 0,
+                               static_cast<GLsizei>(blocks.size()), direct ? blocks.data() : NULL);
+    }
+    if (direct)
+        job.level = job.endLevel;
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(job.firstLevel));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(job.endLevel) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void TextureStreamer::uploadLevel(const TextureHandle &texture, uint32_t format, size_t level,
+                                  std::vector<unsigned char> &blocks)
+{
+    createBuffer();
+    
+    jobs.push_back(Job());
+    Job &job = jobs.back();
+    job.texture = texture;
+    job.compressed.format = format;
+    job.compressed.width = texture->width;
+    job.compressed.height = texture->height;
+    job.compressed.levels.resize(level + 1);
+    job.compressed.levels[level].swap(blocks);
+    glBlockFormat(format, job.internalFormat);
+    job.id = texture->id;
+    job.created = false;
+    job.firstLevel = level;
+    job.endLevel = level + 1;
+    job.level = level;
+    job.row = 0;
+    
+    // Storage for the level, not sampled until the base level drops to it
+    const std::vector<unsigned char> &levelBlocks = job.compressed.levels[level];
+    bool direct = blockRowBytes(job.compressed, level) > segmentBytes;
+    glBindTexture(GL_TEXTURE_2D, job.id);
+    glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), job.internalFormat,
+                           levelSize(job.compressed.width, level), levelSize(job.compressed.height, level), 0,
+                           static_cast<GLsizei>(levelBlocks.size()), direct ? levelBlocks.data() : NULL);
+    if (direct)
+        job.level = job.endLevel;
+}
+
+size_t TextureStreamer::update(bool wait)
+{
+    if (jobs.empty())
+        return 0;
+    
+    // Reuse the segment only once the GPU has read what was last put in it
+    GLsync &fence = fences[nextSegment];
+    if (fence)
+    {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            return 0;
+        glDeleteSync(fence);
+        fence = NULL;
+    }
+    
+    size_t segmentOffset = nextSegment * segmentBytes;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    unsigned char *mapped = static_cast<unsigned char *>(glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, segmentOffset, segmentBytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    if (!mapped)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return 0;
+    }
+    
+    // Copy whole block rows, in queue order, until the segment is full
+    bands.clear();
+    size_t used = 0;
+    for (Job &job : jobs)
+    {
+        while (job.level < job.endLevel)
+        {
+            unsigned int rowCount = (levelSize(job.compressed.height, job.level) + 3) / 4;
+            size_t rowBytes = blockRowBytes(job.compressed, job.level);
+            unsigned int rows = static_cast<unsigned int>(
+                std::min<size_t>(rowCount - job.row, (segmentBytes - used) / rowBytes));
+            if (rows == 0)
+                break;
+            
+            Band band = { &job, job.level, job.row, rows, segmentOffset + used, rows * rowBytes };
+            memcpy(mapped + used, job.compressed.levels[job.level].data() + job.row * rowBytes, band.size);
+            bands.push_back(band);
+            used += band.size;
+            
+            job.row += rows;
+            if (job.row == rowCount)
+            {
+                job.level++;
+                job.row = 0;
+            }
+        }
+        if (job.level < job.endLevel)
+            break;
+    }
+    
+    if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+        printf("Texture upload buffer was lost while mapped\n");
+    
+    // Upload the bands from the buffer: the driver copies them when the GPU
+    // gets to them, not now
+    for (const Band &band : bands)
+    {
+        const CompressedTexture &compressed = band.job->compressed;
+        unsigned int height = levelSize(compressed.height, band.level);
+        glBindTexture(GL_TEXTURE_2D, band.job->id);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(band.level), 0, band.row * 4,
+                                  levelSize(compressed.width, band.level),
+                                  std::min(band.rowCount * 4, height - band.row * 4),
+                                  band.job->internalFormat, static_cast<GLsizei>(band.size),
+                                  reinterpret_cast<const void *>(band.offset));
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    nextSegment = (nextSegment + 1) % fences.size();
+    
+    // Textures with every level uploaded stop drawing as their placeholder,
+    // and levels added to a texture start being sampled
+    size_t finished = 0;
+    while (!jobs.empty() && jobs.front().level == jobs.front().endLevel)
+    {
+        const Job &job = jobs.front();
+        GpuTexture &texture = *job.texture;
+        if (job.created)
+        {
+            texture.id = job.id;
+            texture.owned = true;
+            texture.internalFormat = job.internalFormat;
+            texture.width = job.compressed.width;
+            texture.height = job.compressed.height;
+            texture.levels = static_cast<unsigned int>(job.compressed.levels.size());
+            texture.original.reset();
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, job.id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(job.firstLevel));
+        }
+        texture.baseLevel = static_cast<unsigned int>(job.firstLevel);
+        jobs.pop_front();
+        finished++;
+    }
+    return finished;
+}
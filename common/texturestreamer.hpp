@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include "ktx2.hpp"
+#include "resourcecache.hpp"
+
+// GL internal format of a block format, and whether the driver has it
+bool glBlockFormat(uint32_t format, GLenum &outInternalFormat);
+
+// Streams compressed textures to GL through a ring of pixel unpack buffer
+// memory. The ring is split into one segment per frame in flight; each
+// update() copies block rows into the next free segment and uploads them
+// from there, so the driver copies asynchronously rather than the frame
+// waiting on glCompressedTexImage2D. A fence per segment says when the GPU
+// is done with it. Large levels stream in bands of block rows over several
+// frames, and a texture keeps drawing as its placeholder until every level
+// is in. Needs a GL 3.3 context.
+class TextureStreamer
+{
+public:
+    // segmentBytes is the most copied per update, the per frame budget
+    explicit TextureStreamer(size_t segmentBytes = 4 << 20, unsigned int segmentCount = 3);
+    ~TextureStreamer();
+
+    // Queue the levels of a texture with a block format the driver has,
+    // taking them from compressed. Levels before firstLevel are left out
+    // and the texture's base level starts at firstLevel.
+    void upload(const TextureHandle &texture, CompressedTexture &compressed, size_t firstLevel = 0);
+
+    // Queue the level above the base level of a texture already uploaded,
+    // taking its blocks. The base level drops to it once it is in.
+    void uploadLevel(const TextureHandle &texture, uint32_t format, size_t level, std::vector<unsigned char> &blocks);
+
+    // Copy and upload the next segment's worth of queued levels. When the
+    // next segment is still in use this uploads nothing, unless wait is set.
+    // Returns how many textures and levels were finished.
+    size_t update(bool wait = false);
+
+    // Textures and levels queued and not finished
+    size_t pendingCount() const { return jobs.size(); }
+
+private:
+    TextureStreamer(const TextureStreamer &);
+    TextureStreamer &operator=(const TextureStreamer &);
+
+    void createBuffer();
+
+    struct Job
+    {
+        TextureHandle texture;
+        CompressedTexture compressed;
+        GLenum internalFormat;
+        GLuint id;
+        bool created;               // id is a new texture rather than the texture's own
+        size_t firstLevel, endLevel;
+        size_t level;
+        unsigned int row;           // next block row of level
+    };
+
+    // Block rows copied into the mapped segment, uploaded once it is unmapped
+    struct Band
+    {
+        Job *job;
+        size_t level;
+        unsigned int row, rowCount;
+        size_t offset, size;        // bytes in the buffer
+    };
+
+    GLuint buffer;
+    size_t segmentBytes;
+    std::vector<GLsync> fences;     // per segment, NULL once the GPU is done with it
+    unsigned int nextSegment;
+    std::deque<Job> jobs;
+    std::vector<Band> bands;
+};
@@ -0,0 +1,72 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <stdio.h>
+
+#include "threadpool.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : busyCount(0), stopping(false)
+{
+    if (threadCount == 0)
+        threadCount = hardwareThreadCount();
+    threads.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++)
+        threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskQueued.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    taskQueued.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    tasksDone.wait(lock, [this] { return tasks.empty() && busyCount == 0; });
+}
+
+void ThreadPool::run(unsigned int index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "Worker %u", index);
+    traceThreadName(name);
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        taskQueued.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty())
+            return;
+        
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        busyCount++;
+        
+        lock.unlock();
+        task();
+        lock.lock();
+        
+        busyCount--;
+        if (tasks.empty() && busyCount == 0)
+            tasksDone.notify_all();
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads running queued tasks in the order they were
+// submitted. Unlike runParallel the threads live as long as the pool, so
+// tasks can be queued from anywhere without waiting for them.
+class ThreadPool
+{
+public:
+    // threadCount workers, 0 for one per core
+    explicit ThreadPool(unsigned int threadCount = 0);
+
+    // Runs the tasks still queued, then joins the workers
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    // Block until the queue is empty and no task is running
+    void wait();
+
+    unsigned int threadCount() const { return static_cast<unsigned int>(threads.size()); }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    void run(unsigned int index);
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskQueued;
+    std::condition_variable tasksDone;
+    unsigned int busyCount;
+    bool stopping;
+};
@@ -0,0 +1,211 @@
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <stdio.h>
+
+#include "trace.hpp"
+
+namespace
+{
+    struct Span
+    {
+        const char *name;
+        std::string detail;
+        int64_t start;          // microseconds since the first span
+        int64_t duration;
+        unsigned int thread;
+        bool sameAsset;         // inside a span with the same detail
+    };
+
+    struct Trace
+    {
+        std::mutex mutex;
+        std::vector<Span> spans;
+        std::vector<std::string> threadNames;
+        std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    };
+
+    Trace &trace()
+    {
+        static Trace instance;
+        return instance;
+    }
+
+    // Small thread numbers read better in a trace viewer than native ids
+    unsigned int threadNumber()
+    {
+        static std::atomic<unsigned int> nextNumber(0);
+        thread_local unsigned int number = nextNumber++;
+        return number;
+    }
+
+    thread_local const TraceScope *openScope = NULL;
+
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - trace().origin).count();
+    }
+
+    // Quote a string for JSON
+    std::string jsonString(const std::string &text)
+    {
+        std::string quoted = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                quoted += '\\';
+                quoted += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                quoted += escape;
+            }
+            else
+            {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+}
+
+TraceScope::TraceScope(const char *name, const char *detail)
+    : name(name), detail(detail ? detail : ""), start(now()), parent(openScope)
+{
+    // Stages of loading an asset belong to the asset
+    if (this->detail.empty() && parent)
+        this->detail = parent->detail;
+    openScope = this;
+}
+
+TraceScope::TraceScope(const char *name, const std::string &detail)
+    : TraceScope(name, detail.c_str())
+{
+}
+
+TraceScope::~TraceScope()
+{
+    openScope = parent;
+    
+    Span span;
+    span.name = name;
+    span.detail = detail;
+    span.start = start;
+    span.duration = now() - start;
+    span.thread = threadNumber();
+    span.sameAsset = parent && parent->detail == detail;
+    
+    Trace &state = trace();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.spans.push_back(span);
+}
+
+void traceThreadName(const char *name)
+{
+    unsigned int number = threadNumber();
+    Trace &state = trace();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.threadNames.size() <= number)
+        state.threadNames.resize(number + 1);
+    state.threadNames[number] = name;
+}
+
+bool writeTrace(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+    
+    Trace &state = trace();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t i = 0; i < state.threadNames.size(); i++)
+    {
+        if (state.threadNames[i].empty())
+            continue;
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":%s}}",
+                first ? "" : ",\n", i, jsonString(state.threadNames[i]).c_str());
+        first = false;
+    }
+    for (const Span &span : state.spans)
+    {
+        fprintf(file, "%s{\"name\":%s,\"cat\":\"load\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%lld,\"dur\":%lld",
+                first ? "" : ",\n", jsonString(span.name).c_str(), span.thread,
+                static_cast<long long>(span.start), static_cast<long long>(span.duration));
+        if (!span.detail.empty())
+            fprintf(file, ",\"args\":{\"asset\":%s}", jsonString(span.detail).c_str());
+        fprintf(file, "}");
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+void printTraceSummary()
+{
+    struct Total
+    {
+        std::string name;
+        unsigned int count;
+        int64_t total;
+        int64_t longest;
+        std::string longestDetail;
+    };
+    
+    std::vector<Total> stages;
+    std::vector<Total> assets;
+    {
+        Trace &state = trace();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        std::unordered_map<std::string, size_t> stageIndex;
+        std::unordered_map<std::string, size_t> assetIndex;
+        for (const Span &span : state.spans)
+        {
+            auto stage = stageIndex.emplace(span.name, stages.size());
+            if (stage.second)
+                stages.push_back(Total{ span.name, 0, 0, 0, std::string() });
+            Total &total = stages[stage.first->second];
+            total.count++;
+            total.total += span.duration;
+            if (span.duration >= total.longest)
+            {
+                total.longest = span.duration;
+                total.longestDetail = span.detail;
+            }
+            
+            // Spans nested in one for the same asset are already counted
+            if (span.detail.empty() || span.sameAsset)
+                continue;
+            auto asset = assetIndex.emplace(span.detail, assets.size());
+            if (asset.second)
+                assets.push_back(Total{ span.detail, 0, 0, 0, std::string() });
+            Total &assetTotal = assets[asset.first->second];
+            assetTotal.count++;
+            assetTotal.total += span.duration;
+            assetTotal.longest = std::max(assetTotal.longest, span.duration);
+        }
+    }
+    
+    auto byTotal = [](const Total &a, const Total &b) { return a.total > b.total; };
+    std::sort(stages.begin(), stages.end(), byTotal);
+    std::sort(assets.begin(), assets.end(), byTotal);
+    
+    printf("%-28s %6s %10s %10s  %s\n", "stage", "count", "total ms", "max ms", "slowest asset");
+    for (const Total &stage : stages)
+        printf("%-28s %6u %10.2f %10.2f  %s\n", stage.name.c_str(), stage.count, stage.total / 1000.0,
+               stage.longest / 1000.0, stage.longestDetail.c_str());
+    
+    printf("\n%-40s %6s %10s\n", "asset", "spans", "total ms");
+    for (const Total &asset : assets)
+        printf("%-40s %6u %10.2f\n", asset.name.c_str(), asset.count, asset.total / 1000.0);
+}
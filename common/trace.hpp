@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+// Wall clock span from construction to destruction, recorded with the
+// calling thread so load times can be traced to a stage and an asset.
+// name must be a string literal; detail, such as the asset's path, is
+// copied, and taken from the enclosing scope when not given. Defining
+// NO_TRACE compiles TRACE_SCOPE out.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, const char *detail = NULL);
+    TraceScope(const char *name, const std::string &detail);
+    ~TraceScope();
+
+private:
+    TraceScope(const TraceScope &);
+    TraceScope &operator=(const TraceScope &);
+
+    const char *name;
+    std::string detail;
+    int64_t start;
+    const TraceScope *parent;   // enclosing scope on this thread
+};
+
+#define TRACE_CONCAT_LINE(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_LINE(a, b)
+#ifdef NO_TRACE
+#define TRACE_SCOPE(...)
+#else
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+#endif
+
+// Name the calling thread in the trace
+void traceThreadName(const char *name);
+
+// Write the spans recorded so far as Chrome trace event JSON, which
+// chrome://tracing and ui.perfetto.dev open
+bool writeTrace(const char *path);
+
+// Print the count, total and longest time of each kind of span, then the
+// time spent on each asset
+void printTraceSummary();
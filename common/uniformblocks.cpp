@@ -0,0 +1,99 @@
+#include <vector>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "uniformblocks.hpp"
+#include "resourcecache.hpp"
+
+// Sizes and offsets as std140 lays out the blocks
+static_assert(sizeof(FrameData) == 144, "FrameData must match its std140 block");
+static_assert(sizeof(LightSourceData) == 64, "LightSourceData must match its std140 struct");
+
+namespace
+{
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+void bindUniformBlocks(GLuint programID)
+{
+    GLuint frame = glGetUniformBlockIndex(programID, "FrameData");
+    if (frame != GL_INVALID_INDEX)
+        glUniformBlockBinding(programID, frame, UNIFORM_BLOCK_FRAME);
+    GLuint lights = glGetUniformBlockIndex(programID, "LightData");
+    if (lights != GL_INVALID_INDEX)
+        glUniformBlockBinding(programID, lights, UNIFORM_BLOCK_LIGHTS);
+}
+
+UniformBlocks::UniformBlocks(unsigned int frameCount)
+    : buffer(0), lightsOffset(0), copyBytes(0), fences(frameCount, (GLsync)NULL), current(0)
+{
+}
+
+UniformBlocks::~UniformBlocks()
+{
+    if (!ResourceCache::hasContext())
+        return;
+
+    for (GLsync fence : fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    if (buffer != 0)
+        glDeleteBuffers(1, &buffer);
+}
+
+void UniformBlocks::update(const FrameData &frame, const LightData &lights)
+{
+    // The buffer is made on first use, as the blocks can be created before
+    // the GL context. Bound ranges start at multiples of the alignment.
+    if (buffer == 0)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        lightsOffset = alignUp(sizeof(FrameData), alignment);
+        copyBytes = alignUp(lightsOffset + sizeof(LightData), alignment);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, copyBytes * fences.size(), NULL, GL_STREAM_DRAW);
+    }
+    else
+    {
+        // The draws since the last update read the last copy
+        GLsync &fence = fences[current];
+        if (fence)
+            glDeleteSync(fence);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current = (current + 1) % fences.size();
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    }
+
+    // The next copy is reused once the GPU has drawn the frame that read it,
+    // which with a few frames in flight it has
+    GLsync &fence = fences[current];
+    if (fence)
+    {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(fence);
+        fence = NULL;
+    }
+
+    size_t offset = current * copyBytes;
+    unsigned char *mapped = static_cast<unsigned char *>(glMapBufferRange(
+        GL_UNIFORM_BUFFER, offset, copyBytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    if (mapped)
+    {
+        memcpy(mapped, &frame, sizeof(frame));
+        memcpy(mapped + lightsOffset, &lights, sizeof(lights));
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_FRAME, buffer, offset, sizeof(FrameData));
+    glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_LIGHTS, buffer, offset + lightsOffset, sizeof(LightData));
+}
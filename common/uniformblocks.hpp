@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Binding points of the uniform blocks every program shares, attached to
+// each program's blocks by bindUniformBlocks
+enum UniformBlockBinding
+{
+    UNIFORM_BLOCK_FRAME = 0,    // FrameData
+    UNIFORM_BLOCK_LIGHTS        // LightData
+};
+
+// Point lights in LightData, TOTAL_LIGHTS in fragmentShader.glsl
+const unsigned int maxLights = 2;
+
+// The std140 layouts of the blocks in the shaders, member for member
+
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPosition;
+    float padding;
+};
+
+struct LightSourceData
+{
+    glm::vec3 position;
+    float focalStrength;
+    glm::vec3 ambientColor;
+    float specularIntensity;
+    glm::vec3 diffuseColor;
+    int enabled;                // GLSL bool
+    glm::vec3 specularColor;
+    float padding;
+};
+
+struct LightData
+{
+    LightSourceData lightSources[maxLights];
+};
+
+// Attach a linked program's FrameData and LightData blocks, where it has
+// them, to their binding points
+void bindUniformBlocks(GLuint programID);
+
+// Per frame uniform data for every program, written once a frame rather
+// than set on each program with glUniform calls. One buffer holds a copy of
+// the blocks per frame in flight; each update() writes the next copy and
+// binds its ranges to the blocks' binding points, and a fence per copy says
+// when the GPU has finished drawing with it. Needs a GL 3.3 context.
+class UniformBlocks
+{
+public:
+    explicit UniformBlocks(unsigned int frameCount = 3);
+    ~UniformBlocks();
+
+    // Write this frame's blocks, before its draws
+    void update(const FrameData &frame, const LightData &lights);
+
+private:
+    UniformBlocks(const UniformBlocks &);
+    UniformBlocks &operator=(const UniformBlocks &);
+
+    GLuint buffer;
+    size_t lightsOffset;            // within a copy, aligned for glBindBufferRange
+    size_t copyBytes;
+    std::vector<GLsync> fences;     // per copy, NULL once the GPU is done with it
+    unsigned int current;           // copy written by the last update
+};
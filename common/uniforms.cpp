@@ -0,0 +1,103 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "uniforms.hpp"
+#include "material.hpp"
+
+namespace
+{
+    struct ProgramUniforms
+    {
+        UniformTable table;
+        ShaderUniforms shader;
+
+        explicit ProgramUniforms(GLuint programID) : table(programID), shader(table) {}
+    };
+
+    // Most frames draw with one program, so the last one found is kept
+    std::unordered_map<GLuint, std::unique_ptr<ProgramUniforms>> programs;
+    GLuint lastProgram = 0;
+    const ProgramUniforms *lastUniforms = NULL;
+
+    const ProgramUniforms &programUniforms(GLuint programID)
+    {
+        if (lastUniforms && lastProgram == programID)
+            return *lastUniforms;
+        std::unique_ptr<ProgramUniforms> &uniforms = programs[programID];
+        if (!uniforms)
+            uniforms.reset(new ProgramUniforms(programID));
+        lastProgram = programID;
+        lastUniforms = uniforms.get();
+        return *uniforms;
+    }
+}
+
+UniformTable::UniformTable(GLuint programID)
+{
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 1);
+
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveUniform(programID, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size,
+                           &type, name.data());
+        std::string uniform(name.data(), length);
+
+        // Members of uniform blocks have no location
+        GLint location = glGetUniformLocation(programID, uniform.c_str());
+        if (location < 0)
+            continue;
+        locations[uniform] = location;
+
+        // Arrays are listed once as "name[0]"
+        if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+        {
+            std::string base = uniform.substr(0, uniform.size() - 3);
+            locations[base] = location;
+            for (GLint element = 1; element < size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                locations[elementName] = glGetUniformLocation(programID, elementName.c_str());
+            }
+        }
+    }
+}
+
+Uniform UniformTable::find(const std::string &name) const
+{
+    auto found = locations.find(name);
+    return found == locations.end() ? Uniform() : Uniform(found->second);
+}
+
+ShaderUniforms::ShaderUniforms(const UniformTable &table)
+    : ka(table.find("Ka")), kd(table.find("Kd")), ks(table.find("Ks")), ns(table.find("Ns")),
+      useNormalAndSpec(table.find("bUseNormAndSpec")),
+      positionOffset(table.find("positionOffset")), positionScale(table.find("positionScale"))
+{
+    for (unsigned int i = 0; i < samplerTypeCount; i++)
+    {
+        std::string type = samplerType(i);
+        maps[i] = table.find(type + "Map");
+        arrays[i] = table.find(type + "Array");
+        layers[i] = table.find(type + "Layer");
+    }
+}
+
+const UniformTable &uniformTable(GLuint programID)
+{
+    return programUniforms(programID).table;
+}
+
+const ShaderUniforms &shaderUniforms(GLuint programID)
+{
+    return programUniforms(programID).shader;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "material.hpp"
+
+// Location of a uniform, resolved once from its program's table rather than
+// queried by name each frame. -1 when the program has no such active
+// uniform, and the setters then make no call.
+struct Uniform
+{
+    GLint location;
+
+    Uniform() : location(-1) {}
+    explicit Uniform(GLint location) : location(location) {}
+
+    bool active() const { return location >= 0; }
+};
+
+inline void setUniform(Uniform uniform, int value)
+{
+    if (uniform.location >= 0)
+        glUniform1i(uniform.location, value);
+}
+
+inline void setUniform(Uniform uniform, float value)
+{
+    if (uniform.location >= 0)
+        glUniform1f(uniform.location, value);
+}
+
+inline void setUniform(Uniform uniform, const glm::vec3 &value)
+{
+    if (uniform.location >= 0)
+        glUniform3fv(uniform.location, 1, &value.x);
+}
+
+inline void setUniform(Uniform uniform, const glm::mat4 &value)
+{
+    if (uniform.location >= 0)
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &value[0][0]);
+}
+
+// The active uniforms of a linked program by name, enumerated once with
+// glGetActiveUniform
+class UniformTable
+{
+public:
+    explicit UniformTable(GLuint programID);
+
+    // Uniform named as GLSL spells it, such as "Ka" or
+    // "lightSources[1].position". Each element of an array is found as
+    // "name[i]", and the first also as "name". Hashes the name, so is for
+    // load time; keep the Uniform for drawing.
+    Uniform find(const std::string &name) const;
+
+    size_t size() const { return locations.size(); }
+
+private:
+    std::unordered_map<std::string, GLint> locations;
+};
+
+// The uniforms the model and material drawing code sets, resolved from a
+// program's table
+struct ShaderUniforms
+{
+    Uniform ka, kd, ks, ns;
+    Uniform useNormalAndSpec;
+    Uniform positionOffset, positionScale;
+    Uniform maps[samplerTypeCount], arrays[samplerTypeCount], layers[samplerTypeCount];
+
+    explicit ShaderUniforms(const UniformTable &table);
+};
+
+// Table of a program, built the first time it is asked for; LoadShaders
+// builds it once the program links. On the GL thread only.
+const UniformTable &uniformTable(GLuint programID);
+const ShaderUniforms &shaderUniforms(GLuint programID);
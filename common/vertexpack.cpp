@@ -0,0 +1,206 @@
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "vertexpack.hpp"
+
+namespace
+{
+    // Visually lossless limits: a ten thousandth of the model's size, a
+    // quarter texel of a 1024 texture and half a degree of normal direction
+    const float positionTolerance = 1e-4f;
+    const float uvTolerance = 1.0f / 4096.0f;
+    const float normalToleranceDegrees = 0.5f;
+
+    uint32_t attributeSize(uint32_t type, uint32_t components)
+    {
+        switch (type)
+        {
+        case PACKED_FLOAT16:
+        case PACKED_UNORM16:
+            return 2 * components;
+        case PACKED_SNORM10:
+            return 4;
+        default:
+            return 4 * components;
+        }
+    }
+
+    float angleDegrees(const glm::vec3 &a, const glm::vec3 &b)
+    {
+        float lengths = glm::length(a) * glm::length(b);
+        if (lengths == 0.0f)
+            return 0.0f;
+        float cosine = glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f);
+        return acosf(cosine) * (180.0f / 3.14159265f);
+    }
+
+    // GL 3.3 decodes signed normalised 10-bit values as (2c + 1) / 1023 and
+    // GL 4.2 onwards as c / 511, so the error is the worse of the two
+    float snorm10Error(const glm::vec3 &normal, uint32_t packed)
+    {
+        glm::vec3 raw(glm::unpackI3x10_1x2(packed));
+        glm::vec3 modern = glm::max(raw / 511.0f, glm::vec3(-1.0f));
+        glm::vec3 legacy = (raw * 2.0f + 1.0f) / 1023.0f;
+        return std::max(angleDegrees(normal, modern), angleDegrees(normal, legacy));
+    }
+
+    glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+
+    void addAttribute(PackedVertexLayout &layout, uint32_t location, uint32_t type, uint32_t components)
+    {
+        PackedVertexAttribute &attribute = layout.attributes[layout.attributeCount++];
+        attribute.location = location;
+        attribute.type = type;
+        attribute.components = components;
+        attribute.offset = layout.stride;
+
+        // Keep every attribute 4-byte aligned
+        layout.stride += (attributeSize(type, components) + 3) & ~3u;
+    }
+}
+
+void packVertices(const MeshData &mesh, PackedVertexLayout &outLayout,
+                  std::vector<unsigned char> &outVertices, VertexPackError *outError)
+{
+    size_t vertexCount = mesh.vertices.size();
+    bool haveUvs = mesh.uvs.size() == vertexCount;
+    bool haveNormals = mesh.normals.size() == vertexCount;
+    bool haveTangents = mesh.tangents.size() == vertexCount;
+
+    glm::vec3 minimum(0.0f), maximum(0.0f);
+    if (vertexCount > 0)
+    {
+        minimum = maximum = mesh.vertices[0];
+        for (const glm::vec3 &position : mesh.vertices)
+        {
+            minimum = glm::min(minimum, position);
+            maximum = glm::max(maximum, position);
+        }
+    }
+    glm::vec3 extent = maximum - minimum;
+    glm::vec3 inverseExtent;
+    for (int axis = 0; axis < 3; axis++)
+        inverseExtent[axis] = extent[axis] > 0.0f ? 1.0f / extent[axis] : 0.0f;
+    float diagonal = glm::length(extent);
+
+    // Round trip every vertex through the compact formats
+    VertexPackError compact = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        const glm::vec3 &position = mesh.vertices[v];
+        glm::vec3 decoded;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            uint16_t quantised = glm::packUnorm1x16((position[axis] - minimum[axis]) * inverseExtent[axis]);
+            decoded[axis] = minimum[axis] + extent[axis] * glm::unpackUnorm1x16(quantised);
+        }
+        if (diagonal > 0.0f)
+            compact.position = std::max(compact.position, glm::length(decoded - position) / diagonal);
+
+        if (haveUvs)
+        {
+            for (int axis = 0; axis < 2; axis++)
+            {
+                float uv = mesh.uvs[v][axis];
+                compact.uv = std::max(compact.uv, fabsf(glm::unpackHalf1x16(glm::packHalf1x16(uv)) - uv));
+            }
+        }
+
+        if (haveNormals)
+        {
+            glm::vec3 normal = safeNormalize(mesh.normals[v]);
+            uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+            compact.normalDegrees = std::max(compact.normalDegrees, snorm10Error(normal, packed));
+        }
+
+        // The sign in w is exact, so only the direction can lose precision
+        if (haveTangents)
+        {
+            glm::vec3 tangent = safeNormalize(glm::vec3(mesh.tangents[v]));
+            uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4(tangent, mesh.tangents[v].w));
+            compact.tangentDegrees = std::max(compact.tangentDegrees, snorm10Error(tangent, packed));
+        }
+    }
+
+    bool positions16 = compact.position <= positionTolerance;
+    bool uvs16 = compact.uv <= uvTolerance;
+    bool normals10 = compact.normalDegrees <= normalToleranceDegrees;
+    bool tangents10 = compact.tangentDegrees <= normalToleranceDegrees;
+
+    // Lay out the attributes in the order the shader declares them
+    memset(&outLayout, 0, sizeof(outLayout));
+    addAttribute(outLayout, PACKED_POSITION, positions16 ? PACKED_UNORM16 : PACKED_FLOAT32, 3);
+    if (haveNormals)
+        addAttribute(outLayout, PACKED_NORMAL, normals10 ? PACKED_SNORM10 : PACKED_FLOAT32, normals10 ? 4 : 3);
+    if (haveUvs)
+        addAttribute(outLayout, PACKED_UV, uvs16 ? PACKED_FLOAT16 : PACKED_FLOAT32, 2);
+    if (haveTangents)
+        addAttribute(outLayout, PACKED_TANGENT, tangents10 ? PACKED_SNORM10 : PACKED_FLOAT32, 4);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        outLayout.positionOffset[axis] = positions16 ? minimum[axis] : 0.0f;
+        outLayout.positionScale[axis] = positions16 ? extent[axis] : 1.0f;
+    }
+
+    outVertices.assign(vertexCount * outLayout.stride, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        unsigned char *vertex = &outVertices[v * outLayout.stride];
+        for (uint32_t a = 0; a < outLayout.attributeCount; a++)
+        {
+            const PackedVertexAttribute &attribute = outLayout.attributes[a];
+            unsigned char *out = vertex + attribute.offset;
+
+            if (attribute.location == PACKED_POSITION && attribute.type == PACKED_UNORM16)
+            {
+                uint16_t quantised[3];
+                for (int axis = 0; axis < 3; axis++)
+                    quantised[axis] = glm::packUnorm1x16((mesh.vertices[v][axis] - minimum[axis]) * inverseExtent[axis]);
+                memcpy(out, quantised, sizeof(quantised));
+            }
+            else if (attribute.location == PACKED_POSITION)
+                memcpy(out, &mesh.vertices[v], sizeof(glm::vec3));
+            else if (attribute.location == PACKED_NORMAL && attribute.type == PACKED_SNORM10)
+            {
+                uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4(safeNormalize(mesh.normals[v]), 0.0f));
+                memcpy(out, &packed, sizeof(packed));
+            }
+            else if (attribute.location == PACKED_NORMAL)
+                memcpy(out, &mesh.normals[v], sizeof(glm::vec3));
+            else if (attribute.location == PACKED_UV && attribute.type == PACKED_FLOAT16)
+            {
+                uint16_t half[2] = { glm::packHalf1x16(mesh.uvs[v].x), glm::packHalf1x16(mesh.uvs[v].y) };
+                memcpy(out, half, sizeof(half));
+            }
+            else if (attribute.location == PACKED_UV)
+                memcpy(out, &mesh.uvs[v], sizeof(glm::vec2));
+            else if (attribute.location == PACKED_TANGENT && attribute.type == PACKED_SNORM10)
+            {
+                glm::vec4 tangent(safeNormalize(glm::vec3(mesh.tangents[v])), mesh.tangents[v].w);
+                uint32_t packed = glm::packSnorm3x10_1x2(tangent);
+                memcpy(out, &packed, sizeof(packed));
+            }
+            else if (attribute.location == PACKED_TANGENT)
+                memcpy(out, &mesh.tangents[v], sizeof(glm::vec4));
+        }
+    }
+
+    // Float attributes are exact
+    if (outError)
+    {
+        outError->position = positions16 ? compact.position : 0.0f;
+        outError->uv = uvs16 ? compact.uv : 0.0f;
+        outError->normalDegrees = normals10 ? compact.normalDegrees : 0.0f;
+        outError->tangentDegrees = tangents10 ? compact.tangentDegrees : 0.0f;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "objloader.hpp"
+
+// Storage of one vertex attribute in a packed vertex
+enum PackedVertexType
+{
+    PACKED_FLOAT32 = 1,     // GL_FLOAT
+    PACKED_FLOAT16,         // GL_HALF_FLOAT
+    PACKED_UNORM16,         // GL_UNSIGNED_SHORT, normalised
+    PACKED_SNORM10          // GL_INT_2_10_10_10_REV, normalised, 4 components
+};
+
+// Shader attribute locations of the vertex streams
+enum PackedVertexLocation
+{
+    PACKED_POSITION = 0,
+    PACKED_NORMAL = 1,
+    PACKED_UV = 2,
+    PACKED_TANGENT = 3      // w is the bitangent sign
+};
+
+struct PackedVertexAttribute
+{
+    uint32_t location;
+    uint32_t type;          // PackedVertexType
+    uint32_t components;
+    uint32_t offset;        // bytes from the start of the vertex
+};
+
+// Interleaved vertex layout, stored in the mesh cache so the VAO can be set
+// up from it. UNORM16 positions are relative to the mesh bounds and decode as
+// positionOffset + positionScale * value.
+struct PackedVertexLayout
+{
+    uint32_t stride;
+    uint32_t attributeCount;
+    PackedVertexAttribute attributes[6];
+    float positionOffset[3];
+    float positionScale[3];
+};
+
+// Largest difference between the original and the decoded vertices
+struct VertexPackError
+{
+    float position;         // fraction of the bounding box diagonal
+    float uv;               // in texture coordinate units
+    float normalDegrees;
+    float tangentDegrees;
+};
+
+// Pack the vertex streams of a mesh into one interleaved buffer. Each
+// attribute uses its compact format unless decoding it back would exceed
+// the visually lossless tolerance, in which case it stays as floats.
+void packVertices(const MeshData &mesh, PackedVertexLayout &outLayout,
+                  std::vector<unsigned char> &outVertices, VertexPackError *outError = NULL);
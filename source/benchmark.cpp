@@ -0,0 +1,1310 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <common/objloader.hpp>
+#include <common/meshopt.hpp>
+#include <common/meshcache.hpp>
+#include <common/vertexpack.hpp>
+#include <common/tangents.hpp>
+#include <common/simplify.hpp>
+#include <common/meshlet.hpp>
+#include <common/frustum.hpp>
+#include <common/maths.hpp>
+#include <common/scenebvh.hpp>
+#include <common/parallel.hpp>
+#include <common/fileutil.hpp>
+#include <common/bcn.hpp>
+#include <common/texturecache.hpp>
+#include <common/threadpool.hpp>
+#include <common/mipmap.hpp>
+#include <common/model.hpp>
+#include <common/texturestreamer.hpp>
+#include <common/textureresidency.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+
+// Benchmarks for the asset loading code. Run from the source/ directory so
+// the relative asset paths resolve. Pass the name of a benchmark to run just
+// that one, or nothing to run them all.
+
+static const char *benchmarkModels[] = {
+    "../assets/bunny.obj",
+    "../assets/bowling_pin.obj",
+    "../assets/stonealtar.obj"
+};
+
+static const char *allModels[] = {
+    "../assets/Ball.obj",
+    "../assets/Cube.obj",
+    "../assets/barrel.obj",
+    "../assets/bowling_pin.obj",
+    "../assets/bunny.obj",
+    "../assets/crate.obj",
+    "../assets/stonealtar.obj"
+};
+
+struct TextureAsset
+{
+    const char *path;
+    const char *type;
+};
+
+static const TextureAsset benchmarkTextures[] = {
+    { "../assets/floor.jpg",          "diffuse" },
+    { "../assets/floor_normal.jpg",   "normal" },
+    { "../assets/floor_spec.jpg",     "spec" },
+    { "../assets/altar.jpg",          "diffuse" },
+    { "../assets/tile_floor.jpg",     "diffuse" },
+    { "../assets/crate.jpg",          "diffuse" },
+    { "../assets/barrel_diffuse.png", "diffuse" }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Throughput of the in-memory .obj parser, with and without file reads
+void benchmarkObjParse()
+{
+    const int iterations = 20;
+
+    printf("\n== OBJ parse throughput (best of %d) ==\n", iterations);
+    printf("%-28s %10s %10s %12s %12s %12s\n",
+           "file", "MB", "triangles", "parse MB/s", "parse tri/s", "load MB/s");
+
+    for (const char *path : benchmarkModels)
+    {
+        std::vector<char> data;
+        if (!readFile(path, data))
+        {
+            printf("%-28s could not be opened\n", path);
+            continue;
+        }
+        size_t size = data.size() - 1;
+
+        double bestParse = 1e30, bestLoad = 1e30;
+        size_t triangles = 0;
+        for (int i = 0; i < iterations; i++)
+        {
+            MeshData mesh;
+
+            auto start = std::chrono::steady_clock::now();
+            if (!parseObj(data.data(), size, mesh))
+                break;
+            bestParse = std::min(bestParse, secondsSince(start));
+            triangles = mesh.indices.size() / 3;
+
+            start = std::chrono::steady_clock::now();
+            loadObjFile(path, mesh);
+            bestLoad = std::min(bestLoad, secondsSince(start));
+        }
+
+        double megabytes = size / (1024.0 * 1024.0);
+        printf("%-28s %10.2f %10zu %12.1f %12.3g %12.1f\n",
+               path, megabytes, triangles,
+               megabytes / bestParse, triangles / bestParse, megabytes / bestLoad);
+    }
+}
+
+static bool sameMesh(const MeshData &a, const MeshData &b)
+{
+    return a.vertices.size() == b.vertices.size() &&
+           a.indices.size() == b.indices.size() &&
+           memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(glm::vec3)) == 0 &&
+           memcmp(a.uvs.data(), b.uvs.data(), a.uvs.size() * sizeof(glm::vec2)) == 0 &&
+           memcmp(a.normals.data(), b.normals.data(), a.normals.size() * sizeof(glm::vec3)) == 0 &&
+           memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(unsigned int)) == 0;
+}
+
+// Build a large synthetic .obj of a height-field grid. Alternate rows use
+// relative (negative) face indices so the chunk merge has to resolve them.
+static std::string makeGridObj(int size)
+{
+    std::string obj;
+    obj.reserve(static_cast<size_t>(size) * size * 170);
+
+    char line[256];
+    for (int z = 0; z < size; z++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            float u = static_cast<float>(x) / (size - 1);
+            float v = static_cast<float>(z) / (size - 1);
+            float height = 0.1f * sinf(u * 20.0f) * cosf(v * 20.0f);
+            snprintf(line, sizeof(line), "v %f %f %f\nvt %f %f\nvn %f %f %f\n",
+                     u, height, v, u, v, 0.0f, 1.0f, 0.0f);
+            obj += line;
+        }
+
+        if (z == 0)
+            continue;
+
+        // Faces between this row and the previous one
+        for (int x = 1; x < size; x++)
+        {
+            int a = (z - 1) * size + x;
+            int b = a + 1;
+            int c = a + size;
+            int d = c + 1;
+            if (z % 2 == 0)
+            {
+                int count = (z + 1) * size;
+                a -= count + 1;
+                b -= count + 1;
+                c -= count + 1;
+                d -= count + 1;
+            }
+            snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                     a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+            obj += line;
+        }
+    }
+    return obj;
+}
+
+// Wall-clock scaling of the chunked parser with thread count
+void benchmarkObjThreads()
+{
+    const int iterations = 3;
+    std::string obj = makeGridObj(700);
+    double megabytes = obj.size() / (1024.0 * 1024.0);
+
+    printf("\n== OBJ parse thread scaling, %.1f MB synthetic grid (best of %d, %u cores) ==\n",
+           megabytes, iterations, defaultObjThreadCount());
+    printf("%8s %12s %12s %10s %10s\n", "threads", "seconds", "MB/s", "speedup", "matches");
+
+    MeshData reference;
+    double singleThreaded = 0.0;
+    for (unsigned int threads : { 1u, 2u, 4u, 8u, 16u })
+    {
+        double best = 1e30;
+        MeshData mesh;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if (!parseObj(obj.data(), obj.size(), mesh, threads))
+                return;
+            best = std::min(best, secondsSince(start));
+        }
+
+        // Every thread count must produce exactly the single-threaded output
+        if (threads == 1)
+        {
+            singleThreaded = best;
+            reference = mesh;
+        }
+        bool matches = sameMesh(mesh, reference);
+
+        printf("%8u %12.3f %12.1f %9.2fx %10s\n",
+               threads, best, megabytes / best, singleThreaded / best, matches ? "yes" : "NO");
+    }
+}
+
+// Memory and vertex shader work of indexed meshes against the expanded
+// triangle soup that glDrawArrays used to draw
+void benchmarkIndexed()
+{
+    printf("\n== Indexed vs expanded meshes (32 entry FIFO cache) ==\n");
+    printf("%-28s %9s %9s %10s %10s %8s %9s %10s %8s\n", "file", "corners", "vertices",
+           "soup KB", "indexed KB", "saved", "soup VS", "indexed VS", "saved");
+
+    for (const char *path : allModels)
+    {
+        MeshData mesh;
+        if (!loadObjFile(path, mesh))
+            continue;
+
+        // Expanded: 32 bytes per corner. Indexed: 32 bytes per unique vertex
+        // plus 16 or 32-bit indices, as chosen by Model::setupBuffers.
+        size_t corners = mesh.indices.size();
+        size_t vertexBytes = sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3);
+        size_t indexBytes = mesh.vertices.size() <= 65536 ? 2 : 4;
+        double soupKB = corners * vertexBytes / 1024.0;
+        double indexedKB = (mesh.vertices.size() * vertexBytes + corners * indexBytes) / 1024.0;
+
+        // glDrawArrays shades every corner, glDrawElements only cache misses
+        VertexCacheStats stats = analyzeVertexCache(mesh.indices.data(), corners, mesh.vertices.size());
+
+        printf("%-28s %9zu %9zu %10.1f %10.1f %7.1f%% %9zu %10zu %7.1f%%\n",
+               path, corners, mesh.vertices.size(), soupKB, indexedKB,
+               100.0 * (1.0 - indexedKB / soupKB), corners, stats.vertexShaderInvocations,
+               100.0 * (1.0 - static_cast<double>(stats.vertexShaderInvocations) / corners));
+    }
+}
+
+// Read every stream of a loaded mesh, as glBufferData would, so page faults
+// on the mapped file are part of the measurement
+static bool touchMeshStreams(const CachedMesh &mesh)
+{
+    static std::vector<unsigned char> upload;
+    for (uint32_t type : { MESH_SECTION_VERTICES, MESH_SECTION_INDICES })
+    {
+        size_t size;
+        const void *data = mesh.section(type, &size);
+        if (data == NULL)
+            return false;
+        upload.resize(size);
+        memcpy(upload.data(), data, size);
+    }
+    return true;
+}
+
+// Startup cost of loading each mesh with no cache (parse, cook and write)
+// against mapping an existing cache, both including the upload copy
+void benchmarkMeshCache()
+{
+    const int iterations = 20;
+
+    printf("\n== Mesh cache cold vs warm load (best of %d) ==\n", iterations);
+    printf("%-28s %10s %10s %10s %8s\n", "file", "cache KB", "cold ms", "warm ms", "speedup");
+
+    double totalCold = 0.0, totalWarm = 0.0;
+    for (const char *path : allModels)
+    {
+        std::string cachePath = meshCachePath(path);
+        double bestCold = 1e30, bestWarm = 1e30;
+        bool ok = true;
+        for (int i = 0; i < iterations && ok; i++)
+        {
+            remove(cachePath.c_str());
+
+            CachedMesh mesh;
+            auto start = std::chrono::steady_clock::now();
+            ok = mesh.load(path) && !mesh.wasWarm();
+            ok = ok && touchMeshStreams(mesh);
+            bestCold = std::min(bestCold, secondsSince(start));
+            mesh.release();
+
+            start = std::chrono::steady_clock::now();
+            ok = ok && mesh.load(path) && mesh.wasWarm();
+            ok = ok && touchMeshStreams(mesh);
+            bestWarm = std::min(bestWarm, secondsSince(start));
+        }
+
+        uint64_t cacheSize = 0;
+        int64_t modifiedTime;
+        getFileInfo(cachePath.c_str(), cacheSize, modifiedTime);
+        if (!ok)
+        {
+            printf("%-28s failed\n", path);
+            continue;
+        }
+
+        totalCold += bestCold;
+        totalWarm += bestWarm;
+        printf("%-28s %10.1f %10.3f %10.3f %7.1fx\n", path, cacheSize / 1024.0,
+               bestCold * 1000.0, bestWarm * 1000.0, bestCold / bestWarm);
+    }
+    printf("%-28s %10s %10.3f %10.3f %7.1fx\n", "total", "",
+           totalCold * 1000.0, totalWarm * 1000.0, totalCold / totalWarm);
+}
+
+// Vertex cache efficiency and overdraw of every mesh before and after
+// optimizeMesh, and the time it adds to cooking a cache
+void benchmarkMeshOpt()
+{
+    printf("\n== Mesh optimisation (32 entry FIFO cache, overdraw from 6 axis views) ==\n");
+    printf("%-28s %10s %15s %15s %15s %10s\n", "file", "triangles",
+           "ACMR", "ATVR", "overdraw", "time ms");
+
+    for (const char *path : allModels)
+    {
+        MeshData mesh;
+        if (!loadObjFile(path, mesh))
+            continue;
+
+        size_t vertexCount = mesh.vertices.size();
+        OverdrawStats overdrawBefore = analyzeOverdraw(mesh.indices.data(), mesh.indices.size(),
+                                                       mesh.vertices.data(), vertexCount);
+
+        MeshOptimizationStats stats;
+        auto start = std::chrono::steady_clock::now();
+        optimizeMesh(mesh, &stats);
+        double seconds = secondsSince(start);
+
+        OverdrawStats overdrawAfter = analyzeOverdraw(mesh.indices.data(), mesh.indices.size(),
+                                                      mesh.vertices.data(), vertexCount);
+
+        printf("%-28s %10zu %6.3f -> %5.3f %6.3f -> %5.3f %6.3f -> %5.3f %10.2f\n",
+               path, mesh.indices.size() / 3,
+               stats.before.acmr, stats.after.acmr, stats.before.atvr, stats.after.atvr,
+               overdrawBefore.overdraw, overdrawAfter.overdraw, seconds * 1000.0);
+    }
+}
+
+// Vertex memory of the packed interleaved format against float streams, and
+// the worst round trip error of the quantisation
+void benchmarkVertexPack()
+{
+    printf("\n== Packed vertex format ==\n");
+    printf("%-28s %9s %8s %8s %10s %10s %12s %12s %10s %11s\n", "file", "vertices", "bytes", "packed",
+           "float KB", "packed KB", "position", "uv texels", "normal deg", "tangent deg");
+
+    size_t totalFloat = 0, totalPacked = 0;
+    for (const char *path : allModels)
+    {
+        MeshData mesh;
+        if (!loadObjFile(path, mesh))
+            continue;
+
+        generateTangents(mesh);
+
+        PackedVertexLayout layout;
+        std::vector<unsigned char> vertices;
+        VertexPackError error;
+        packVertices(mesh, layout, vertices, &error);
+
+        size_t floatBytes = sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3) + sizeof(glm::vec4);
+        size_t vertexCount = mesh.vertices.size();
+        totalFloat += vertexCount * floatBytes;
+        totalPacked += vertices.size();
+
+        // Position error as a fraction of the model's size, uv error in
+        // texels of a 1024 texture
+        printf("%-28s %9zu %8zu %8u %10.1f %10.1f %11.5f%% %12.3f %10.3f %11.3f\n",
+               path, vertexCount, floatBytes, layout.stride,
+               vertexCount * floatBytes / 1024.0, vertices.size() / 1024.0,
+               error.position * 100.0f, error.uv * 1024.0f, error.normalDegrees, error.tangentDegrees);
+    }
+    printf("%-28s %9s %8s %8s %10.1f %10.1f %7.1f%% saved\n", "total", "", "", "",
+           totalFloat / 1024.0, totalPacked / 1024.0, 100.0 * (1.0 - static_cast<double>(totalPacked) / totalFloat));
+}
+
+// Cost of generating tangents at load time, for every asset and with 1 to
+// 16 threads on a large synthetic mesh
+void benchmarkTangents()
+{
+    const int iterations = 3;
+
+    printf("\n== Tangent generation (best of %d) ==\n", iterations);
+    printf("%-28s %9s %9s %9s %10s\n", "file", "vertices", "split", "mirrored", "ms");
+
+    for (const char *path : allModels)
+    {
+        MeshData source;
+        if (!loadObjFile(path, source))
+            continue;
+
+        MeshData mesh;
+        double best = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            mesh = source;
+            auto start = std::chrono::steady_clock::now();
+            generateTangents(mesh);
+            best = std::min(best, secondsSince(start));
+        }
+
+        size_t mirrored = 0;
+        for (const glm::vec4 &tangent : mesh.tangents)
+            mirrored += tangent.w < 0.0f;
+        printf("%-28s %9zu %9zu %9zu %10.3f\n", path, source.vertices.size(),
+               mesh.vertices.size() - source.vertices.size(), mirrored, best * 1000.0);
+    }
+
+    std::string obj = makeGridObj(700);
+    MeshData grid;
+    if (!parseObj(obj.data(), obj.size(), grid))
+        return;
+
+    printf("\n%8s %12s %10s   (%zu vertex grid, %u cores)\n", "threads", "ms", "speedup",
+           grid.vertices.size(), defaultObjThreadCount());
+    double singleThreaded = 0.0;
+    for (unsigned int threads : { 1u, 2u, 4u, 8u, 16u })
+    {
+        double best = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            MeshData mesh = grid;
+            auto start = std::chrono::steady_clock::now();
+            generateTangents(mesh, threads);
+            best = std::min(best, secondsSince(start));
+        }
+        if (threads == 1)
+            singleThreaded = best;
+        printf("%8u %12.2f %9.2fx\n", threads, best * 1000.0, singleThreaded / best);
+    }
+}
+
+// Triangles and error of each simplified level, and the level the render
+// queue would pick for the bowling pin at increasing distances
+void benchmarkLod()
+{
+    printf("\n== Levels of detail (error budget %.1f%% of radius) ==\n", meshCacheDefaultLodError * 100.0f);
+    printf("%-28s %6s %10s %10s %10s %10s\n", "file", "level", "triangles", "kept", "error", "ms");
+
+    MeshData pin;
+    for (const char *path : allModels)
+    {
+        MeshData mesh;
+        if (!loadObjFile(path, mesh))
+            continue;
+        generateTangents(mesh);
+
+        auto start = std::chrono::steady_clock::now();
+        generateLods(mesh, meshCacheDefaultLodError);
+        double seconds = secondsSince(start);
+
+        size_t fullTriangles = 0;
+        for (size_t l = 0; l < mesh.lods.size(); l++)
+        {
+            const MeshLod &lod = mesh.lods[l];
+            size_t triangles = 0;
+            for (unsigned int i = 0; i < lod.subMeshCount; i++)
+                triangles += mesh.subMeshes[lod.firstSubMesh + i].indexCount / 3;
+            if (l == 0)
+                fullTriangles = triangles;
+            if (l == 0)
+                printf("%-28s %6zu %10zu %9.1f%% %10.5f %10.2f\n", path, l, triangles, 100.0, lod.error, seconds * 1000.0);
+            else
+                printf("%-28s %6zu %10zu %9.1f%% %10.5f\n", "", l, triangles,
+                       100.0 * triangles / fullTriangles, lod.error);
+
+            // Coarser levels must have larger errors for selectLod to step
+            // through them with distance
+            if (l > 0 && lod.error <= mesh.lods[l - 1].error)
+                printf("%-28s error does not grow from level %zu\n", "", l - 1);
+        }
+
+        if (strstr(path, "bowling_pin"))
+            pin = mesh;
+    }
+
+    if (pin.lods.empty())
+        return;
+
+    // Same scale and projection as the coursework scene
+    glm::vec3 minimum = pin.vertices[0], maximum = pin.vertices[0];
+    for (const glm::vec3 &position : pin.vertices)
+    {
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    float scale = 3.5f;
+    float radius = 0.5f * glm::length(maximum - minimum) * scale;
+    float pixelsPerUnit = 768.0f / (2.0f * tanf(glm::radians(45.0f) * 0.5f));
+
+    printf("\n%10s %6s %10s %12s   (bowling pin, radius %.1f)\n", "distance", "level", "triangles",
+           "error px", radius);
+    for (float distance : { 50.0f, 100.0f, 200.0f, 400.0f, 800.0f, 1600.0f, 3200.0f })
+    {
+        unsigned int level = selectLod(pin.lods.data(), pin.lods.size(), scale, distance - radius, pixelsPerUnit);
+        const MeshLod &lod = pin.lods[level];
+        size_t triangles = 0;
+        for (unsigned int i = 0; i < lod.subMeshCount; i++)
+            triangles += pin.subMeshes[lod.firstSubMesh + i].indexCount / 3;
+        printf("%10.0f %6u %10zu %12.3f\n", distance, level, triangles,
+               lod.error * scale * pixelsPerUnit / (distance - radius));
+    }
+}
+
+// Meshlet sizes and the vertex cache cost of clustering, then the share of
+// triangles left after frustum and backface cone culling with the camera
+// circling each model
+void benchmarkMeshlets()
+{
+    printf("\n== Meshlets ==\n");
+    printf("%-28s %9s %9s %9s %16s %8s %10s\n", "file", "meshlets", "avg tris", "cullable",
+           "ACMR", "ms", "drawn");
+
+    for (const char *path : allModels)
+    {
+        MeshData mesh;
+        if (!loadObjFile(path, mesh))
+            continue;
+        optimizeMesh(mesh);
+        float acmrBefore = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size()).acmr;
+
+        auto start = std::chrono::steady_clock::now();
+        buildMeshlets(mesh);
+        double seconds = secondsSince(start);
+        float acmrAfter = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size()).acmr;
+
+        size_t cullable = 0;
+        for (const Meshlet &meshlet : mesh.meshlets)
+            cullable += meshlet.coneCutoff < 1.0f;
+
+        // Eight cameras around the model at three times its radius, with the
+        // coursework's projection
+        glm::vec3 minimum = mesh.vertices[0], maximum = mesh.vertices[0];
+        for (const glm::vec3 &position : mesh.vertices)
+        {
+            minimum = glm::min(minimum, position);
+            maximum = glm::max(maximum, position);
+        }
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        float radius = 0.5f * glm::length(maximum - minimum);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, radius * 0.1f, radius * 10.0f);
+
+        size_t drawn = 0, total = 0;
+        std::vector<IndexRange> ranges;
+        for (int view = 0; view < 8; view++)
+        {
+            float angle = view * 3.14159265f / 4.0f;
+            glm::vec3 camera = center + 3.0f * radius * glm::vec3(cosf(angle), 0.5f, sinf(angle));
+            glm::mat4 viewMatrix = glm::lookAt(camera, center, glm::vec3(0.0f, 1.0f, 0.0f));
+
+            ranges.clear();
+            cullMeshlets(mesh.meshlets.data(), mesh.meshlets.size(), extractFrustum(projection * viewMatrix),
+                         camera, ranges);
+            for (const IndexRange &range : ranges)
+                drawn += range.indexCount / 3;
+            total += mesh.indices.size() / 3;
+        }
+
+        printf("%-28s %9zu %9.1f %9zu %7.3f -> %5.3f %8.2f %9.1f%%\n", path, mesh.meshlets.size(),
+               mesh.indices.size() / 3.0 / mesh.meshlets.size(), cullable, acmrBefore, acmrAfter,
+               seconds * 1000.0, 100.0 * drawn / total);
+    }
+}
+
+// Cost of frustum culling scenes of randomly placed props per frame, with
+// the coursework's projection and a camera looking into the scene
+void benchmarkCulling()
+{
+    const int frames = 20;
+
+    MeshData bunny;
+    if (!loadObjFile("../assets/bunny.obj", bunny))
+        return;
+    BoundingVolume bounds;
+    bounds.min = bounds.max = bunny.vertices[0];
+    for (const glm::vec3 &position : bunny.vertices)
+    {
+        bounds.min = glm::min(bounds.min, position);
+        bounds.max = glm::max(bounds.max, position);
+    }
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+    bounds.radius = 0.0f;
+    for (const glm::vec3 &position : bunny.vertices)
+        bounds.radius = std::max(bounds.radius, glm::length(position - bounds.center));
+
+    Mat4 projection = PerspectiveFov(45.0f, 16.0f / 9.0f, 0.1f, 10000.0f);
+    Mat4 view = LookAt(Vec3(0.0f, 100.0f, 0.0f), Vec3(0.0f, 100.0f, -1.0f), Vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = extractFrustum(glm::make_mat4(Multiply(projection, view).data()));
+
+    printf("\n== Frustum culling (best of %d frames) ==\n", frames);
+    printf("%10s %10s %10s %12s %12s %12s\n", "objects", "drawn", "culled", "sphere only", "ms", "ns/object");
+
+    for (size_t objectCount : { 1000u, 10000u, 100000u })
+    {
+        // Props scattered through a 4000 unit cube around the camera
+        std::vector<glm::mat4> matrices(objectCount);
+        unsigned int seed = 12345;
+        auto random = [&seed]()
+        {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) / 16777216.0f;
+        };
+        for (glm::mat4 &matrix : matrices)
+        {
+            glm::vec3 position(random() * 4000.0f - 2000.0f, random() * 4000.0f - 2000.0f, random() * 4000.0f - 2000.0f);
+            matrix = glm::translate(glm::mat4(1.0f), position) *
+                     glm::rotate(glm::mat4(1.0f), random() * 6.2831853f, glm::vec3(0.0f, 1.0f, 0.0f)) *
+                     glm::scale(glm::mat4(1.0f), glm::vec3(50.0f + random() * 200.0f));
+        }
+
+        double best = 1e30;
+        size_t drawn = 0, sphereOnly = 0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            drawn = 0;
+            for (const glm::mat4 &matrix : matrices)
+                drawn += volumeInFrustum(frustum, transformVolume(bounds, matrix));
+            best = std::min(best, secondsSince(start));
+        }
+        for (const glm::mat4 &matrix : matrices)
+        {
+            BoundingVolume world = transformVolume(bounds, matrix);
+            sphereOnly += sphereInFrustum(frustum, world.center, world.radius);
+        }
+
+        printf("%10zu %10zu %10zu %12zu %12.3f %12.1f\n", objectCount, drawn, objectCount - drawn, sphereOnly,
+               best * 1000.0, best * 1e9 / objectCount);
+    }
+}
+
+// Scene BVH build, refit and query times against testing every object, for
+// scenes of randomly placed boxes at the same density
+void benchmarkBvh()
+{
+    const int iterations = 3;
+    const int rays = 1000;
+
+    printf("\n== Scene BVH (best of %d) ==\n", iterations);
+    printf("%9s %7s %10s %10s %10s %11s %8s %10s %10s %10s %10s\n", "objects", "nodes", "build ms", "threads",
+           "refit ms", "refit 1% ms", "visible", "cull ms", "flat ms", "pick us", "flat us");
+
+    for (size_t objectCount : { 1000u, 100000u, 1000000u })
+    {
+        unsigned int seed = 12345;
+        auto random = [&seed]()
+        {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) / 16777216.0f;
+        };
+
+        float side = 100.0f * cbrtf(static_cast<float>(objectCount));
+        std::vector<BoundingVolume> objects(objectCount);
+        for (BoundingVolume &object : objects)
+        {
+            glm::vec3 center(random() * side, random() * side, random() * side);
+            glm::vec3 extent(1.0f + random() * 20.0f, 1.0f + random() * 20.0f, 1.0f + random() * 20.0f);
+            object.min = center - extent;
+            object.max = center + extent;
+            object.center = center;
+            object.radius = glm::length(extent);
+        }
+
+        SceneBvh bvh;
+        double buildSingle = 1e30, buildParallel = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            bvh.build(objects.data(), objects.size(), 1);
+            buildSingle = std::min(buildSingle, secondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            bvh.build(objects.data(), objects.size());
+            buildParallel = std::min(buildParallel, secondsSince(start));
+        }
+
+        // Everything moves a little, or one object in a hundred moves
+        std::vector<BoundingVolume> moved = objects;
+        for (BoundingVolume &object : moved)
+        {
+            glm::vec3 offset(random() * 10.0f, random() * 10.0f, random() * 10.0f);
+            object.min += offset;
+            object.max += offset;
+            object.center += offset;
+        }
+        double refitAll = 1e30, refitSome = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            bvh.refit(moved.data());
+            refitAll = std::min(refitAll, secondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            for (size_t object = 0; object < objectCount; object += 100)
+                bvh.refitObject(static_cast<unsigned int>(object), objects[object]);
+            refitSome = std::min(refitSome, secondsSince(start));
+        }
+        bvh.build(objects.data(), objects.size());
+
+        // A camera at one corner looking across the scene
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, side);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(side), glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = extractFrustum(projection * view);
+
+        std::vector<unsigned int> visible;
+        double cullTree = 1e30, cullFlat = 1e30;
+        size_t flatVisible = 0;
+        for (int i = 0; i < iterations; i++)
+        {
+            visible.clear();
+            auto start = std::chrono::steady_clock::now();
+            bvh.cull(frustum, visible);
+            cullTree = std::min(cullTree, secondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            flatVisible = 0;
+            for (const BoundingVolume &object : objects)
+                flatVisible += boxInFrustum(frustum, object.min, object.max);
+            cullFlat = std::min(cullFlat, secondsSince(start));
+        }
+
+        // Rays from the camera corner; the flat test runs on fewer of them
+        std::vector<glm::vec3> directions(rays);
+        for (glm::vec3 &direction : directions)
+            direction = glm::vec3(0.5f + random(), 0.5f + random(), 0.5f + random());
+        auto start = std::chrono::steady_clock::now();
+        size_t mismatches = 0;
+        std::vector<int> hits(rays);
+        for (int r = 0; r < rays; r++)
+            hits[r] = bvh.pick(glm::vec3(0.0f), directions[r]);
+        double pickTree = secondsSince(start) / rays;
+
+        int flatRays = objectCount > 100000 ? 10 : 100;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < flatRays; r++)
+        {
+            int nearest = -1;
+            float nearestDistance = 1e30f;
+            glm::vec3 inverseDirection = 1.0f / directions[r];
+            for (size_t object = 0; object < objectCount; object++)
+            {
+                glm::vec3 t1 = (objects[object].min) * inverseDirection;
+                glm::vec3 t2 = (objects[object].max) * inverseDirection;
+                glm::vec3 near = glm::min(t1, t2), far = glm::max(t1, t2);
+                float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+                float exit = std::min(std::min(far.x, far.y), far.z);
+                if (exit >= enter && enter < nearestDistance)
+                {
+                    nearestDistance = enter;
+                    nearest = static_cast<int>(object);
+                }
+            }
+            mismatches += nearest != hits[r];
+        }
+        double pickFlat = secondsSince(start) / flatRays;
+
+        printf("%9zu %7zu %10.2f %9.2fx %10.3f %11.3f %7.1f%% %10.3f %10.3f %10.2f %10.1f\n", objectCount, bvh.nodeCount(),
+               buildSingle * 1000.0, buildSingle / buildParallel, refitAll * 1000.0, refitSome * 1000.0,
+               100.0 * visible.size() / objectCount, cullTree * 1000.0, cullFlat * 1000.0, pickTree * 1e6, pickFlat * 1e6);
+        if (visible.size() != flatVisible || mismatches > 0)
+            printf("  mismatch: %zu culled visible against %zu, %zu picks differ\n",
+                   visible.size(), flatVisible, mismatches);
+    }
+    printf("(threads: speedup of building on %u threads over one)\n", hardwareThreadCount());
+}
+
+// Peak signal to noise ratio of the first channels of two RGBA8 images
+static double psnr(const unsigned char *a, const unsigned char *b, size_t pixelCount, int channels)
+{
+    double squaredError = 0.0;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            double difference = static_cast<double>(a[i * 4 + c]) - b[i * 4 + c];
+            squaredError += difference * difference;
+        }
+    }
+    squaredError /= static_cast<double>(pixelCount) * channels;
+    return squaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / squaredError) : 99.0;
+}
+
+// Block compression of every texture in its cache format: encode time,
+// video memory against the uncompressed upload with mipmaps, error of the
+// top level, and the load time of a cold cache against a warm one
+void benchmarkTexCompress()
+{
+    static const char *formatNames[] = { "", "BC1", "BC3", "BC5", "BC7" };
+    const int warmIterations = 5;
+
+    printf("\n== Texture block compression (%u threads, warm best of %d) ==\n", hardwareThreadCount(), warmIterations);
+    printf("%-30s %11s %6s %10s %9s %9s %6s %8s %10s %9s %8s\n", "file", "size", "format", "encode ms",
+           "raw KB", "BCn KB", "ratio", "PSNR dB", "decode ms", "warm ms", "speedup");
+
+    double totalRaw = 0.0, totalCompressed = 0.0, totalCold = 0.0, totalWarm = 0.0;
+    for (const TextureAsset &texture : benchmarkTextures)
+    {
+        int width, height, components;
+        auto start = std::chrono::steady_clock::now();
+        unsigned char *pixels = stbi_load(texture.path, &width, &height, &components, 4);
+        double decode = secondsSince(start);
+        if (!pixels)
+        {
+            printf("%-30s failed\n", texture.path);
+            continue;
+        }
+
+        // Encode the same way the cache does, then measure the top level
+        uint32_t usage = textureUsage(texture.type);
+        bool hasAlpha = false;
+        for (size_t i = 3; i < static_cast<size_t>(width) * height * 4 && !hasAlpha; i += 4)
+            hasAlpha = pixels[i] != 255;
+        uint32_t format = textureCacheFormat(usage, hasAlpha);
+
+        CompressedTexture compressed;
+        start = std::chrono::steady_clock::now();
+        compressTexture(pixels, width, height, usage, 0, format, compressed);
+        double encode = secondsSince(start);
+
+        std::vector<unsigned char> decoded(static_cast<size_t>(width) * height * 4);
+        decompressImage(compressed.levels[0].data(), width, height, format, decoded.data());
+        int channels = format == BLOCK_BC5 ? 2 : (hasAlpha ? 4 : 3);
+        double error = psnr(pixels, decoded.data(), static_cast<size_t>(width) * height, channels);
+        stbi_image_free(pixels);
+
+        // Drivers store 8-bit RGB as 4 bytes per texel, plus a third for mips
+        double rawBytes = static_cast<double>(width) * height * 4 * 4.0 / 3.0;
+        double compressedBytes = 0.0;
+        for (const std::vector<unsigned char> &level : compressed.levels)
+            compressedBytes += level.size();
+
+        std::string cachePath = textureCachePath(texture.path, usage, 0);
+        remove(cachePath.c_str());
+        uint64_t contentHash;
+        bool warm;
+        start = std::chrono::steady_clock::now();
+        bool ok = loadTextureCache(texture.path, usage, 0, compressed, contentHash, &warm) && !warm;
+        double cold = secondsSince(start);
+        double bestWarm = 1e30;
+        for (int i = 0; i < warmIterations && ok; i++)
+        {
+            start = std::chrono::steady_clock::now();
+            ok = loadTextureCache(texture.path, usage, 0, compressed, contentHash, &warm) && warm;
+            bestWarm = std::min(bestWarm, secondsSince(start));
+        }
+        if (!ok)
+        {
+            printf("%-30s failed\n", texture.path);
+            continue;
+        }
+
+        totalRaw += rawBytes;
+        totalCompressed += compressedBytes;
+        totalCold += cold;
+        totalWarm += bestWarm;
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", width, height);
+        printf("%-30s %11s %6s %10.1f %9.0f %9.0f %5.1fx %8.2f %10.1f %9.2f %7.0fx\n", texture.path, size,
+               formatNames[format], encode * 1000.0, rawBytes / 1024.0, compressedBytes / 1024.0,
+               rawBytes / compressedBytes, error, decode * 1000.0, bestWarm * 1000.0, decode / bestWarm);
+    }
+    printf("%-30s %11s %6s %10s %9.0f %9.0f %5.1fx %8s %10s %9.2f   (cold cache load %.1f ms)\n", "total", "", "", "",
+           totalRaw / 1024.0, totalCompressed / 1024.0, totalRaw / totalCompressed, "", "",
+           totalWarm * 1000.0, totalCold * 1000.0);
+}
+
+// Wall-clock time to decode every texture with one task per image on 1 to
+// 16 threads, as Model::loadTextures does, from files already in memory
+void benchmarkTexDecode()
+{
+    const int iterations = 3;
+
+    std::vector<std::vector<char>> files;
+    double megapixels = 0.0;
+    for (const TextureAsset &texture : benchmarkTextures)
+    {
+        files.push_back(std::vector<char>());
+        int width, height, components;
+        if (!readFile(texture.path, files.back()) ||
+            !stbi_info_from_memory(reinterpret_cast<const stbi_uc *>(files.back().data()),
+                                   static_cast<int>(files.back().size() - 1), &width, &height, &components))
+        {
+            printf("%s failed\n", texture.path);
+            return;
+        }
+        megapixels += width * height / 1e6;
+    }
+
+    printf("\n== Texture decode thread scaling, %zu images, %.1f megapixels (best of %d, %u cores) ==\n",
+           files.size(), megapixels, iterations, hardwareThreadCount());
+    printf("%8s %12s %12s %10s\n", "threads", "ms", "MPixel/s", "speedup");
+
+    double singleThreaded = 0.0;
+    for (unsigned int threads : { 1u, 2u, 4u, 8u, 16u })
+    {
+        double best = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            ThreadPool pool(threads);
+            auto start = std::chrono::steady_clock::now();
+            for (const std::vector<char> &file : files)
+            {
+                pool.submit([&file]
+                {
+                    int width, height, components;
+                    stbi_set_flip_vertically_on_load_thread(1);
+                    stbi_image_free(stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(file.data()),
+                                                          static_cast<int>(file.size() - 1),
+                                                          &width, &height, &components, 4));
+                });
+            }
+            pool.wait();
+            best = std::min(best, secondsSince(start));
+        }
+
+        if (threads == 1)
+            singleThreaded = best;
+        printf("%8u %12.1f %12.1f %9.2fx\n", threads, best * 1000.0, megapixels / best, singleThreaded / best);
+    }
+    printf("(the largest image bounds the speedup: floor*.jpg are 12.6 megapixels each)\n");
+}
+
+// Filter an image down to 1x1, returning the seconds taken and the last level
+static double buildMipChain(const unsigned char *rgba, int width, int height, uint32_t content,
+                            uint32_t filter, unsigned int threads, unsigned char outLast[4])
+{
+    std::vector<unsigned char> level(rgba, rgba + static_cast<size_t>(width) * height * 4), next;
+    auto start = std::chrono::steady_clock::now();
+    while (width > 1 || height > 1)
+    {
+        downsampleImage(level.data(), width, height, content, filter, next, threads);
+        level.swap(next);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    double seconds = secondsSince(start);
+    memcpy(outLast, level.data(), 4);
+    return seconds;
+}
+
+static double srgbToLinear(unsigned char value)
+{
+    double c = value / 255.0;
+    return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+// Time to build every texture's mip chain on the CPU with each filter, and
+// how far the 1x1 level of the colour maps drifts from the image's mean
+// brightness when filtered in linear light against straight on sRGB bytes
+void benchmarkMipmap()
+{
+    printf("\n== CPU mip chain generation (%u threads) ==\n", hardwareThreadCount());
+    printf("%-30s %8s %10s %10s %13s %9s %12s %12s\n", "file", "content", "box ms", "kaiser ms",
+           "kaiser 1t ms", "speedup", "sRGB drift", "naive drift");
+
+    static const char *contentNames[] = { "", "linear", "sRGB", "normal" };
+    for (const TextureAsset &texture : benchmarkTextures)
+    {
+        int width, height, components;
+        unsigned char *pixels = stbi_load(texture.path, &width, &height, &components, 4);
+        if (!pixels)
+        {
+            printf("%-30s failed\n", texture.path);
+            continue;
+        }
+
+        uint32_t content = textureMipContent(textureUsage(texture.type));
+        unsigned char last[4];
+        double box = buildMipChain(pixels, width, height, content, MIP_FILTER_BOX, 0, last);
+        double kaiserSingle = buildMipChain(pixels, width, height, content, MIP_FILTER_KAISER, 1, last);
+        double kaiser = buildMipChain(pixels, width, height, content, MIP_FILTER_KAISER, 0, last);
+
+        // Mean of the green channel in linear light, the 1x1 level's target
+        char correct[16] = "", naive[16] = "";
+        if (content == MIP_CONTENT_SRGB)
+        {
+            double mean = 0.0;
+            for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+                mean += srgbToLinear(pixels[i * 4 + 1]);
+            mean /= static_cast<double>(width) * height;
+
+            unsigned char naiveLast[4];
+            buildMipChain(pixels, width, height, MIP_CONTENT_LINEAR, MIP_FILTER_KAISER, 0, naiveLast);
+            snprintf(correct, sizeof(correct), "%+.1f%%", 100.0 * (srgbToLinear(last[1]) - mean) / mean);
+            snprintf(naive, sizeof(naive), "%+.1f%%", 100.0 * (srgbToLinear(naiveLast[1]) - mean) / mean);
+        }
+        stbi_image_free(pixels);
+
+        printf("%-30s %8s %10.1f %10.1f %13.1f %8.2fx %12s %12s\n", texture.path, contentNames[content],
+               box * 1000.0, kaiser * 1000.0, kaiserSingle * 1000.0, kaiserSingle / kaiser, correct, naive);
+    }
+}
+
+static void printFrameTimes(const char *name, std::vector<double> &frames, double seconds)
+{
+    std::sort(frames.begin(), frames.end());
+    auto percentile = [&frames](double p) { return frames[static_cast<size_t>(p * (frames.size() - 1))] * 1000.0; };
+    printf("%-10s %8zu %10.2f %9.2f %9.2f %9.2f %9.2f\n", name, frames.size(), seconds,
+           percentile(0.5), percentile(0.95), percentile(0.99), frames.back() * 1000.0);
+}
+
+// A hidden window with a GL 3.3 context made current, or NULL after saying
+// the benchmark is skipped. On machines without a display run under Xvfb,
+// with LIBGL_ALWAYS_SOFTWARE=1 for Mesa's software renderer.
+static GLFWwindow *openHiddenWindow(const char *benchmarkName)
+{
+    if (!glfwInit())
+    {
+        printf("\n== %s: GLFW failed to initialise, skipped ==\n", benchmarkName);
+        return NULL;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "Benchmark", NULL, NULL);
+    if (window)
+    {
+        glfwMakeContextCurrent(window);
+        glewExperimental = true;
+    }
+    if (!window || glewInit() != GLEW_OK)
+    {
+        printf("\n== %s: no GL 3.3 context, skipped ==\n", benchmarkName);
+        glfwTerminate();
+        return NULL;
+    }
+    glfwSwapInterval(0);
+    return window;
+}
+
+// A full mip chain of noise
+static void makeNoiseTexture(uint32_t format, unsigned int size, uint32_t seed, CompressedTexture &outTexture)
+{
+    outTexture.format = format;
+    outTexture.width = outTexture.height = size;
+    outTexture.levels.clear();
+    for (unsigned int level = size; ; level /= 2)
+    {
+        outTexture.levels.push_back(std::vector<unsigned char>(compressedImageSize(format, level, level)));
+        for (unsigned char &byte : outTexture.levels.back())
+        {
+            seed = seed * 1664525u + 1013904223u;
+            byte = static_cast<unsigned char>(seed >> 24);
+        }
+        if (level == 1)
+            break;
+    }
+}
+
+// Frame time of streaming a level's worth of textures, as the asset loader
+// hands them to GL: blocking glCompressedTexImage2D calls for up to 4 ms a
+// frame, against the pixel buffer ring at 4 MB a frame. Needs a GL context,
+// so it opens a hidden window.
+void benchmarkTexStream()
+{
+    const unsigned int textureCount = 500, size = 512;
+    const double handOffBudget = 0.004;
+    const size_t bytesPerFrame = 4 << 20;
+
+    GLFWwindow *window = openHiddenWindow("Texture streaming");
+    if (!window)
+        return;
+
+    // A full mip chain of noise in the colour maps' format, or BC1 without it
+    GLenum internalFormat;
+    CompressedTexture source;
+    makeNoiseTexture(glBlockFormat(BLOCK_BC7, internalFormat) ? BLOCK_BC7 : BLOCK_BC1, size, 1, source);
+    size_t textureBytes = 0;
+    for (const std::vector<unsigned char> &level : source.levels)
+        textureBytes += level.size();
+
+    printf("\n== Texture streaming, %u %ux%u %s textures, %.1f MB (%s) ==\n", textureCount, size, size,
+           source.format == BLOCK_BC7 ? "BC7" : "BC1", textureCount * textureBytes / 1048576.0,
+           reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+    printf("%-10s %8s %10s %9s %9s %9s %9s\n", "upload", "frames", "seconds", "p50 ms", "p95 ms", "p99 ms", "max ms");
+
+    std::vector<TextureHandle> textures;
+    bool match = false;
+    for (int streamed = 0; streamed < 2; streamed++)
+    {
+        // The streamer takes the levels it is given, so each texture needs its own
+        std::vector<CompressedTexture> copies(streamed ? textureCount : 0, source);
+        TextureStreamer streamer(bytesPerFrame);
+        std::vector<double> frames;
+        unsigned int handedOff = 0;
+        size_t finished = 0;
+
+        auto start = std::chrono::steady_clock::now(), frameStart = start;
+        while (finished < textureCount)
+        {
+            // Textures ready this frame, at least one, as AssetLoader::update
+            auto handOffStart = std::chrono::steady_clock::now();
+            while (handedOff < textureCount)
+            {
+                textures.push_back(std::make_shared<GpuTexture>());
+                if (streamed)
+                {
+                    streamer.upload(textures.back(), copies[handedOff]);
+                }
+                else
+                {
+                    glGenTextures(1, &textures.back()->id);
+                    textures.back()->owned = true;
+                    Model::uploadCompressedTexture(*textures.back(), source);
+                    finished++;
+                }
+                handedOff++;
+                if (secondsSince(handOffStart) >= handOffBudget)
+                    break;
+            }
+            if (streamed)
+                finished += streamer.update();
+
+            glClear(GL_COLOR_BUFFER_BIT);
+            glfwSwapBuffers(window);
+            auto now = std::chrono::steady_clock::now();
+            frames.push_back(std::chrono::duration<double>(now - frameStart).count());
+            frameStart = now;
+        }
+        glFinish();
+        double seconds = secondsSince(start);
+        printFrameTimes(streamed ? "ring" : "blocking", frames, seconds);
+
+        // The last texture streamed in has every level intact
+        if (streamed)
+        {
+            match = true;
+            glBindTexture(GL_TEXTURE_2D, textures.back()->id);
+            for (size_t level = 0; level < source.levels.size(); level++)
+            {
+                std::vector<unsigned char> readBack(source.levels[level].size());
+                glGetCompressedTexImage(GL_TEXTURE_2D, static_cast<GLint>(level), readBack.data());
+                match = match && readBack == source.levels[level];
+            }
+        }
+        textures.clear();
+    }
+    printf("(ring frames copy at most %zu KB; streamed levels read back %s)\n", bytesPerFrame / 1024,
+           match ? "identical" : "DIFFERENT");
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
+// Mip level residency of a row of large textures under a budget a fraction
+// of their full chains, with the camera moving down the row: each texture
+// streams in its large levels as the camera nears it and loses them once
+// passed. The textures are KTX2 files of noise written to the current
+// directory and deleted afterwards. Needs a GL context, so it opens a
+// hidden window.
+void benchmarkResidency()
+{
+    const unsigned int textureCount = 24, size = 2048, frameCount = 600;
+    const size_t budget = 16 << 20;
+    const float spacing = 8.0f, radius = 2.0f, cameraOffset = 3.0f;
+    const float pixelsPerUnit = 768.0f / (2.0f * tanf(glm::radians(45.0f) * 0.5f));
+
+    GLFWwindow *window = openHiddenWindow("Texture residency");
+    if (!window)
+        return;
+
+    std::vector<CompressedTexture> sources(textureCount);
+    std::vector<std::string> paths(textureCount);
+    std::vector<TextureHandle> textures(textureCount);
+    size_t chainBytes = 0;
+    TextureResidency residency(budget);
+    TextureStreamer streamer;
+    bool written = true;
+    for (unsigned int i = 0; i < textureCount; i++)
+    {
+        makeNoiseTexture(BLOCK_BC1, size, i + 1, sources[i]);
+        std::vector<unsigned char> file;
+        writeKtx2(sources[i], Ktx2KeyValues(), file);
+        paths[i] = "residency_" + std::to_string(i) + ".ktx2";
+        written = writeFileAtomic(paths[i].c_str(), file.data(), file.size()) && written;
+
+        // The small levels up front, as the asset loader uploads them
+        textures[i] = std::make_shared<GpuTexture>();
+        CompressedTexture copy = sources[i];
+        size_t firstLevel = residency.add(textures[i], paths[i].c_str(), copy) ? residency.initialLevel(copy) : 0;
+        streamer.upload(textures[i], copy, firstLevel);
+        for (const std::vector<unsigned char> &level : sources[i].levels)
+            chainBytes += level.size();
+    }
+    while (streamer.pendingCount() > 0)
+        streamer.update(true);
+
+    TextureResidencyStats initial = residency.stats();
+    printf("\n== Texture residency, %u %ux%u BC1 textures, %.1f MB of full chains in a %.0f MB budget (%s) ==\n",
+           textureCount, size, size, chainBytes / 1048576.0, budget / 1048576.0,
+           reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+    if (!written || initial.textures != textureCount)
+        printf("(only %u of the textures are managed)\n", initial.textures);
+    printf("%-10s %8s %10s %9s %9s %9s %9s\n", "camera", "frames", "seconds", "p50 ms", "p95 ms", "p99 ms", "max ms");
+
+    // Down the row and back, the textures sized on screen by their distance
+    std::vector<double> frames;
+    size_t peakBytes = initial.residentBytes;
+    auto start = std::chrono::steady_clock::now(), frameStart = start;
+    for (unsigned int frame = 0; frame < frameCount; frame++)
+    {
+        float t = static_cast<float>(frame) / (frameCount / 2);
+        float cameraX = (t <= 1.0f ? t : 2.0f - t) * spacing * (textureCount - 1);
+        for (unsigned int i = 0; i < textureCount; i++)
+        {
+            float distance = glm::length(glm::vec2(i * spacing - cameraX, cameraOffset)) - radius;
+            residency.request(textures[i], 2.0f * radius * pixelsPerUnit / std::max(distance, 1e-3f));
+        }
+        residency.update();
+        peakBytes = std::max(peakBytes, residency.stats().residentBytes);
+
+        glClear(GL_COLOR_BUFFER_BIT);
+        glfwSwapBuffers(window);
+        auto now = std::chrono::steady_clock::now();
+        frames.push_back(std::chrono::duration<double>(now - frameStart).count());
+        frameStart = now;
+    }
+    glFinish();
+    double seconds = secondsSince(start);
+    printFrameTimes("moving", frames, seconds);
+
+    TextureResidencyStats stats = residency.stats();
+    printf("(started with %.1f MB, peak %.1f MB %s the budget; %u levels loaded, %u evicted)\n",
+           initial.residentBytes / 1048576.0, peakBytes / 1048576.0, peakBytes <= budget ? "within" : "OVER",
+           stats.loads, stats.evictions);
+
+    // Resident bytes of each texture once the camera is back at the start,
+    // and the levels in video memory match the files
+    bool match = true;
+    printf("resident KB:");
+    for (unsigned int i = 0; i < textureCount; i++)
+    {
+        const GpuTexture &texture = *textures[i];
+        printf("%s %zu", i % 12 == 0 ? "\n " : "", residency.residentBytes(texture) / 1024);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        for (size_t level = texture.baseLevel; level < sources[i].levels.size(); level++)
+        {
+            std::vector<unsigned char> readBack(sources[i].levels[level].size());
+            glGetCompressedTexImage(GL_TEXTURE_2D, static_cast<GLint>(level), readBack.data());
+            match = match && readBack == sources[i].levels[level];
+        }
+    }
+    printf("\n(resident levels read back %s)\n", match ? "identical" : "DIFFERENT");
+
+    for (const std::string &path : paths)
+        remove(path.c_str());
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
+struct Benchmark
+{
+    const char *name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    { "objparse",   benchmarkObjParse },
+    { "objthreads", benchmarkObjThreads },
+    { "indexed",    benchmarkIndexed },
+    { "meshcache",  benchmarkMeshCache },
+    { "meshopt",    benchmarkMeshOpt },
+    { "vertexpack", benchmarkVertexPack },
+    { "tangents",   benchmarkTangents },
+    { "lod",        benchmarkLod },
+    { "meshlets",   benchmarkMeshlets },
+    { "culling",    benchmarkCulling },
+    { "bvh",        benchmarkBvh },
+    { "texcompress", benchmarkTexCompress },
+    { "texdecode",  benchmarkTexDecode },
+    { "mipmap",     benchmarkMipmap },
+    { "texstream",  benchmarkTexStream },
+    { "residency",  benchmarkResidency }
+};
+
+int main(int argc, char **argv)
+{
+    const char *only = argc > 1 ? argv[1] : NULL;
+
+    bool found = false;
+    for (const Benchmark &benchmark : benchmarks)
+    {
+        if (only && strcmp(only, benchmark.name) != 0)
+            continue;
+        benchmark.run();
+        found = true;
+    }
+
+    if (!found)
+    {
+        printf("Unknown benchmark %s. Available:", only);
+        for (const Benchmark &benchmark : benchmarks)
+            printf(" %s", benchmark.name);
+        printf("\n");
+        return 1;
+    }
+    return 0;
+}
@@ -1,15 +1,26 @@
 #include <iostream>
 #include <cmath>
+#include <chrono>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <glm/gtc/type_ptr.hpp>
 
 #include <common/shader.hpp>
+#include <common/uniforms.hpp>
+#include <common/uniformblocks.hpp>
 #include <common/texture.hpp>
 #include <common/maths.hpp>
 #include <common/camera.hpp>
 #include <common/model.hpp>
 #include <common/light.hpp>
+#include <common/renderqueue.hpp>
+#include <common/scenebvh.hpp>
+#include <common/assetloader.hpp>
+#include <common/texturearray.hpp>
+#include <common/textureresidency.hpp>
+#include <common/trace.hpp>
 #include "common/maths.hpp"
 
 struct LightSource
@@ -30,21 +41,58 @@ Camera camera(Vec3(0.0f, 140.0f, 340.5f));
 int CameraType  = 0;
 bool ToggleLight1 = true;
 bool ToggleLight2 = true;
+bool PickRequested = false;
 
 // Function prototypes
 void keyboardInput(GLFWwindow *window);
-int GetuniformLocation(unsigned int Program, const char* name);
-void setvec3(const char* name, glm::vec3 Data, unsigned int Program);
-
-void setFloat(const char* name, float Data, unsigned int Program);
 
 int main( void )
 {
+    auto startTime = std::chrono::steady_clock::now();
+    traceThreadName("Main");
+
+    // Read and decode the assets on worker threads while the window opens
+    // and the shaders compile. The models draw nothing until they arrive.
+    Model model;
+    Model StoneAltar;
+    Model bowlingPin;
+    Model Crate;
+    Model Barrel;
+
+    // Video memory for texture levels, less than the full chains of the
+    // scene so the floor's largest levels come and go with the camera
+    const size_t textureBudget = 32 << 20;
+    TextureResidency textureResidency(textureBudget);
+
+    AssetLoader assetLoader;
+    assetLoader.setResidency(&textureResidency);
+    assetLoader.loadModel(model, "../assets/Cube.obj");
+    assetLoader.addTexture(model, "../assets/floor.jpg", "diffuse");
+    assetLoader.addTexture(model, "../assets/floor_normal.jpg", "normal");
+    assetLoader.addTexture(model, "../assets/floor_spec.jpg", "spec");
+
+    assetLoader.loadModel(StoneAltar, "../assets/stonealtar.obj");
+    assetLoader.addTexture(StoneAltar, "../assets/altar.jpg", "diffuse");
+
+    assetLoader.loadModel(bowlingPin, "../assets/bowling_pin.obj");
+    assetLoader.addTexture(bowlingPin, "../assets/tile_floor.jpg", "diffuse");
+
+    assetLoader.loadModel(Crate, "../assets/crate.obj");
+    assetLoader.addTexture(Crate, "../assets/crate.jpg", "diffuse");
+
+    assetLoader.loadModel(Barrel, "../assets/barrel.obj");
+    assetLoader.addTexture(Barrel, "../assets/barrel_diffuse.png", "diffuse");
+
     // =========================================================================
     // Window creation - you shouldn't need to change this code
     // -------------------------------------------------------------------------
     // Initialise GLFW
-    if( !glfwInit() )
+    bool glfwReady;
+    {
+        TRACE_SCOPE("glfwInit");
+        glfwReady = glfwInit();
+    }
+    if( !glfwReady )
     {
         fprintf( stderr, "Failed to initialize GLFW\n" );
         getchar();
@@ -60,7 +108,10 @@ int main( void )
 
     // Open a window and create its OpenGL context
     GLFWwindow* window;
-    window = glfwCreateWindow(1024, 768, "Computer Graphics Coursework", NULL, NULL);
+    {
+        TRACE_SCOPE("glfwCreateWindow");
+        window = glfwCreateWindow(1024, 768, "Computer Graphics Coursework", NULL, NULL);
+    }
     
     if( window == NULL ){
         fprintf(stderr, "Failed to open GLFW window.\n");
@@ -72,7 +123,12 @@ int main( void )
 
     // Initialize GLEW
     glewExperimental = true; // Needed for core profile
-    if (glewInit() != GLEW_OK) {
+    GLenum glewStatus;
+    {
+        TRACE_SCOPE("glewInit");
+        glewStatus = glewInit();
+    }
+    if (glewStatus != GLEW_OK) {
         fprintf(stderr, "Failed to initialize GLEW\n");
         getchar();
         glfwTerminate();
@@ -84,7 +140,20 @@ int main( void )
     
     glfwSetMouseButtonCallback(window, (GLFWmousebuttonfun)[](GLFWwindow* window, int button, int action, int mod) 
     {
+        // Select the object under the cursor
         if (button == GLFW_MOUSE_BUTTON_1)
+        {
+            if (action == GLFW_PRESS)
+            {
+                PickRequested = true;
+            }
+        }
+    });
+
+
+    glfwSetKeyCallback(window, (GLFWkeyfun)[](GLFWwindow* window, int button, int scancode, int action, int mod)
+    {
+        if (button == GLFW_KEY_1)
         {
             if (action == GLFW_PRESS)
             {
@@ -92,18 +161,14 @@ int main( void )
             }
         }
 
-        if (button == GLFW_MOUSE_BUTTON_2)
+        if (button == GLFW_KEY_2)
         {
             if (action == GLFW_PRESS)
             {
                 ToggleLight2 = !ToggleLight2;
             }
         }
-    });
-
 
-    glfwSetKeyCallback(window, (GLFWkeyfun)[](GLFWwindow* window, int button, int scancode, int action, int mod)
-    {
         if (button == GLFW_KEY_3)
         {
             if (action == GLFW_PRESS)
@@ -127,6 +192,7 @@ int main( void )
     //shader setup
     unsigned int Program  =  LoadShaders("VertexShader.glsl", "fragmentShader.glsl");
     glUseProgram(Program);
+    setTextureUnits(Program);
 
     Mat4 ProjectionMatrix = PerspectiveFov(45.0f, 16.0f / 9.0f, 0.1f, 10000.0f);
     glm::mat4 ModelMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(500, 30, 500));
@@ -136,65 +202,75 @@ int main( void )
 
     //Model Cube = Model("")
     glm::mat4 PlaneModels = ModelMatrix;
-    Model model = Model("../assets/Cube.obj");
-    model.addTexture("../assets/floor.jpg", "diffuse");
-    model.addTexture("../assets/floor_normal.jpg", "normal");
-    model.addTexture("../assets/floor_spec.jpg", "spec");
-
-    Model StoneAltar = Model("../assets/stonealtar.obj");
-    StoneAltar.addTexture("../assets/altar.jpg", "diffuse");
-
-
-    Model bowlingPin = Model("../assets/bowling_pin.obj");
-    bowlingPin.addTexture("../assets/tile_floor.jpg", "diffuse");
 
+    // Scene objects, kept in a BVH for culling and mouse picking. Models
+    // still loading have empty bounds until the BVH is refit.
+    struct SceneObject
+    {
+        Model *model;
+        glm::mat4 modelMatrix;
+        const char *name;
+    };
+    SceneObject sceneObjects[] = {
+        { &StoneAltar, glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 20.0f, 1.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(70.5f)), "stone altar" },
+        { &bowlingPin, glm::translate(glm::mat4(1.0f), glm::vec3(60.0f, 80.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(3.5f)), "bowling pin" },
+        { &Crate, glm::translate(glm::mat4(1.0f), glm::vec3(-150.0f, 20.0f, 7.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(25.5f)), "crate" },
+        { &Barrel, glm::translate(glm::mat4(1.0f), glm::vec3(50.0f, 20.0f, 100.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(30.5f)), "barrel" }
+    };
+    const unsigned int sceneObjectCount = sizeof(sceneObjects) / sizeof(sceneObjects[0]);
 
-    Model Crate = Model("../assets/crate.obj");
-    Crate.addTexture("../assets/crate.jpg", "diffuse");
+    std::vector<BoundingVolume> sceneBounds;
+    for (const SceneObject &object : sceneObjects)
+        sceneBounds.push_back(object.model->worldBounds(object.modelMatrix));
+    SceneBvh sceneBvh;
+    sceneBvh.build(sceneBounds.data(), sceneBounds.size());
+    std::vector<unsigned int> visibleObjects;
+    int selectedObject = -1;
 
-    Model Barrel = Model("../assets/barrel.obj");
-    Crate.addTexture("../assets/crate.jpg", "diffuse");
+    // Models are drawn sorted by material
+    RenderQueue renderQueue;
+    double statsTime = glfwGetTime();
 
 
     // Position and Color data
     GLfloat verts[] = {
-        // Position            // Normal             // TexCoords   // Tangent
+        // Position            // Normal             // TexCoords   // Tangent and bitangent sign
 
         // Back Face (-Z)
-         0.5f,  0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   1.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   0.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
+         0.5f,  0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   1.0f, 1.0f,    1.0f, 0.0f, 0.0f, -1.0f,
+         0.5f, -0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   1.0f, 0.0f,    1.0f, 0.0f, 0.0f, -1.0f,
+        -0.5f, -0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   0.0f, 0.0f,    1.0f, 0.0f, 0.0f, -1.0f,
+        -0.5f,  0.5f, -0.5f,    0.0f,  0.0f, -1.0f,   0.0f, 1.0f,    1.0f, 0.0f, 0.0f, -1.0f,
 
         // Bottom Face (-Y)
-        -0.5f, -0.5f,  0.5f,    0.0f, -1.0f,  0.0f,   1.0f, 1.0f,    1.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,    0.0f, -1.0f,  0.0f,   1.0f, 0.0f,    1.0f, 0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,    0.0f, -1.0f,  0.0f,   0.0f, 0.0f,    1.0f, 0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,    0.0f, -1.0f,  0.0f,   0.0f, 1.0f,    1.0f, 0.0f, 0.0f,
+        -0.5f, -0.5f,  0.5f,    0.0f, -1.0f,  0.0f,   1.0f, 1.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+        -0.5f, -0.5f, -0.5f,    0.0f, -1.0f,  0.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+         0.5f, -0.5f, -0.5f,    0.0f, -1.0f,  0.0f,   0.0f, 0.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+         0.5f, -0.5f,  0.5f,    0.0f, -1.0f,  0.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
 
          // Left Face (-X)
-         -0.5f,  0.5f, -0.5f,   -1.0f,  0.0f,  0.0f,   1.0f, 1.0f,    0.0f, 0.0f, 1.0f,
-         -0.5f, -0.5f, -0.5f,   -1.0f,  0.0f,  0.0f,   1.0f, 0.0f,    0.0f, 0.0f, 1.0f,
-         -0.5f, -0.5f,  0.5f,   -1.0f,  0.0f,  0.0f,   0.0f, 0.0f,    0.0f, 0.0f, 1.0f,
-         -0.5f,  0.5f,  0.5f,   -1.0f,  0.0f,  0.0f,   0.0f, 1.0f,    0.0f, 0.0f, 1.0f,
+         -0.5f,  0.5f, -0.5f,   -1.0f,  0.0f,  0.0f,   1.0f, 1.0f,    0.0f, 0.0f, -1.0f, -1.0f,
+         -0.5f, -0.5f, -0.5f,   -1.0f,  0.0f,  0.0f,   1.0f, 0.0f,    0.0f, 0.0f, -1.0f, -1.0f,
+         -0.5f, -0.5f,  0.5f,   -1.0f,  0.0f,  0.0f,   0.0f, 0.0f,    0.0f, 0.0f, -1.0f, -1.0f,
+         -0.5f,  0.5f,  0.5f,   -1.0f,  0.0f,  0.0f,   0.0f, 1.0f,    0.0f, 0.0f, -1.0f, -1.0f,
 
          // Right Face (+X)
-          0.5f,  0.5f,  0.5f,    1.0f,  0.0f,  0.0f,   1.0f, 1.0f,    0.0f, 0.0f, -1.0f,
-          0.5f, -0.5f,  0.5f,    1.0f,  0.0f,  0.0f,   1.0f, 0.0f,    0.0f, 0.0f, -1.0f,
-          0.5f, -0.5f, -0.5f,    1.0f,  0.0f,  0.0f,   0.0f, 0.0f,    0.0f, 0.0f, -1.0f,
-          0.5f,  0.5f, -0.5f,    1.0f,  0.0f,  0.0f,   0.0f, 1.0f,    0.0f, 0.0f, -1.0f,
+          0.5f,  0.5f,  0.5f,    1.0f,  0.0f,  0.0f,   1.0f, 1.0f,    0.0f, 0.0f, 1.0f, -1.0f,
+          0.5f, -0.5f,  0.5f,    1.0f,  0.0f,  0.0f,   1.0f, 0.0f,    0.0f, 0.0f, 1.0f, -1.0f,
+          0.5f, -0.5f, -0.5f,    1.0f,  0.0f,  0.0f,   0.0f, 0.0f,    0.0f, 0.0f, 1.0f, -1.0f,
+          0.5f,  0.5f, -0.5f,    1.0f,  0.0f,  0.0f,   0.0f, 1.0f,    0.0f, 0.0f, 1.0f, -1.0f,
 
           // Top Face (+Y)
-          -0.5f,  0.5f, -0.5f,    0.0f,  1.0f,  0.0f,   1.0f, 1.0f,    1.0f, 0.0f, 0.0f,
-          -0.5f,  0.5f,  0.5f,    0.0f,  1.0f,  0.0f,   1.0f, 0.0f,    1.0f, 0.0f, 0.0f,
-           0.5f,  0.5f,  0.5f,    0.0f,  1.0f,  0.0f,   0.0f, 0.0f,    1.0f, 0.0f, 0.0f,
-           0.5f,  0.5f, -0.5f,    0.0f,  1.0f,  0.0f,   0.0f, 1.0f,    1.0f, 0.0f, 0.0f,
+          -0.5f,  0.5f, -0.5f,    0.0f,  1.0f,  0.0f,   1.0f, 1.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+          -0.5f,  0.5f,  0.5f,    0.0f,  1.0f,  0.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+           0.5f,  0.5f,  0.5f,    0.0f,  1.0f,  0.0f,   0.0f, 0.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+           0.5f,  0.5f, -0.5f,    0.0f,  1.0f,  0.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
 
            // Front Face (+Z)
-           -0.5f,  0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   1.0f, 1.0f,    1.0f, 0.0f, 0.0f,
-           -0.5f, -0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   1.0f, 0.0f,    1.0f, 0.0f, 0.0f,
-            0.5f, -0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   0.0f, 0.0f,    1.0f, 0.0f, 0.0f,
-            0.5f,  0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   0.0f, 1.0f,    1.0f, 0.0f, 0.0f,
+           -0.5f,  0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   1.0f, 1.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+           -0.5f, -0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+            0.5f, -0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   0.0f, 0.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
+            0.5f,  0.5f,  0.5f,    0.0f,  0.0f,  1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f, -1.0f,
     };
 
 
@@ -216,7 +292,7 @@ int main( void )
 
     unsigned int cubeVAO, VBO[2];
 
-    unsigned int nVertices = sizeof(verts) / (sizeof(verts[0]) * (3 + 3 + 2 + 3));
+    unsigned int nVertices = sizeof(verts) / (sizeof(verts[0]) * (3 + 3 + 2 + 4));
     unsigned int nIndices = sizeof(indices) / sizeof(indices[0]);
 
     glGenVertexArrays(1, &cubeVAO); // we can also generate multiple VAOs or buffers at the same time
@@ -227,16 +303,16 @@ int main( void )
     glBindBuffer(GL_ARRAY_BUFFER, VBO[0]); // Activates the buffer
     glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 12 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     //normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 12 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
     //texture attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 12 * sizeof(float), (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
     //tangent
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(8 * sizeof(float)));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(float), (void*)(8 * sizeof(float)));
     glEnableVertexAttribArray(3);
 
 
@@ -266,23 +342,62 @@ int main( void )
    // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
 
-    glUniformMatrix4fv(glGetUniformLocation(Program, "projection"), 1, false, ProjectionMatrix.data());
-    int modelLoc = glGetUniformLocation(Program, "model");
-    int viewLoc = glGetUniformLocation(Program, "view");
-    int ViewPositionloc = glGetUniformLocation(Program, "viewPosition");
-    int toggleLight1loc = glGetUniformLocation(Program, "toggleLight1");
-    int toggleLight2loc = glGetUniformLocation(Program, "toggleLight2");
-    int NomaANdSpecLoc = glGetUniformLocation(Program, "bUseNormAndSpec");
+    // Uniforms are looked up by name once here, from the table LoadShaders
+    // built, so frames make no location queries
+    const UniformTable &uniforms = uniformTable(Program);
+    int modelLoc = uniforms.find("model").location;
+    int NomaANdSpecLoc = uniforms.find("bUseNormAndSpec").location;
+    int positionOffsetLoc = uniforms.find("positionOffset").location;
+    int positionScaleLoc = uniforms.find("positionScale").location;
+
+    // The camera and lights go to every program through uniform blocks,
+    // written once a frame
+    UniformBlocks uniformBlocks;
+    FrameData frameData;
+    LightData lightData;
+    frameData.projection = glm::make_mat4(ProjectionMatrix.data());
+    frameData.padding = 0.0f;
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
 
     // Render loop
+    bool firstFrame = true;
     while (!glfwWindowShouldClose(window))
     {
         // Get inputs
         keyboardInput(window);
         
+        // Upload the assets that have loaded, for up to 4 ms a frame, and
+        // fit the BVH around models that just arrived. The tree was built
+        // while the models were still points, so it is built again over
+        // their real bounds once everything has loaded.
+        if (assetLoader.update(0.004) > 0)
+        {
+            for (unsigned int i = 0; i < sceneObjectCount; i++)
+                sceneBounds[i] = sceneObjects[i].model->worldBounds(sceneObjects[i].modelMatrix);
+
+            if (assetLoader.pendingCount() > 0)
+                sceneBvh.refit(sceneBounds.data());
+            else
+            {
+                sceneBvh.build(sceneBounds.data(), sceneBounds.size());
+
+                // Textures of the same format and size become layers of one
+                // array, so their materials draw without rebinding
+                TexturePackStats packStats = packTextureArrays(resourceCache().liveTextures());
+                printf("Packed %u textures into %u texture arrays, %u left as 2D textures\n",
+                       packStats.packed, packStats.arrays, packStats.unpacked);
+
+                ResourceCacheStats cacheStats = resourceCache().stats();
+                printf("Assets loaded after %.3f s: %zu textures (%u shared by path, %u by contents), "
+                       "%zu meshes (%u shared by path, %u by contents)\n",
+                       std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count(),
+                       resourceCache().textureCount(), cacheStats.textureHits, cacheStats.textureContentHits,
+                       resourceCache().meshCount(), cacheStats.meshHits, cacheStats.meshContentHits);
+            }
+        }
+        
         // Clear the window
         glClearColor(0.2f, 0.2f, 0.0f, 0.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -291,40 +406,38 @@ int main( void )
         ModelMatrix = PlaneModels;
         glUniformMatrix4fv(modelLoc, 1, false, &ModelMatrix[0][0]);
 
+        Mat4 ViewMatrix;
         if (CameraType == 0)
         {
-            glUniformMatrix4fv(viewLoc, 1, false, camera.GetViewMatrixCustonm().data());
+            ViewMatrix = camera.GetViewMatrixCustonm();
         }
 
 
         if (CameraType == 1)
         {
-            glUniformMatrix4fv(viewLoc, 1, false, camera.GetViewMatrixQuat().data());
+            ViewMatrix = camera.GetViewMatrixQuat();
         }
 
         if (CameraType == 2)
         {
-            glUniformMatrix4fv(viewLoc, 1, false, camera.GetViewMatrixQuat().data());
+            ViewMatrix = camera.GetViewMatrixQuat();
         }
+        frameData.view = glm::make_mat4(ViewMatrix.data());
+        frameData.viewPosition = glm::vec3(camera.Position.x, camera.Position.y, camera.Position.z);
 
-        glUniform3fv(ViewPositionloc, 1, &camera.Position.x);
-
-
-        for (int i = 0; i < 2; i++)
+        for (unsigned int i = 0; i < maxLights; i++)
         {
-            glUniform1i(toggleLight1loc, ToggleLight1);
-            glUniform1i(toggleLight2loc, ToggleLight2);
-
-
-
-            std::string IndexStringRepresentation = std::to_string(i);
-            std::string ConcatWithClassAccess = "lightSources[" + IndexStringRepresentation + "]";
-
-            setvec3((ConcatWithClassAccess + ".position").c_str(), Source[i].position, Program);
-            setvec3((ConcatWithClassAccess + ".ambientColor").c_str(), Source[i].ambientColor, Program);
-            setvec3((ConcatWithClassAccess + ".diffuseColor").c_str(), Source[i].diffuseColor, Program);
-            setvec3((ConcatWithClassAccess + ".specularColor").c_str(), Source[i].specularColor, Program);
+            LightSourceData &light = lightData.lightSources[i];
+            light.position = Source[i].position;
+            light.focalStrength = Source[i].focalStrength;
+            light.ambientColor = Source[i].ambientColor;
+            light.specularIntensity = Source[i].specularIntensity;
+            light.diffuseColor = Source[i].diffuseColor;
+            light.enabled = i == 0 ? ToggleLight1 : ToggleLight2;
+            light.specularColor = Source[i].specularColor;
+            light.padding = 0.0f;
         }
+        uniformBlocks.update(frameData, lightData);
 
         
         {
@@ -334,6 +447,10 @@ int main( void )
             //use The Texture Of this to Render the Below Object
             model.draw(Program, false);
 
+            // The cube's positions are plain floats, unlike the models'
+            glUniform3f(positionOffsetLoc, 0.0f, 0.0f, 0.0f);
+            glUniform3f(positionScaleLoc, 1.0f, 1.0f, 1.0f);
+
             glBindVertexArray(cubeVAO);
             glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_INT, (void*)0);
             glBindVertexArray(0);
@@ -343,38 +460,106 @@ int main( void )
         }
 
 
-        //Draw Other Models
-        ModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 20.0f, 1.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(70.5f));
-        glUniformMatrix4fv(modelLoc, 1, false, &ModelMatrix[0][0]);
-
-        StoneAltar.draw(Program, true);
-
-
-        //bowling Pin
-        ModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(60.0f, 80.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(3.5f));
-        glUniformMatrix4fv(modelLoc, 1, false, &ModelMatrix[0][0]);
-
-        bowlingPin.draw(Program, true);
-
-        //Crate
-        ModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-150.0f, 20.0f, 7.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(25.5f));
-        glUniformMatrix4fv(modelLoc, 1, false, &ModelMatrix[0][0]);
-
-        Crate.draw(Program, true);
+        // Models outside the view are skipped, those far from the camera draw a
+        // simpler level of detail, and meshlets facing away are not drawn
+        float pixelsPerUnit = 768.0f / (2.0f * tanf(glm::radians(45.0f) * 0.5f));
+        glm::mat4 viewProjection = glm::make_mat4(Multiply(ProjectionMatrix, ViewMatrix).data());
+        renderQueue.setCamera(glm::vec3(camera.Position.x, camera.Position.y, camera.Position.z),
+                              viewProjection, pixelsPerUnit);
+
+        //Draw Other Models, those the BVH finds inside the frustum
+        visibleObjects.clear();
+        sceneBvh.cull(extractFrustum(viewProjection), visibleObjects);
+        for (unsigned int object : visibleObjects)
+            renderQueue.submit(*sceneObjects[object].model, sceneObjects[object].modelMatrix);
+
+        renderQueue.flush(Program, modelLoc);
+
+        // Stream in the texture levels the visible objects and the floor
+        // need, evicting those no longer seen
+        glm::vec3 cameraPosition(camera.Position.x, camera.Position.y, camera.Position.z);
+        textureResidency.request(model, PlaneModels, cameraPosition, pixelsPerUnit);
+        for (unsigned int object : visibleObjects)
+            textureResidency.request(*sceneObjects[object].model, sceneObjects[object].modelMatrix,
+                                     cameraPosition, pixelsPerUnit);
+        textureResidency.update();
+
+        // Cast a ray through the cursor into the scene
+        if (PickRequested)
+        {
+            PickRequested = false;
+
+            double cursorX, cursorY;
+            int windowWidth, windowHeight;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+            glm::vec2 ndc(2.0f * cursorX / windowWidth - 1.0f, 1.0f - 2.0f * cursorY / windowHeight);
+
+            glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+            glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+            glm::vec3 rayOrigin = glm::vec3(nearPoint) / nearPoint.w;
+            glm::vec3 rayDirection = glm::vec3(farPoint) / farPoint.w - rayOrigin;
+
+            selectedObject = sceneBvh.pick(rayOrigin, rayDirection);
+            printf("Selected %s\n", selectedObject >= 0 ? sceneObjects[selectedObject].name : "nothing");
+        }
 
-        //barrel
-        ModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(50.0f, 20.0f, 100.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(30.5f));
-        glUniformMatrix4fv(modelLoc, 1, false, &ModelMatrix[0][0]);
+        // Show the state changes saved by sorting once a second
+        if (glfwGetTime() - statsTime > 1.0)
+        {
+            const RenderStats &sorted = renderQueue.sortedStats();
+            const RenderStats &unsorted = renderQueue.unsortedStats();
+            TextureResidencyStats residency = textureResidency.stats();
+
+            // Culled objects are those the BVH or the render queue left out;
+            // models still loading are neither drawn nor culled
+            unsigned int culledObjects = sorted.objectsCulled;
+            for (unsigned int i = 0; i < sceneObjectCount; i++)
+            {
+                const MeshHandle &mesh = sceneObjects[i].model->mesh;
+                if (mesh && mesh->loaded() &&
+                    std::find(visibleObjects.begin(), visibleObjects.end(), i) == visibleObjects.end())
+                    culledObjects++;
+            }
 
-        Barrel.draw(Program, true);
+            char title[512];
+            snprintf(title, sizeof(title),
+                     "Computer Graphics Coursework - %u draws, material binds %u (was %u), "
+                     "texture binds %u (was %u), uniforms %u (was %u), triangles %u (was %u), "
+                     "objects %u (%u culled), meshlets %u (%u culled), textures %.1f of %.0f MB, selected %s",
+                     sorted.draws, sorted.materialBinds, unsorted.materialBinds,
+                     sorted.textureBinds, unsorted.textureBinds,
+                     sorted.uniformCalls, unsorted.uniformCalls,
+                     sorted.triangles, unsorted.triangles,
+                     sorted.objects, culledObjects,
+                     sorted.meshlets, sorted.meshletsCulled,
+                     residency.residentBytes / 1048576.0, residency.budgetBytes / 1048576.0,
+                     selectedObject >= 0 ? sceneObjects[selectedObject].name : "nothing");
+            glfwSetWindowTitle(window, title);
+            statsTime = glfwGetTime();
+        }
 
 
         // Swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (firstFrame)
+        {
+            printf("First frame after %.3f s\n",
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+            firstFrame = false;
+        }
     }
     
-    // Close OpenGL window and terminate GLFW
+    // Where the startup time went, for chrome://tracing or ui.perfetto.dev
+    writeTrace("startup_trace.json");
+    printTraceSummary();
+
+    // Close OpenGL window and terminate GLFW. The models and textures still
+    // alive go with the context.
+    ResourceCache::contextDestroyed();
     glfwTerminate();
     return 0;
 }
@@ -426,34 +611,6 @@ void keyboardInput(GLFWwindow *window)
         camera.ProcessMouseMovement(0.0f, -keyboard_cursor_y);
     }
 
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
-    {
-        ToggleLight1 = !ToggleLight1;
-    }
-
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
-    {
-        ToggleLight2 = !ToggleLight2;
-    }
-
-
-}
-
-
-int GetuniformLocation(unsigned int Program, const char* name)
-{
-    return glGetUniformLocation(Program, name);
+    // The lights are toggled by the key callback, once per press
 }
 
-void setvec3(const char* name, glm::vec3 Data, unsigned int Program)
-{
-    int loc = GetuniformLocation(Program, name);
-    glUniform3f(loc, Data.x, Data.y, Data.z);
-}
-
-
-void setFloat(const char* name, float Data, unsigned int Program)
-{
-    int loc = GetuniformLocation(Program, name);
-    glUniform1f(loc, Data);
-}
\ No newline at end of file
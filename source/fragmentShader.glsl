@@ -1,14 +1,16 @@
 #version 330 core
 
+// members ordered so each float packs after a vec3, as LightSourceData in
+// uniformblocks.hpp lays them out
 struct LightSource 
 {
     vec3 position;	
+    float focalStrength;
     vec3 ambientColor;
+    float specularIntensity;
     vec3 diffuseColor;
+    bool enabled;
     vec3 specularColor;
-   
-    float focalStrength;
-    float specularIntensity;
 };
 
 #define TOTAL_LIGHTS 2
@@ -23,24 +25,44 @@ out vec4 outFragmentColor;
 uniform bool bUseNormAndSpec=false;
 uniform bool bUseTexture=true;
 uniform bool bUseLighting=true;
-uniform bool toggleLight1=true;
-uniform bool toggleLight2=true;
 uniform vec4 objectColor = vec4(1.0f);
 
 uniform sampler2D diffuseMap;
 uniform sampler2D specMap;
 uniform sampler2D normalMap;
 
-uniform vec3 viewPosition;
+// Maps packed into texture arrays are sampled from the array at their
+// layer, the others from the 2D map when their layer is -1
+uniform sampler2DArray diffuseArray;
+uniform sampler2DArray specArray;
+uniform sampler2DArray normalArray;
+uniform int diffuseLayer = -1;
+uniform int specLayer = -1;
+uniform int normalLayer = -1;
+
 uniform vec2 UVscale = vec2(1.0f, 1.0f);
-uniform LightSource lightSources[TOTAL_LIGHTS];
 
-uniform  float Ka;
-uniform  float Ks;
-uniform  float Kd;
+// camera and lights of the frame, written once a frame for every program
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+};
+
+layout (std140) uniform LightData
+{
+    LightSource lightSources[TOTAL_LIGHTS];
+};
+
+// material from the .mtl file
+uniform  vec3 Ka;
+uniform  vec3 Ks;
+uniform  vec3 Kd;
 uniform  float Ns;
 
 // function prototypes
+vec4 sampleMap(sampler2D map, sampler2DArray array, int layer, vec2 uv);
 vec3 CalcLightSource(LightSource light, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection);
 vec3 calcDirectionalLight(vec3 Dir, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection);
 
@@ -54,11 +76,10 @@ void main()
 
     if(bUseNormAndSpec)
 	{		
-		// obtain normals from normals map in range [0,1]
-		lightNormal = texture(normalMap, fragmentTextureCoordinate).rgb;
-		
-		// transform normals vector to range [-1,1]
-		lightNormal = normalize(lightNormal * 2.0 - 1.0);  
+		// obtain x and y from the two channel normal map, transformed to
+		// range [-1,1], and rebuild z since normals have unit length
+		vec2 normalXY = sampleMap(normalMap, normalArray, normalLayer, fragmentTextureCoordinate).rg * 2.0 - 1.0;
+		lightNormal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
 		
 		lightNormal = (TBN * lightNormal);//transformation to tangent space
 	}
@@ -71,23 +92,15 @@ void main()
 
       for(int i = 0; i < TOTAL_LIGHTS; i++)
       {
-        if(!toggleLight1 && i == 0 ) {
-            continue;
-         }
-
-        if(!toggleLight2 && i == 1 ) {
-            continue;
-         }
-
-
-         else{
+         if(lightSources[i].enabled)
+         {
            phongResult += CalcLightSource(lightSources[i], lightNormal, fragmentPosition, viewDirection); 
          }
       }   
     
       if(bUseTexture == true)
       {
-         vec4 textureColor = texture(diffuseMap, fragmentTextureCoordinate * UVscale);
+         vec4 textureColor = sampleMap(diffuseMap, diffuseArray, diffuseLayer, fragmentTextureCoordinate * UVscale);
          outFragmentColor = vec4(phongResult * textureColor.xyz, 1.0);
       }
       else
@@ -99,7 +112,7 @@ void main()
    {
       if(bUseTexture == true)
       {
-         outFragmentColor = texture(diffuseMap, fragmentTextureCoordinate * UVscale);
+         outFragmentColor = sampleMap(diffuseMap, diffuseArray, diffuseLayer, fragmentTextureCoordinate * UVscale);
       }
       else
       {
@@ -112,6 +125,11 @@ void main()
 }
 
 
+vec4 sampleMap(sampler2D map, sampler2DArray array, int layer, vec2 uv)
+{
+    return layer < 0 ? texture(map, uv) : texture(array, vec3(uv, float(layer)));
+}
+
 vec3 calcDirectionalLight(vec3 Dir, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection)
 {
    float intensity = 0.50f;
@@ -163,18 +181,18 @@ vec3 CalcLightSource(LightSource light, vec3 lightNormal, vec3 vertexPosition, v
 
     // Diffuse
     float impact = max(dot(lightNormal, lightDirection), 0.0);
-    diffuse = impact * light.diffuseColor * intensity;
+    diffuse = impact * light.diffuseColor * Kd * intensity;
 
-    // Specular
+    // Specular, with the material's exponent
     vec3 reflectDir = reflect(-lightDirection, lightNormal);
-    float specularComponent = pow(max(dot(viewDirection, reflectDir), 0.0), 32.0f);
+    float specularComponent = pow(max(dot(viewDirection, reflectDir), 0.0), Ns > 0.0 ? Ns : 32.0f);
 
     if(bUseNormAndSpec)
     {
-        specular = specularComponent * (light.specularIntensity * Ns) * light.specularColor * intensity * texture(specMap, fragmentTextureCoordinate).rgb;
+        specular = specularComponent * light.specularIntensity * Ks * light.specularColor * intensity * sampleMap(specMap, specArray, specLayer, fragmentTextureCoordinate).rgb;
     }
     else{
-        specular = specularComponent * (light.specularIntensity * Ns) * light.specularColor * intensity;
+        specular = specularComponent * light.specularIntensity * Ks * light.specularColor * intensity;
     }
 
     // Apply attenuation
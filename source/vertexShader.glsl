@@ -2,29 +2,40 @@
 layout (location = 0) in vec3 inVertexPosition;
 layout (location = 1) in vec3 inVertexNormal;
 layout (location = 2) in vec2 inTextureCoordinate;
-layout (location = 3) in vec3 inTangent;
+layout (location = 3) in vec4 inTangent;   // w is the bitangent sign
 
 out vec3 fragmentPosition;
 out vec3 fragmentVertexNormal;
 out vec2 fragmentTextureCoordinate;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// camera of the frame, written once a frame for every program
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+};
+
+// models store positions quantised to their bounds
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 out mat3 TBN;
 
 
 void main()
 {
-   fragmentPosition = vec3(model * vec4(inVertexPosition, 1.0));
-   gl_Position = projection * view * model * vec4(inVertexPosition, 1.0f);
+   vec3 position = positionOffset + positionScale * inVertexPosition;
+   fragmentPosition = vec3(model * vec4(position, 1.0));
+   gl_Position = projection * view * model * vec4(position, 1.0f);
    
    fragmentVertexNormal = transpose(inverse(mat3(model))) *  inVertexNormal;
    fragmentTextureCoordinate = inTextureCoordinate;
 
    vec3 N = normalize(inVertexNormal);
-   vec3 T = normalize(inTangent);
-   vec3 B = normalize(cross(T, N));
+   vec3 T = normalize(inTangent.xyz);
+   vec3 B = normalize(cross(N, T)) * (inTangent.w < 0.0 ? -1.0 : 1.0);
 
    TBN = mat3(T, B, N);
 }
\ No newline at end of file